@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * AllocationTracker.hpp
+ *
+ *  Created on: Oct 28, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_ALLOCATIONTRACKER_HPP_
+#define INCLUDE_ALLOCATIONTRACKER_HPP_
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Counts heap allocations by subsystem. Only builds with
+ * ENEMYCRAFT_TRACK_ALLOCATIONS count anything: they replace the global
+ * operator new and delete (see AllocationTracker.cpp), everywhere else the
+ * scopes are empty and cost nothing.
+ *
+ * Code says what it's doing with an AllocationScope, which tags every
+ * allocation the thread makes until the scope ends (ThreadPool hands the
+ * tag on to its workers). A scope can also forbid allocating: with strict
+ * mode on, an allocation in there prints the subsystem and aborts, so the
+ * debugger stops right at it. World::step() forbids it, steady ticks must
+ * not touch the heap (enemycraft-alloccheck checks this).
+ */
+class AllocationTracker {
+public:
+	enum Subsystem {
+		Untracked,
+		Simulation,
+		Forces,
+		Light,
+		Materials,
+		FlowFields,
+		Networking,
+		Rendering,
+		Effects,
+		NumSubsystems
+	};
+
+	struct Counts {
+		std::uint64_t allocations = 0, frees = 0, bytes = 0;
+	};
+
+	// What a thread is tagged with, to carry over to another one
+	struct Tag {
+		Subsystem subsystem;
+		bool forbidden;
+	};
+
+#ifdef ENEMYCRAFT_TRACK_ALLOCATIONS
+	static constexpr bool enabled = true;
+
+	static Counts getTotal(Subsystem subsystem);
+	static Tag getTag();
+	static void setTag(const Tag &tag);
+	static void setStrict(bool strict);
+
+	// Called by the operator new and delete replacements
+	static void recordAllocation(std::size_t bytes);
+	static void recordFree();
+#else
+	static constexpr bool enabled = false;
+
+	static Counts getTotal(Subsystem) {
+		return Counts();
+	}
+	static Tag getTag() {
+		return Tag { Untracked, false };
+	}
+	static void setTag(const Tag&) {
+	}
+	static void setStrict(bool) {
+	}
+#endif
+
+	/*
+	 * Ends a frame: what each subsystem allocated since the last call is
+	 * kept for getFrame() and handed to the Metrics. Main thread only.
+	 */
+	static void endFrame();
+	static Counts getFrame(Subsystem subsystem);
+
+	static const char* getName(Subsystem subsystem);
+};
+
+/**
+ * Tags the calling thread's allocations until the end of the scope
+ */
+class AllocationScope {
+public:
+	AllocationScope(AllocationTracker::Subsystem subsystem, bool forbid = false) :
+			previous(AllocationTracker::getTag()) {
+		AllocationTracker::setTag(AllocationTracker::Tag { subsystem, forbid
+				|| previous.forbidden });
+	}
+	AllocationScope(const AllocationTracker::Tag &tag) :
+			previous(AllocationTracker::getTag()) {
+		AllocationTracker::setTag(tag);
+	}
+	~AllocationScope() {
+		AllocationTracker::setTag(previous);
+	}
+
+	AllocationScope(const AllocationScope&) = delete;
+	AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+	AllocationTracker::Tag previous;
+};
+
+#endif /* INCLUDE_ALLOCATIONTRACKER_HPP_ */
@@ -38,11 +38,7 @@ public:
 	}
 	T& get(S x, S y) {
 		if (x >= rows || y >= columns) {
-			std::string err = "X or Y is out of range: (X: " + std::to_string(x)
-					+ ", Y: " + std::to_string(y) + "), (" + "Row: "
-					+ std::to_string(rows) + ", Col: " + std::to_string(columns)
-					+ ")";
-			throw std::out_of_range(err);
+			throwOutOfRange(x, y);
 		}
 		return arr[y * rows + x];
 	}
@@ -53,7 +49,18 @@ public:
 	void clear() {
 		std::fill_n(arr, rows * columns, 0);
 	}
+	T* getArr() {
+		return arr;
+	}
 private:
+	// Out of line, so the message is only ever built (and allocated) when it's thrown
+	[[gnu::cold, gnu::noinline]] void throwOutOfRange(S x, S y) const {
+		std::string err = "X or Y is out of range: (X: " + std::to_string(x)
+				+ ", Y: " + std::to_string(y) + "), (" + "Row: "
+				+ std::to_string(rows) + ", Col: " + std::to_string(columns) + ")";
+		throw std::out_of_range(err);
+	}
+
 	T *arr;
 	S rows, columns;
 };
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * BitGrid.hpp
+ *
+ *  Created on: Oct 19, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_BITGRID_HPP_
+#define INCLUDE_BITGRID_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+/**
+ * One bit per cell, row by row, each row padded to whole 64 bit words.
+ * Bit (x % 64) of word (x / 64) in row y stands for cell (x, y).
+ *
+ * The scans below work a word (64 cells) at a time: set cells are found with
+ * countr_zero and counted with popcount, and the loops over whole rows are
+ * kept branch free so the compiler can vectorise them further.
+ */
+template<class T>
+class BitGrid {
+public:
+	static constexpr T wordBits = 64;
+
+	BitGrid(T width, T height) :
+			w(width), h(height), wordsPerRow((width + wordBits - 1) / wordBits) {
+		words.assign(wordsPerRow * height, 0);
+	}
+
+	void set(T x, T y, bool value) {
+		std::uint64_t &word = words[y * wordsPerRow + x / wordBits];
+		std::uint64_t bit = (std::uint64_t) 1 << (x % wordBits);
+		word = value ? word | bit : word & ~bit;
+	}
+
+	bool test(T x, T y) const {
+		return (words[y * wordsPerRow + x / wordBits] >> (x % wordBits)) & 1;
+	}
+
+	void clear() {
+		std::fill(words.begin(), words.end(), 0);
+	}
+
+	const std::uint64_t* getRow(T y) const {
+		return words.data() + y * wordsPerRow;
+	}
+
+	bool isRowEmpty(T y) const {
+		const std::uint64_t *row = getRow(y);
+		std::uint64_t any = 0;
+		for (T i = 0; i < wordsPerRow; i++) {
+			any |= row[i];
+		}
+		return any == 0;
+	}
+
+	/*
+	 * Up to 64 bits of row y starting at x, cells past the row read as 0
+	 */
+	std::uint64_t getBits(T x, T y, T count) const {
+		const std::uint64_t *row = getRow(y);
+		T word = x / wordBits, shift = x % wordBits;
+		std::uint64_t bits = row[word] >> shift;
+		if (shift != 0 && word + 1 < wordsPerRow) {
+			bits |= row[word + 1] << (wordBits - shift);
+		}
+		return count >= wordBits ? bits : bits & (((std::uint64_t) 1 << count) - 1);
+	}
+
+	T countRow(T y) const {
+		const std::uint64_t *row = getRow(y);
+		T total = 0;
+		for (T i = 0; i < wordsPerRow; i++) {
+			total += std::popcount(row[i]);
+		}
+		return total;
+	}
+
+	T count() const {
+		T total = 0;
+		for (std::uint64_t word : words) {
+			total += std::popcount(word);
+		}
+		return total;
+	}
+
+	/*
+	 * Calls visit(x, y) for every set cell in [x0, x1) x [y0, y1), row by row
+	 */
+	template<class F>
+	void forEachInRect(T x0, T y0, T x1, T y1, F visit) const {
+		scan(x0, y0, x1, y1, [this](T y, T i) {
+			return getRow(y)[i];
+		}, visit);
+	}
+
+	/*
+	 * Same as forEachInRect(), for the cells set here but not in other
+	 * (which has to be the same size)
+	 */
+	template<class F>
+	void forEachAndNotInRect(const BitGrid<T> &other, T x0, T y0, T x1, T y1,
+			F visit) const {
+		scan(x0, y0, x1, y1, [this, &other](T y, T i) {
+			return getRow(y)[i] & ~other.getRow(y)[i];
+		}, visit);
+	}
+
+	template<class F>
+	void forEachInRows(T y0, T y1, F visit) const {
+		forEachInRect(0, y0, w, y1, visit);
+	}
+
+	template<class F>
+	void forEach(F visit) const {
+		forEachInRect(0, 0, w, h, visit);
+	}
+
+	/*
+	 * For every word of row y: the cells with a set cell right next to them
+	 * (left, right, above or below)
+	 */
+	void getNeighbourMask(T y, std::uint64_t *out) const {
+		const std::uint64_t *row = getRow(y);
+		for (T i = 0; i < wordsPerRow; i++) {
+			std::uint64_t carryLeft = i > 0 ? row[i - 1] >> (wordBits - 1) : 0;
+			std::uint64_t carryRight = i + 1 < wordsPerRow ? row[i + 1] << (wordBits - 1) : 0;
+			std::uint64_t mask = (row[i] << 1) | carryLeft | (row[i] >> 1) | carryRight;
+			if (y > 0) {
+				mask |= getRow(y - 1)[i];
+			}
+			if (y + 1 < h) {
+				mask |= getRow(y + 1)[i];
+			}
+			out[i] = mask;
+		}
+		// Padding past the end of the row stays clear
+		if (w % wordBits != 0) {
+			out[wordsPerRow - 1] &= ~(std::uint64_t) 0 >> (wordBits - w % wordBits);
+		}
+	}
+
+	T getWordsPerRow() const {
+		return wordsPerRow;
+	}
+
+	T getWidth() const {
+		return w;
+	}
+
+	T getHeight() const {
+		return h;
+	}
+
+private:
+	template<class W, class F>
+	void scan(T x0, T y0, T x1, T y1, W wordAt, F visit) const {
+		if (x0 >= x1) {
+			return;
+		}
+		T firstWord = x0 / wordBits, lastWord = (x1 - 1) / wordBits;
+		std::uint64_t firstMask = ~(std::uint64_t) 0 << (x0 % wordBits);
+		std::uint64_t lastMask = ~(std::uint64_t) 0 >> (wordBits - 1 - (x1 - 1) % wordBits);
+		for (T y = y0; y < y1; y++) {
+			for (T i = firstWord; i <= lastWord; i++) {
+				std::uint64_t word = wordAt(y, i);
+				if (i == firstWord) {
+					word &= firstMask;
+				}
+				if (i == lastWord) {
+					word &= lastMask;
+				}
+				while (word != 0) {
+					visit(i * wordBits + std::countr_zero(word), y);
+					word &= word - 1;
+				}
+			}
+		}
+	}
+
+	T w, h;
+	T wordsPerRow;
+	std::vector<std::uint64_t> words;
+};
+
+#endif /* INCLUDE_BITGRID_HPP_ */
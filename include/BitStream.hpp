@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * BitStream.hpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_BITSTREAM_HPP_
+#define INCLUDE_BITSTREAM_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Zigzag coding maps small negative numbers to small positive ones
+ * (0, -1, 1, -2 ... -> 0, 1, 2, 3 ...) so they stay short as varints
+ */
+inline std::uint32_t zigzagEncode(std::int32_t value) {
+	return ((std::uint32_t) value << 1) ^ (std::uint32_t) (value >> 31);
+}
+
+inline std::int32_t zigzagDecode(std::uint32_t value) {
+	return (std::int32_t) (value >> 1) ^ -(std::int32_t) (value & 1);
+}
+
+/**
+ * Packs values of any bit width back to back, least significant bit first
+ */
+class BitWriter {
+public:
+	BitWriter(std::vector<std::uint8_t> &dest) :
+			bytes(dest), scratch(0), scratchBits(0) {
+	}
+
+	void writeBits(std::uint32_t value, int count) {
+		scratch |= (std::uint64_t) (value & mask(count)) << scratchBits;
+		scratchBits += count;
+		while (scratchBits >= 8) {
+			bytes.push_back(scratch & 0xFF);
+			scratch >>= 8;
+			scratchBits -= 8;
+		}
+	}
+
+	void writeBool(bool value) {
+		writeBits(value ? 1 : 0, 1);
+	}
+
+	/*
+	 * groupBits (7 unless given) bits at a time, each group followed by a bit
+	 * that says whether more follow. Narrower groups suit values that are
+	 * nearly always small.
+	 */
+	void writeVarint(std::uint32_t value, int groupBits = 7) {
+		while (value > mask(groupBits)) {
+			writeBits(value, groupBits);
+			writeBits(1, 1);
+			value >>= groupBits;
+		}
+		writeBits(value, groupBits);
+		writeBits(0, 1);
+	}
+
+	void writeSignedVarint(std::int32_t value, int groupBits = 7) {
+		writeVarint(zigzagEncode(value), groupBits);
+	}
+
+	/*
+	 * Writes out the last partial byte, padded with zeros
+	 */
+	void flush() {
+		if (scratchBits > 0) {
+			bytes.push_back(scratch & 0xFF);
+			scratch = 0;
+			scratchBits = 0;
+		}
+	}
+
+private:
+	static std::uint32_t mask(int count) {
+		return count >= 32 ? 0xFFFFFFFF : ((std::uint32_t) 1 << count) - 1;
+	}
+
+	std::vector<std::uint8_t> &bytes;
+	std::uint64_t scratch;
+	int scratchBits;
+};
+
+/**
+ * Reads what BitWriter wrote. Running off the end returns zeros and clears
+ * isValid().
+ */
+class BitReader {
+public:
+	BitReader(const std::uint8_t *data, std::size_t size) :
+			bytes(data), length(size), position(0), scratch(0), scratchBits(
+					0), valid(true) {
+	}
+
+	std::uint32_t readBits(int count) {
+		while (scratchBits < count) {
+			if (position >= length) {
+				valid = false;
+				return 0;
+			}
+			scratch |= (std::uint64_t) bytes[position++] << scratchBits;
+			scratchBits += 8;
+		}
+		std::uint32_t value = (std::uint32_t) (scratch
+				& (count >= 32 ? 0xFFFFFFFF : ((std::uint64_t) 1 << count) - 1));
+		scratch >>= count;
+		scratchBits -= count;
+		return value;
+	}
+
+	bool readBool() {
+		return readBits(1) != 0;
+	}
+
+	std::uint32_t readVarint(int groupBits = 7) {
+		std::uint32_t value = 0;
+		for (int shift = 0; shift < 32; shift += groupBits) {
+			value |= readBits(groupBits) << shift;
+			if (readBits(1) == 0 || !valid) {
+				return value;
+			}
+		}
+		valid = false;
+		return 0;
+	}
+
+	std::int32_t readSignedVarint(int groupBits = 7) {
+		return zigzagDecode(readVarint(groupBits));
+	}
+
+	bool isValid() const {
+		return valid;
+	}
+
+private:
+	const std::uint8_t *bytes;
+	std::size_t length;
+	std::size_t position;
+	std::uint64_t scratch;
+	int scratchBits;
+	bool valid;
+};
+
+#endif /* INCLUDE_BITSTREAM_HPP_ */
@@ -27,10 +27,9 @@
 #define INCLUDE_BLOCK_HPP_
 
 #include <vector>
-#include <SFML/Graphics.hpp>
 
 #include "Point.hpp"
-#include "TextureManager.hpp"
+#include "BlockType.hpp"
 
 /*
  * There are four states of a block: 0,1-4
@@ -41,81 +40,94 @@
  * 4 - West charge (left facing icon)
  * Any block can be magnetic, but like real life, some blocks are more magnetic in general than others (need to define the magnetic constants)
  * By right clicking on a block, you can change the charge? (change the thing in survival where the player loses a magnetic health point for it)
+ *
+ * Only blocks that are moving get one of these; blocks at rest live in
+ * BlockManager's per-chunk palettes. Everything blocks of a kind have in
+ * common (size, mass, friction, texture) is in their BlockType.
  */
 template<class T>
-class Block: public sf::Sprite {
+class Block {
 public:
-	Block(T len, T m, T velocityX, T velocityY, float muConstant,
-			TextureManager &manager) :
-			sf::Sprite(manager.getNormalBlock()), length(len), mass(m), vx(
-					velocityX), vy(velocityY), mu(muConstant), textureManager(
-					manager) {
+	Block(const BlockType<T> &blockType, T velocityX, T velocityY) :
+			type(&blockType), vx(velocityX), vy(velocityY) {
 		magnetFacingDirection = 0; // default
 	}
 
 	void moveWithStats(T x, T y) {
-		setPosWithStats(getPosition().x + (float) x, getPosition().y + (float) y);
+		setPosWithStats(coord.x + x, coord.y + y);
 	}
 
 	void setPosWithStats(T x, T y) {
-		previousCoord.x = (getPosition().x / length) * length;
-		previousCoord.y = (getPosition().y / length) * length;
-		setPosition((float) x, (float) y);
+		previousCoord = coord;
+		coord.x = x;
+		coord.y = y;
 	}
 
-	bool isMagnetic() {
-		return magnetFacingDirection >= 1 && magnetFacingDirection <= 4;
+	/*
+	 * Places the block without counting it as a move
+	 */
+	void setCoord(T x, T y) {
+		coord.x = x;
+		coord.y = y;
+		previousCoord = coord;
 	}
 
-	bool operator==(const Block<T> &b) const {
-		sf::Vector2f &aPos = getPosition();
-		sf::Vector2f &bPos = getPosition();
-		return (((aPos.x / length) * length) == ((bPos.x / length) * length))
-				&& (((aPos.y / length) * length) == ((bPos.y / length) * length));
+	/*
+	 * Position used by the simulation, in pixels
+	 */
+	const Point<T>& getCoord() const {
+		return coord;
 	}
 
-	T getLength() const {
-		return length;
+	bool isMagnetic() const {
+		return magnetFacingDirection >= 1 && magnetFacingDirection <= 4;
 	}
 
-	void setLength(T length) {
-		this->length = length;
+	/*
+	 * Magnetic moment of the block, pointing the same way as the force it
+	 * adds to the force table (zero for non-magnetic blocks)
+	 */
+	Point<T> getMagneticMoment() const {
+		return getMagneticMoment(type->mass, magnetFacingDirection);
 	}
 
-	int getMagnetFacingDirection() const {
-		return magnetFacingDirection;
-	}
-
-	void setMagnetFacingDirection(int magnetFacingDirection) {
+	static Point<T> getMagneticMoment(T mass, int magnetFacingDirection) {
 		switch (magnetFacingDirection) {
-		case 0:
-			setTexture(textureManager.getNormalBlock());
-			break;
+		// Up
 		case 1:
-			setTexture(textureManager.getMagnetUpBlock());
-			break;
+			return Point<T>((T) 0, mass);
+			// Down
 		case 2:
-			setTexture(textureManager.getMagnetDownBlock());
-			break;
+			return Point<T>((T) 0, -mass);
+			// Left
 		case 3:
-			setTexture(textureManager.getMagnetLeftBlock());
-			break;
+			return Point<T>(-mass, (T) 0);
+			// Right
 		case 4:
-			setTexture(textureManager.getMagnetRightBlock());
-			break;
+			return Point<T>(mass, (T) 0);
 		default:
-			setTexture(textureManager.getNormalBlock());
-			break;
+			return Point<T>();
 		}
-		this->magnetFacingDirection = magnetFacingDirection;
 	}
 
-	T getMass() const {
-		return mass;
+	const BlockType<T>& getType() const {
+		return *type;
+	}
+
+	T getLength() const {
+		return type->length;
 	}
 
-	void setMass(T mass) {
-		this->mass = mass;
+	int getMagnetFacingDirection() const {
+		return magnetFacingDirection;
+	}
+
+	void setMagnetFacingDirection(int magnetFacingDirection) {
+		this->magnetFacingDirection = magnetFacingDirection;
+	}
+
+	T getMass() const {
+		return type->mass;
 	}
 
 	T getVx() const {
@@ -143,23 +155,16 @@ public:
 	}
 
 	float getMu() const {
-		return mu;
-	}
-
-	void setMu(float mu) {
-		this->mu = mu;
+		return type->mu;
 	}
 
 private:
-	T length;
-	T mass; // in kg
+	const BlockType<T> *type;
 
 	T vx, vy;
 
-	float mu; // between 0 and 1
-	TextureManager &textureManager;
-
 	int magnetFacingDirection;
+	Point<T> coord;
 	Point<T> previousCoord;
 };
 
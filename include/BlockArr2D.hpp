@@ -48,23 +48,21 @@ public:
 		arr = new Block<T>*[numRows * numColumns]();
 	}
 	~BlockArr2D() {
-		for (auto *b : arr) {
-			if (b != NULL)
-				delete b;
-		}
-		if (arr != NULL)
-			delete[] arr;
+		clear();
+		delete[] arr;
 	}
 
+	/*
+	 * Deletes every block in the array
+	 */
 	void clear() {
-		for (auto *b : arr) {
-			if (b != NULL)
-				delete b;
+		for (S i = 0; i < arraySize; i++) {
+			delete arr[i];
+			arr[i] = nullptr;
 		}
-		std::fill_n(arr, rows * columns, 0);
 	}
 
-	void set(Point<T> &p, Block<T> *block) {
+	void set(const Point<T> &p, Block<T> *block) {
 		set(p.x, p.y, block);
 	}
 
@@ -72,16 +70,12 @@ public:
 		S newX = (S) (x / blockSize);
 		S newY = (S) (y / blockSize);
 		if (newX < 0 || newY < 0 || newX >= rows || newY >= columns) {
-			std::string err = "X or Y is out of range: (X: "
-					+ std::to_string(newX) + ", Y: " + std::to_string(newY)
-					+ "), (" + "Row: " + std::to_string(rows) + ", Col: "
-					+ std::to_string(columns) + ")";
-			throw std::out_of_range(err);
+			throwOutOfRange(newX, newY);
 		}
 		arr[newY * rows + newX] = block;
 	}
 
-	void remove(Point<T> &p) {
+	void remove(const Point<T> &p) {
 		remove(p.x, p.y);
 	}
 
@@ -94,7 +88,7 @@ public:
 		}
 	}
 
-	Block<T>* get(Point<T> &p) {
+	Block<T>* get(const Point<T> &p) {
 		return get(p.x, p.y);
 	}
 
@@ -103,11 +97,7 @@ public:
 		S newY = (S) (y / blockSize);
 		// Bounds checking
 		if (newX < 0 || newY < 0 || newX >= rows || newY >= columns) {
-			std::string err = "X or Y is out of range: (X: "
-					+ std::to_string(newX) + ", Y: " + std::to_string(newY)
-					+ "), (" + "Row: " + std::to_string(rows) + ", Col: "
-					+ std::to_string(columns) + ")";
-			throw std::out_of_range(err);
+			throwOutOfRange(newX, newY);
 		}
 
 		return arr[newY * rows + newX];
@@ -138,6 +128,14 @@ public:
 	}
 
 private:
+	// Out of line, so the message is only ever built (and allocated) when it's thrown
+	[[gnu::cold, gnu::noinline]] void throwOutOfRange(S x, S y) const {
+		std::string err = "X or Y is out of range: (X: " + std::to_string(x)
+				+ ", Y: " + std::to_string(y) + "), (" + "Row: "
+				+ std::to_string(rows) + ", Col: " + std::to_string(columns) + ")";
+		throw std::out_of_range(err);
+	}
+
 	Block<T> **arr;
 	S rows, columns;
 	S arraySize;
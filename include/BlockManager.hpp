@@ -29,118 +29,724 @@
 #include <string>
 #include <vector>
 #include <random>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <limits>
 
-#include <SFML/Graphics.hpp>
 #include <Block.hpp>
-#include <TextureManager.hpp>
+#include <BlockType.hpp>
+#include <PalettedChunk.hpp>
 #include <Point.hpp>
 #include <ForceTable.hpp>
 #include <BlockArr2D.hpp>
+#include <MagnetQuadTree.hpp>
+#include <ThreadPool.hpp>
+#include <Chunk.hpp>
+#include <WorldGenerator.hpp>
+#include <OccupancyMap.hpp>
+#include <BitGrid.hpp>
+#include <LightMap.hpp>
 
+/**
+ * Owns every block of a world.
+ *
+ * A block at rest is only a palette entry (its type and magnet direction) in
+ * the PalettedChunk of its chunk, which costs a few bits. Once something
+ * pushes on it, it is woken up into a full Block with a position and a
+ * velocity, kept in the block map until it comes to rest on a cell again.
+ * The occupancy map has a bit for both kinds and tells them apart.
+ *
+ * Chunk palettes are shared with snapshots (see takeSnapshot()) and only
+ * copied on the first write after one.
+ *
+ * Every add, remove and move notifies the cell and its four neighbours, and
+ * every change to the forces notifies the cells it pushes on, so per-block
+ * logic only has to look at collectChangedCells() instead of the whole world.
+ *
+ * With events enabled, edits also queue up an Event for the effects
+ * (particles, sounds) to pick up with collectEvents().
+ */
 template<class P, class T>
 class BlockManager {
 public:
 	BlockManager(P bSize, P bMass, T w, T h, float defaultMuConstant,
-			TextureManager &manager, std::mt19937 &device) :
-			blockSize(bSize), blockMass(bMass), width(w / bSize), height(
-					h / bSize), defaultMu(defaultMuConstant), textureManager(
-					manager), randDevice(device) {
+			BlockRegistry<P> &registry, std::mt19937 &device, ThreadPool &pool) :
+			blockSize(bSize), blockMass(bMass), width((T) ((P) w / bSize)), height(
+					(T) ((P) h / bSize)), defaultMu(defaultMuConstant), blockTypes(
+					registry), randDevice(device), threadPool(pool), chunkGrid(
+					width, height), occupancy(chunkGrid), light(chunkGrid), notified(width,
+					height) {
+		defaultType = blockTypes.find("Block");
+		if (defaultType == nullptr) {
+			defaultType = &blockTypes.add("Block", (P) blockSize, (P) blockMass,
+					defaultMu);
+		}
+		resetRestingChunks();
 		blockMap = new BlockArr2D<P, T>(width, height, blockSize);
 		forceTable = new ForceTable<T, P>(width, height, blockSize);
+		magnetTree = new MagnetQuadTree<P, T>(width, height, (P) 1 / 2);
+		magnetTreeDirty = true;
+		dirtyForceRows.assign(height, 0);
+		dirtyForceColumns.assign(width, 0);
+		magnetsChanged = false;
+		allChanged = false;
+		eventsEnabled = false;
+		editDepth = 0;
+		deferredRebuildLines = 0;
 		magnetForce = 100;
+		chunkRevisions.assign(chunkGrid.getChunkCount(), 0);
 
 		// Debug Messages
 		std::cout << "BlockManager width: " << width << ", height: " << height
 				<< std::endl;
 	}
 
+	/*
+	 * Deletes the moving blocks, spare blocks and the tables it owns (including
+	 * any handed over with setBlockMap() or setForceTable())
+	 */
+	~BlockManager() {
+		for (Block<P> *block : spareBlocks) {
+			delete block;
+		}
+		delete blockMap;
+		delete forceTable;
+		delete magnetTree;
+	}
+
+	BlockManager(const BlockManager&) = delete;
+	BlockManager& operator=(const BlockManager&) = delete;
+
+	/*
+	 * Adds a moving block to an empty cell
+	 */
 	void add(Block<P> *block) {
 		// Learned: you cannot insert the same object twice
-		Point<P> blockCoord(block->getPosition().x, block->getPosition().y);
+		const Point<P> &blockCoord = block->getCoord();
 		addMagneticForce(blockCoord, block);
 		blockMap->set(blockCoord, block);
+		occupancy.set((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize), true);
+		occupancy.setAwake((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize), true);
+		occupancy.setMagnetic((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize), block->isMagnetic());
+		markChanged(blockCoord.x, blockCoord.y);
+		light.markChanged((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize));
+		notifyNeighbours((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize));
+		addEvent(BlockAdded, (T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize));
+		stats.added++;
+		if (block->isMagnetic() && !magnetTreeDirty) {
+			magnetTree->addMagnet((T) (blockCoord.x / blockSize),
+					(T) (blockCoord.y / blockSize), block->getMagneticMoment());
+		}
 	}
 
 	void remove(Point<P> &p) {
 		remove(p.x, p.y);
 	}
 
+	/*
+	 * Removes the block in the cell holding (x, y), resting or not. Does nothing
+	 * if the cell is empty.
+	 */
 	void remove(P x, P y) {
+		T cellX = (T) (x / blockSize), cellY = (T) (y / blockSize);
+		if (!containsCell(cellX, cellY) || !occupancy.test(cellX, cellY)) {
+			return;
+		}
+		const BlockType<P> *type = getCellType(cellX, cellY);
+		int direction = getCellKind(cellX, cellY);
+		Point<P> force = getEmittedForce(type->mass, direction);
+		if ((force.x != (P) 0 || force.y != (P) 0) && !magnetTreeDirty) {
+			magnetTree->removeMagnet(cellX, cellY, force);
+		}
+		if (occupancy.testAwake(cellX, cellY)) {
+			// A moving magnet's force is where it was last tick, see World::updateBlockForces()
+			Block<P> *block = getAwakeBlock(cellX, cellY);
+			removeMagneticForce(block->getPreviousCoord(), block);
+			releaseBlock(x, y);
+			occupancy.setAwake(cellX, cellY, false);
+		} else {
+			removeEmittedForce(x, y, force);
+			setResting(cellX, cellY, 0);
+		}
+		occupancy.set(cellX, cellY, false);
+		occupancy.setMagnetic(cellX, cellY, false);
+		markChanged(x, y);
+		light.markChanged(cellX, cellY);
+		notifyNeighbours(cellX, cellY);
+		addEvent(BlockRemoved, cellX, cellY);
+		stats.removed++;
+	}
+
+	/*
+	 * Puts a block of the given type down at rest in an empty cell
+	 */
+	void place(T cellX, T cellY, const BlockType<P> &type, int direction) {
+		P x = (P) (cellX * blockSize), y = (P) (cellY * blockSize);
+		Point<P> force = getEmittedForce(type.mass, direction);
+		addEmittedForce(x, y, force);
+		setResting(cellX, cellY, 1 + type.id * directions + direction);
+		occupancy.set(cellX, cellY, true);
+		occupancy.setMagnetic(cellX, cellY,
+				force.x != (P) 0 || force.y != (P) 0);
+		markChanged(x, y);
+		light.markChanged(cellX, cellY);
+		notifyNeighbours(cellX, cellY);
+		addEvent(BlockAdded, cellX, cellY);
+		stats.added++;
+		if ((force.x != (P) 0 || force.y != (P) 0) && !magnetTreeDirty) {
+			magnetTree->addMagnet(cellX, cellY, force);
+		}
+	}
+
+	/*
+	 * Turns the resting block of a cell into a moving one (with no velocity
+	 * yet) and returns it. Nothing about the world changes, the block only
+	 * gets the state it needs to move. Cells that are already awake just
+	 * return their block.
+	 */
+	Block<P>* wake(T cellX, T cellY) {
+		P x = (P) (cellX * blockSize), y = (P) (cellY * blockSize);
+		if (occupancy.testAwake(cellX, cellY)) {
+			return blockMap->get(x, y);
+		}
+		std::uint16_t value = getResting(cellX, cellY);
+		Block<P> *block = takeBlock(blockTypes.get((value - 1) / directions),
+				(P) 0, (P) 0);
+		block->setMagnetFacingDirection((value - 1) % directions);
+		block->setCoord(x, y);
+		blockMap->set(x, y, block);
+		setResting(cellX, cellY, 0);
+		occupancy.setAwake(cellX, cellY, true);
+		stats.woken++;
+		return block;
+	}
+
+	/*
+	 * Opposite of wake(), for a block that stopped right on its cell
+	 */
+	void sleep(T cellX, T cellY) {
+		P x = (P) (cellX * blockSize), y = (P) (cellY * blockSize);
 		Block<P> *block = blockMap->get(x, y);
-		removeMagneticForce(x, y, block);
-		blockMap->remove(x, y);
+		setResting(cellX, cellY,
+				1 + block->getType().id * directions
+						+ block->getMagnetFacingDirection());
+		releaseBlock(x, y);
+		occupancy.setAwake(cellX, cellY, false);
+		stats.slept++;
+		// It might still be pushed on, which is checked again next tick
+		notify(cellX, cellY);
+	}
+
+	/*
+	 * Whether the block in an awake cell can go back to sleep
+	 */
+	bool isAtRest(T cellX, T cellY) {
+		Block<P> *block = blockMap->get((P) (cellX * blockSize),
+				(P) (cellY * blockSize));
+		return block->getVx() == (P) 0 && block->getVy() == (P) 0
+				&& block->getCoord().x == (P) (cellX * blockSize)
+				&& block->getCoord().y == (P) (cellY * blockSize);
+	}
+
+	/*
+	 * Moves a block from one cell of the block map to another (both in pixels)
+	 */
+	void move(Block<P> *block, P fromX, P fromY, P toX, P toY) {
+		blockMap->set(toX, toY, block);
+		blockMap->set(fromX, fromY, nullptr);
+		occupancy.set((T) (fromX / blockSize), (T) (fromY / blockSize), false);
+		occupancy.set((T) (toX / blockSize), (T) (toY / blockSize), true);
+		occupancy.setMagnetic((T) (fromX / blockSize), (T) (fromY / blockSize),
+				false);
+		occupancy.setMagnetic((T) (toX / blockSize), (T) (toY / blockSize),
+				block->isMagnetic());
+		occupancy.setAwake((T) (fromX / blockSize), (T) (fromY / blockSize),
+				false);
+		occupancy.setAwake((T) (toX / blockSize), (T) (toY / blockSize), true);
+		markChanged(fromX, fromY);
+		markChanged(toX, toY);
+		light.markChanged((T) (fromX / blockSize), (T) (fromY / blockSize));
+		light.markChanged((T) (toX / blockSize), (T) (toY / blockSize));
+		notifyNeighbours((T) (fromX / blockSize), (T) (fromY / blockSize));
+		notifyNeighbours((T) (toX / blockSize), (T) (toY / blockSize));
+		magnetsChanged = magnetsChanged || block->isMagnetic();
+		stats.moved++;
+		if (block->isMagnetic() && !magnetTreeDirty) {
+			// Only single cell hops are patched in place, anything else waits for the next rebuild
+			if (!magnetTree->moveMagnet((T) (fromX / blockSize),
+					(T) (fromY / blockSize), (T) (toX / blockSize),
+					(T) (toY / blockSize), block->getMagneticMoment())) {
+				magnetTreeDirty = true;
+			}
+		}
+	}
+
+	void setMagnetFacingDirection(Block<P> *block, int direction) {
+		const Point<P> &blockCoord = block->getCoord();
+		removeMagneticForce(block->getPreviousCoord(), block);
+		block->setMagnetFacingDirection(direction);
+		addMagneticForce(block->getPreviousCoord(), block);
+		occupancy.setMagnetic((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize), block->isMagnetic());
+		markChanged(blockCoord.x, blockCoord.y);
+		light.markChanged((T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize));
+		addEvent(BlockTurned, (T) (blockCoord.x / blockSize),
+				(T) (blockCoord.y / blockSize));
+		magnetTreeDirty = true;
+	}
+
+	/*
+	 * Turns the block of a cell to face direction, resting or not
+	 */
+	void setCellDirection(T cellX, T cellY, int direction) {
+		if (!containsCell(cellX, cellY) || !occupancy.test(cellX, cellY)) {
+			return;
+		}
+		if (occupancy.testAwake(cellX, cellY)) {
+			Block<P> *block = getAwakeBlock(cellX, cellY);
+			removeMagneticForce(block->getPreviousCoord(), block);
+			block->setMagnetFacingDirection(direction);
+			addMagneticForce(block->getPreviousCoord(), block);
+			occupancy.setMagnetic(cellX, cellY, block->isMagnetic());
+			markChanged((P) (cellX * blockSize), (P) (cellY * blockSize));
+			light.markChanged(cellX, cellY);
+			addEvent(BlockTurned, cellX, cellY);
+			magnetTreeDirty = true;
+			return;
+		}
+		// The block stays where it is, only its palette entry and force change
+		const BlockType<P> &type = *getCellType(cellX, cellY);
+		P x = (P) (cellX * blockSize), y = (P) (cellY * blockSize);
+		Point<P> oldForce = getEmittedForce(type.mass, getCellKind(cellX, cellY));
+		Point<P> force = getEmittedForce(type.mass, direction);
+		if ((oldForce.x != (P) 0 || oldForce.y != (P) 0) && !magnetTreeDirty) {
+			magnetTree->removeMagnet(cellX, cellY, oldForce);
+		}
+		removeEmittedForce(x, y, oldForce);
+		addEmittedForce(x, y, force);
+		setResting(cellX, cellY, 1 + type.id * directions + direction);
+		occupancy.setMagnetic(cellX, cellY,
+				force.x != (P) 0 || force.y != (P) 0);
+		if ((force.x != (P) 0 || force.y != (P) 0) && !magnetTreeDirty) {
+			magnetTree->addMagnet(cellX, cellY, force);
+		}
+		markChanged(x, y);
+		light.markChanged(cellX, cellY);
+		notifyNeighbours(cellX, cellY);
+		addEvent(BlockTurned, cellX, cellY);
+	}
+
+	enum EventKind {
+		BlockAdded, BlockRemoved, BlockTurned, BlockCollided
+	};
+
+	struct Event {
+		EventKind kind;
+		T cellX, cellY;
+	};
+
+	/*
+	 * Events only queue up while enabled, so a world nobody watches (the
+	 * server) doesn't collect them forever
+	 */
+	void setEventsEnabled(bool enabled) {
+		eventsEnabled = enabled;
+		if (!enabled) {
+			events.clear();
+		}
+	}
+
+	void addEvent(EventKind kind, T cellX, T cellY) {
+		if (eventsEnabled) {
+			events.push_back(Event { kind, cellX, cellY });
+		}
+	}
+
+	/*
+	 * Running totals of what happened to the blocks. They are plain counters,
+	 * as only one thread ever edits a BlockManager, and World::step() hands
+	 * them to the Metrics once a tick.
+	 */
+	struct Stats {
+		unsigned long added = 0, removed = 0, moved = 0, woken = 0, slept = 0;
+	};
+
+	const Stats& getStats() const {
+		return stats;
+	}
+
+	/*
+	 * Every event since the last call, oldest first. The list stays valid
+	 * until the next call.
+	 */
+	const std::vector<Event>& collectEvents() {
+		collectedEvents.clear();
+		collectedEvents.swap(events);
+		return collectedEvents;
 	}
 
-	void addMagneticForce(const Point<P> &coords, const Block<P> *block) const {
+	/*
+	 * Bumps the revision of the chunk holding (x, y) in pixels. Anything that
+	 * caches a chunk (renderers, network replication) compares revisions to
+	 * find out what it has to redo.
+	 */
+	void markChanged(P x, P y) {
+		T cellX = (T) (x / blockSize);
+		T cellY = (T) (y / blockSize);
+		if (cellX >= 0 && cellY >= 0 && cellX < width && cellY < height) {
+			chunkRevisions[chunkGrid.getChunkIndex(cellX, cellY)]++;
+		}
+	}
+
+	/*
+	 * Asks for the block logic of a cell to run again, at most once per
+	 * collectChangedCells() however often it is called
+	 */
+	void notify(T cellX, T cellY) {
+		if (containsCell(cellX, cellY) && !notified.test(cellX, cellY)) {
+			notified.set(cellX, cellY, true);
+			changedCells.emplace_back(cellX, cellY);
+		}
+	}
+
+	/*
+	 * A cell and the four cells around it
+	 */
+	void notifyNeighbours(T cellX, T cellY) {
+		notify(cellX, cellY);
+		notify(cellX - 1, cellY);
+		notify(cellX + 1, cellY);
+		notify(cellX, cellY - 1);
+		notify(cellX, cellY + 1);
+	}
+
+	/*
+	 * Every cell notified since the last call, plus the blocks on the
+	 * rows and columns whose forces changed (and all magnets, when another
+	 * magnet changed). Each cell shows up once. The list stays valid until
+	 * the next call.
+	 */
+	const std::vector<Point<T>>& collectChangedCells() {
+		const BitGrid<T> &occupied = occupancy.getOccupied();
+		auto notifyCell = [this](T x, T y) {
+			notify(x, y);
+		};
+		if (allChanged) {
+			occupied.forEach(notifyCell);
+		}
+		for (T row : dirtyRowList) {
+			occupied.forEachInRows(row, row + 1, notifyCell);
+			dirtyForceRows[row] = 0;
+		}
+		for (T column : dirtyColumnList) {
+			for (T y = 0; y < height; y++) {
+				if (occupied.test(column, y)) {
+					notify(column, y);
+				}
+			}
+			dirtyForceColumns[column] = 0;
+		}
+		if (magnetsChanged) {
+			occupancy.getMagnetic().forEach(notifyCell);
+		}
+		dirtyRowList.clear();
+		dirtyColumnList.clear();
+		magnetsChanged = false;
+		allChanged = false;
+
+		collectedCells.clear();
+		collectedCells.swap(changedCells);
+		for (const Point<T> &cell : collectedCells) {
+			notified.set(cell.x, cell.y, false);
+		}
+		return collectedCells;
+	}
+
+	unsigned long getChunkRevision(T chunkIndex) const {
+		return chunkRevisions[chunkIndex];
+	}
+
+	const ChunkGrid<T>& getChunkGrid() const {
+		return chunkGrid;
+	}
+
+	/*
+	 * Brings the magnet tree up to date for this tick. Adds, removes and single
+	 * cell moves are already applied in place, so this only rebuilds (in
+	 * parallel) after changes that could not be patched.
+	 */
+	void refreshMagnetTree() {
+		if (magnetTreeDirty) {
+			magnetTree->rebuild(occupancy.getMagnetic(), [this](T x, T y) {
+				return getMagneticMoment(x, y);
+			}, threadPool);
+			magnetTreeDirty = false;
+			// The pull on every magnet can come out slightly different after a rebuild
+			magnetsChanged = true;
+		}
+	}
+
+	/*
+	 * Pull or push on a magnet with the given moment from all the other
+	 * magnets in the world
+	 */
+	Point<P> getMagnetInteraction(P x, P y, const Point<P> &moment) {
+		return magnetTree->getForce(occupancy.getMagnetic(), [this](T cx, T cy) {
+			return getMagneticMoment(cx, cy);
+		}, (T) (x / blockSize), (T) (y / blockSize), moment, (P) magnetForce);
+	}
+
+	Point<P> getMagnetInteraction(P x, P y, const Block<P> *block) {
+		return getMagnetInteraction(x, y, block->getMagneticMoment());
+	}
+
+	void addMagneticForce(const Point<P> &coords, const Block<P> *block) {
 		addMagneticForce(coords.x, coords.y, block);
 	}
 
-	void addMagneticForce(P x, P y, const Block<P> *block) const {
-		switch (block->getMagnetFacingDirection()) {
-		// Up
-		case 1:
-			forceTable->addForce(x, y, 0, block->getMass());
-			break;
-			// Down
-		case 2:
-			forceTable->addForce(x, y, 0, -block->getMass());
-			break;
-			// Left
-		case 3:
-			forceTable->addForce(x, y, -block->getMass(), 0);
-			break;
-			// Right
-		case 4:
-			forceTable->addForce(x, y, block->getMass(), 0);
-			break;
-		default:
-			break;
-		}
-	}
-
-	void removeMagneticForce(const Point<P> &p, const Block<P> *block) const {
+	void addMagneticForce(P x, P y, const Block<P> *block) {
+		addEmittedForce(x, y,
+				getEmittedForce(block->getMass(),
+						block->getMagnetFacingDirection()));
+	}
+
+	void removeMagneticForce(const Point<P> &p, const Block<P> *block) {
 		removeMagneticForce(p.x, p.y, block);
 	}
 
-	void removeMagneticForce(P x, P y, const Block<P> *block) const {
-		switch (block->getMagnetFacingDirection()) {
-		// Up
-		case 1:
-			forceTable->removeForce(x, y, 0, block->getMass());
-			break;
-			// Down
-		case 2:
-			forceTable->removeForce(x, y, 0, -block->getMass());
-			break;
-			// Left
-		case 3:
-			forceTable->removeForce(x, y, -block->getMass(), 0);
-			break;
-			// Right
-		case 4:
-			forceTable->removeForce(x, y, block->getMass(), 0);
-			break;
-		default:
-			break;
+	void removeMagneticForce(P x, P y, const Block<P> *block) {
+		removeEmittedForce(x, y,
+				getEmittedForce(block->getMass(),
+						block->getMagnetFacingDirection()));
+	}
+
+	/*
+	 * Between beginEdit() and endEdit() the force table only records which
+	 * magnets came and went, and endEdit() rebuilds the touched rows and
+	 * columns in one parallel sweep. Use it around anything that changes more
+	 * than a handful of cells. Calls may nest.
+	 */
+	void beginEdit() {
+		editDepth++;
+	}
+
+	void endEdit() {
+		if (--editDepth == 0 && forceTable->needsRebuild()) {
+			rebuildForceLines(
+					deferredRebuildLines > 0 ?
+							deferredRebuildLines : std::numeric_limits<T>::max());
+		}
+	}
+
+	/*
+	 * With a limit, endEdit() rebuilds at most that many force table rows
+	 * and columns (the latest ones first) and leaves the rest of a bulk edit
+	 * to rebuildForces(), e.g. from a background job. Until then those lines
+	 * keep their old forces, and their blocks show up in collectChangedCells()
+	 * again once they are rebuilt. 0, the default, always rebuilds everything.
+	 */
+	void setDeferredRebuildLines(T lines) {
+		deferredRebuildLines = lines;
+	}
+
+	/*
+	 * Rebuilds up to maxLines of the rows and columns endEdit() left over,
+	 * returns whether any are still left
+	 */
+	bool rebuildForces(T maxLines) {
+		if (forceTable->needsRebuild()) {
+			rebuildForceLines(maxLines);
+		}
+		return forceTable->needsRebuild();
+	}
+
+	/*
+	 * Region edits, coordinates in cells and clipped to the world. kind is
+	 * emptyCell or the magnet direction of the blocks to put down (0 for a
+	 * plain block); blocks of another kind in the way are replaced.
+	 * They return the number of cells that changed.
+	 */
+	T fillRect(T cellX, T cellY, T cellW, T cellH, int kind) {
+		T x0 = std::max(cellX, (T) 0), y0 = std::max(cellY, (T) 0);
+		T x1 = std::min(cellX + cellW, width), y1 = std::min(cellY + cellH, height);
+		T changed = 0;
+		beginEdit();
+		for (T y = y0; y < y1; y++) {
+			for (T x = x0; x < x1; x++) {
+				changed += setCell(x, y, kind);
+			}
+		}
+		endEdit();
+		return changed;
+	}
+
+	T clearRect(T cellX, T cellY, T cellW, T cellH) {
+		return fillRect(cellX, cellY, cellW, cellH, emptyCell);
+	}
+
+	/*
+	 * stamp holds stampW * stampH kinds row by row, keepCell leaves that cell as it is
+	 */
+	T pasteStamp(T cellX, T cellY, T stampW, T stampH,
+			const std::vector<int> &stamp) {
+		T changed = 0;
+		beginEdit();
+		for (T row = 0; row < stampH; row++) {
+			for (T col = 0; col < stampW; col++) {
+				int kind = stamp[row * stampW + col];
+				if (kind != keepCell && containsCell(cellX + col, cellY + row)) {
+					changed += setCell(cellX + col, cellY + row, kind);
+				}
+			}
 		}
+		endEdit();
+		return changed;
 	}
 
+	/*
+	 * Replaces the four-way connected area of cells sharing the kind of
+	 * (cellX, cellY) with kind, like a paint bucket
+	 */
+	T floodReplace(T cellX, T cellY, int kind) {
+		if (!containsCell(cellX, cellY)) {
+			return 0;
+		}
+		int target = getCellKind(cellX, cellY);
+		if (target == kind) {
+			return 0;
+		}
+		T changed = 0;
+		std::vector<Point<T>> stack { Point<T>(cellX, cellY) };
+		beginEdit();
+		while (!stack.empty()) {
+			Point<T> cell = stack.back();
+			stack.pop_back();
+			if (!containsCell(cell.x, cell.y)
+					|| getCellKind(cell.x, cell.y) != target) {
+				continue;
+			}
+			changed += setCell(cell.x, cell.y, kind);
+			stack.emplace_back(cell.x + 1, cell.y);
+			stack.emplace_back(cell.x - 1, cell.y);
+			stack.emplace_back(cell.x, cell.y + 1);
+			stack.emplace_back(cell.x, cell.y - 1);
+		}
+		endEdit();
+		return changed;
+	}
+
+	/*
+	 * Sets a list of cells, e.g. a brush stroke, in one batch
+	 */
+	T fillCells(const std::vector<Point<T>> &cells, int kind) {
+		T changed = 0;
+		beginEdit();
+		for (const Point<T> &cell : cells) {
+			if (containsCell(cell.x, cell.y)) {
+				changed += setCell(cell.x, cell.y, kind);
+			}
+		}
+		endEdit();
+		return changed;
+	}
+
+	int getCellKind(T cellX, T cellY) {
+		if (!occupancy.test(cellX, cellY)) {
+			return emptyCell;
+		}
+		if (occupancy.testAwake(cellX, cellY)) {
+			return getAwakeBlock(cellX, cellY)->getMagnetFacingDirection();
+		}
+		return (getResting(cellX, cellY) - 1) % directions;
+	}
+
+	/*
+	 * nullptr for an empty cell
+	 */
+	const BlockType<P>* getCellType(T cellX, T cellY) {
+		if (!occupancy.test(cellX, cellY)) {
+			return nullptr;
+		}
+		if (occupancy.testAwake(cellX, cellY)) {
+			return &getAwakeBlock(cellX, cellY)->getType();
+		}
+		return &blockTypes.get((getResting(cellX, cellY) - 1) / directions);
+	}
+
+	/*
+	 * The moving block of a cell, nullptr if the cell is empty or at rest
+	 */
+	Block<P>* getAwakeBlock(T cellX, T cellY) {
+		return blockMap->get((P) (cellX * blockSize), (P) (cellY * blockSize));
+	}
+
+	/*
+	 * Magnetic moment of the block in a cell (zero if there is none)
+	 */
+	Point<P> getMagneticMoment(T cellX, T cellY) {
+		const BlockType<P> *type = getCellType(cellX, cellY);
+		if (type == nullptr) {
+			return Point<P>();
+		}
+		return Block<P>::getMagneticMoment(type->mass, getCellKind(cellX, cellY));
+	}
+
+	bool containsCell(T cellX, T cellY) const {
+		return cellX >= 0 && cellY >= 0 && cellX < width && cellY < height;
+	}
+
+	static constexpr int emptyCell = -1;
+	static constexpr int keepCell = -2;
+	// Magnet facing directions a block can have, see Block
+	static constexpr int directions = 5;
+
+	/*
+	 * Generates every chunk of the world at once, split across the thread pool
+	 */
 	void generateAll() {
-		std::uniform_int_distribution<T> randsBlocks(0, blockSize);
-		std::uniform_int_distribution<T> randsX(1, width-1);
-		std::uniform_int_distribution<T> randsY(1, height-1);
-		std::uniform_int_distribution<T> randMagnetism(0, 4);
+		WorldGenerator<T> generator(chunkGrid, randDevice());
+		std::vector<typename WorldGenerator<T>::ChunkData> chunks(
+				chunkGrid.getChunkCount());
+		threadPool.run(chunks.size(), [&](std::size_t i) {
+			Point<T> coord = chunkGrid.getChunkCoord(i);
+			generator.generateChunk(coord.x, coord.y, chunks[i]);
+		});
+		beginEdit();
+		for (auto &chunk : chunks) {
+			fillChunk(chunk);
+		}
+		endEdit();
+	}
 
-		T numBlocks = randsBlocks(randDevice);
-		for (T i = 0; i < numBlocks; i++) {
-			Block<P> *block = new Block<P>(blockSize, blockMass, 0, 0,
-					defaultMu, textureManager);
-			block->setMagnetFacingDirection(randMagnetism(randDevice));
-			T x = (T) (randsX(randDevice) * blockSize);
-			T y = (T) (randsY(randDevice) * blockSize);
-			block->setPosition(x, y);
-			add(block);
+	/*
+	 * Creates the blocks of a generated chunk in cells that are still empty
+	 */
+	void fillChunk(const typename WorldGenerator<T>::ChunkData &chunk) {
+		Point<T> start = chunkGrid.getChunkStart(chunk.chunkX, chunk.chunkY);
+		Point<T> end = chunkGrid.getChunkEnd(chunk.chunkX, chunk.chunkY);
+		T w = end.x - start.x;
+		// Generated terrain just appears, it isn't placed by anyone
+		bool wereEventsEnabled = eventsEnabled;
+		eventsEnabled = false;
+		beginEdit();
+		for (T y = start.y; y < end.y; y++) {
+			for (T x = start.x; x < end.x; x++) {
+				std::uint8_t cell = chunk.cells[(y - start.y) * w + (x - start.x)];
+				if (cell != 0 && getCellKind(x, y) == emptyCell) {
+					setCell(x, y, cell - 1);
+				}
+			}
 		}
+		endEdit();
+		eventsEnabled = wereEventsEnabled;
 	}
 
 	Point<T> getBlockyCoordinates(Point<P> &p) {
@@ -200,21 +806,399 @@ public:
 		return blockMap;
 	}
 
+	/*
+	 * Replaces every block of the world with the (moving) blocks of blockMap
+	 */
 	void setBlockMap(BlockArr2D<P, T> *&blockMap) {
 		this->blockMap = blockMap;
+		magnetTreeDirty = true;
+		occupancy.clear();
+		resetRestingChunks();
+		for (T y = 0; y < height; y++) {
+			for (T x = 0; x < width; x++) {
+				Block<P> *block = blockMap->getArr()[y * width + x];
+				occupancy.set(x, y, block != nullptr);
+				occupancy.setAwake(x, y, block != nullptr);
+				occupancy.setMagnetic(x, y, block != nullptr && block->isMagnetic());
+			}
+		}
+	}
+
+	const BlockType<P>& getDefaultType() const {
+		return *defaultType;
+	}
+
+	BlockRegistry<P>& getBlockTypes() {
+		return blockTypes;
+	}
+
+	/*
+	 * Bytes spent on the blocks at rest, palettes and packed indices of every chunk
+	 */
+	std::size_t getRestingMemoryUsage() const {
+		std::size_t total = 0;
+		for (const auto &chunk : restingChunks) {
+			total += chunk->getMemoryUsage();
+		}
+		return total;
+	}
+
+	/*
+	 * State of a moving block, as kept in a snapshot
+	 */
+	struct MovingBlock {
+		unsigned int cell; // inside its chunk, see getLocalCell()
+		std::uint16_t type;
+		int direction;
+		Point<P> coord, previousCoord;
+		P vx, vy;
+	};
+
+	struct ChunkState {
+		unsigned long revision;
+		std::shared_ptr<PalettedChunk> resting;
+		std::vector<MovingBlock> moving;
+	};
+
+	/*
+	 * One (immutable) state per chunk. Snapshots share the states of chunks
+	 * that did not change between them, and share the resting blocks of a
+	 * chunk with the live world until it is written to.
+	 */
+	typedef std::vector<std::shared_ptr<const ChunkState>> Snapshot;
+
+	/*
+	 * Captures every chunk, costing one pointer per chunk plus the moving
+	 * blocks. Chunks that are unchanged since previous (an earlier snapshot
+	 * of this world, if given) reuse its state.
+	 */
+	Snapshot takeSnapshot(const Snapshot *previous) {
+		Snapshot snapshot(chunkGrid.getChunkCount());
+		for (T i = 0; i < chunkGrid.getChunkCount(); i++) {
+			Point<T> chunk = chunkGrid.getChunkCoord(i);
+			Point<T> start = chunkGrid.getChunkStart(chunk.x, chunk.y);
+			Point<T> end = chunkGrid.getChunkEnd(chunk.x, chunk.y);
+			std::vector<MovingBlock> moving;
+			occupancy.getAwake().forEachInRect(start.x, start.y, end.x, end.y,
+					[&](T x, T y) {
+						Block<P> *block = getAwakeBlock(x, y);
+						moving.push_back(MovingBlock { getLocalCell(x, y),
+								block->getType().id,
+								block->getMagnetFacingDirection(),
+								block->getCoord(), block->getPreviousCoord(),
+								block->getVx(), block->getVy() });
+					});
+			if (previous != nullptr && moving.empty()
+					&& (*previous)[i]->revision == chunkRevisions[i]
+					&& (*previous)[i]->moving.empty()) {
+				snapshot[i] = (*previous)[i];
+				continue;
+			}
+			snapshot[i] = std::make_shared<const ChunkState>(
+					ChunkState { chunkRevisions[i], restingChunks[i],
+							std::move(moving) });
+		}
+		return snapshot;
+	}
+
+	/*
+	 * Puts every chunk back the way it was in snapshot. Chunks that are
+	 * provably the same are left alone, the rest are emptied and refilled
+	 * in one edit batch.
+	 */
+	void restoreSnapshot(const Snapshot &snapshot) {
+		beginEdit();
+		for (T i = 0; i < chunkGrid.getChunkCount(); i++) {
+			const ChunkState &state = *snapshot[i];
+			Point<T> chunk = chunkGrid.getChunkCoord(i);
+			Point<T> start = chunkGrid.getChunkStart(chunk.x, chunk.y);
+			Point<T> end = chunkGrid.getChunkEnd(chunk.x, chunk.y);
+			bool anyAwake = false;
+			occupancy.getAwake().forEachInRect(start.x, start.y, end.x, end.y,
+					[&](T, T) {
+						anyAwake = true;
+					});
+			if (state.revision == chunkRevisions[i] && state.moving.empty()
+					&& !anyAwake) {
+				continue;
+			}
+			clearChunk(start, end);
+			restingChunks[i] = state.resting;
+			for (T y = start.y; y < end.y; y++) {
+				for (T x = start.x; x < end.x; x++) {
+					std::uint16_t value = getResting(x, y);
+					if (value == 0) {
+						continue;
+					}
+					Point<P> force = getEmittedForce(
+							blockTypes.get((value - 1) / directions).mass,
+							(value - 1) % directions);
+					addEmittedForce((P) (x * blockSize), (P) (y * blockSize), force);
+					occupancy.set(x, y, true);
+					occupancy.setMagnetic(x, y,
+							force.x != (P) 0 || force.y != (P) 0);
+				}
+			}
+			for (const MovingBlock &moving : state.moving) {
+				T x = start.x + moving.cell % ChunkGrid<T>::chunkSize;
+				T y = start.y + moving.cell / ChunkGrid<T>::chunkSize;
+				Block<P> *block = takeBlock(blockTypes.get(moving.type), moving.vx,
+						moving.vy);
+				block->setMagnetFacingDirection(moving.direction);
+				block->setCoord(moving.previousCoord.x, moving.previousCoord.y);
+				block->setPosWithStats(moving.coord.x, moving.coord.y);
+				// The force of a moving magnet sits where it was last tick, see World::updateBlockForces()
+				addMagneticForce(block->getPreviousCoord(), block);
+				blockMap->set((P) (x * blockSize), (P) (y * blockSize), block);
+				occupancy.set(x, y, true);
+				occupancy.setAwake(x, y, true);
+				occupancy.setMagnetic(x, y, block->isMagnetic());
+			}
+			chunkRevisions[i]++;
+		}
+		magnetTreeDirty = true;
+		allChanged = true;
+		light.markAllChanged();
+		endEdit();
+	}
+
+	/*
+	 * Which cells hold a block and which hold a magnet, kept in step with
+	 * every add, remove, move and turn. Passes that only care about the
+	 * blocks (or magnets) should scan these bits instead of the block map.
+	 */
+	const OccupancyMap<T>& getOccupancy() const {
+		return occupancy;
+	}
+
+	/*
+	 * Brings the light levels up to date with every change since the last
+	 * call, only redoing the light around the changed cells
+	 */
+	void updateLight() {
+		light.update(occupancy, threadPool);
+	}
+
+	const LightMap<T>& getLight() const {
+		return light;
+	}
+
+	MagnetQuadTree<P, T>*& getMagnetTree() {
+		return magnetTree;
+	}
+
+	/*
+	 * Accuracy of magnet-to-magnet forces for this world, see MagnetQuadTree
+	 */
+	P getMagnetOpeningAngle() const {
+		return magnetTree->getOpeningAngle();
+	}
+
+	void setMagnetOpeningAngle(P openingAngle) {
+		magnetTree->setOpeningAngle(openingAngle);
 	}
 
 private:
+	/*
+	 * What a magnet adds to the force table, the same way as its moment
+	 */
+	Point<P> getEmittedForce(P mass, int direction) const {
+		return Block<P>::getMagneticMoment(mass, direction);
+	}
+
+	/*
+	 * Palette value of a resting cell: 0 when there is no resting block,
+	 * otherwise 1 + type id * directions + magnet direction
+	 */
+	std::uint16_t getResting(T cellX, T cellY) const {
+		return restingChunks[chunkGrid.getChunkIndex(cellX, cellY)]->get(
+				getLocalCell(cellX, cellY));
+	}
+
+	void setResting(T cellX, T cellY, std::uint16_t value) {
+		std::shared_ptr<PalettedChunk> &chunk =
+				restingChunks[chunkGrid.getChunkIndex(cellX, cellY)];
+		// Still shared with a snapshot, so it gets its own copy before the first write
+		if (chunk.use_count() > 1) {
+			chunk = std::make_shared<PalettedChunk>(*chunk);
+		}
+		chunk->set(getLocalCell(cellX, cellY), value);
+	}
+
+	/*
+	 * A magnet's force runs along its row (and column), and it pulls on
+	 * every other magnet
+	 */
+	void markForceChanged(P x, P y, const Point<P> &force) {
+		T cellX = (T) (x / blockSize), cellY = (T) (y / blockSize);
+		if (!containsCell(cellX, cellY)) {
+			return;
+		}
+		if (force.x != (P) 0 && !dirtyForceRows[cellY]) {
+			dirtyForceRows[cellY] = 1;
+			dirtyRowList.push_back(cellY);
+		}
+		if (force.y != (P) 0 && !dirtyForceColumns[cellX]) {
+			dirtyForceColumns[cellX] = 1;
+			dirtyColumnList.push_back(cellX);
+		}
+		magnetsChanged = magnetsChanged || force.x != (P) 0
+				|| force.y != (P) 0;
+	}
+
+	/*
+	 * The forces along a rebuilt line only change now, so its blocks get
+	 * looked at again even if they were handed out when the edit happened
+	 */
+	void rebuildForceLines(T maxLines) {
+		rebuiltRows.clear();
+		rebuiltColumns.clear();
+		forceTable->rebuild(threadPool, maxLines, &rebuiltRows, &rebuiltColumns);
+		for (T row : rebuiltRows) {
+			if (!dirtyForceRows[row]) {
+				dirtyForceRows[row] = 1;
+				dirtyRowList.push_back(row);
+			}
+		}
+		for (T column : rebuiltColumns) {
+			if (!dirtyForceColumns[column]) {
+				dirtyForceColumns[column] = 1;
+				dirtyColumnList.push_back(column);
+			}
+		}
+	}
+
+	void resetRestingChunks() {
+		allChanged = true;
+		light.markAllChanged();
+		restingChunks.resize(chunkGrid.getChunkCount());
+		for (auto &chunk : restingChunks) {
+			chunk = std::make_shared<PalettedChunk>(
+					ChunkGrid<T>::chunkSize * ChunkGrid<T>::chunkSize);
+		}
+	}
+
+	void addEmittedForce(P x, P y, const Point<P> &force) {
+		markForceChanged(x, y, force);
+		if (editDepth > 0) {
+			forceTable->addSource(x, y, force.x, force.y);
+		} else {
+			forceTable->addForce(x, y, force.x, force.y);
+		}
+	}
+
+	void removeEmittedForce(P x, P y, const Point<P> &force) {
+		markForceChanged(x, y, force);
+		if (editDepth > 0) {
+			forceTable->removeSource(x, y, force.x, force.y);
+		} else {
+			forceTable->removeForce(x, y, force.x, force.y);
+		}
+	}
+
+	/*
+	 * Blocks that stopped moving are kept for the next wake() rather than
+	 * deleted, so a world that keeps moving doesn't allocate every tick
+	 */
+	Block<P>* takeBlock(const BlockType<P> &type, P vx, P vy) {
+		if (spareBlocks.empty()) {
+			return new Block<P>(type, vx, vy);
+		}
+		Block<P> *block = spareBlocks.back();
+		spareBlocks.pop_back();
+		*block = Block<P>(type, vx, vy);
+		return block;
+	}
+
+	// Takes the block in the cell holding (x, y) out of the block map
+	void releaseBlock(P x, P y) {
+		spareBlocks.push_back(blockMap->get(x, y));
+		blockMap->set(x, y, nullptr);
+	}
+
+	/*
+	 * Takes every block out of the cells [start, end) without touching the
+	 * palette, which the caller replaces
+	 */
+	void clearChunk(const Point<T> &start, const Point<T> &end) {
+		occupancy.getOccupied().forEachInRect(start.x, start.y, end.x, end.y,
+				[&](T x, T y) {
+					if (occupancy.testAwake(x, y)) {
+						Block<P> *block = getAwakeBlock(x, y);
+						removeMagneticForce(block->getPreviousCoord(), block);
+						releaseBlock((P) (x * blockSize), (P) (y * blockSize));
+					} else {
+						std::uint16_t value = getResting(x, y);
+						removeEmittedForce((P) (x * blockSize), (P) (y * blockSize),
+								getEmittedForce(
+										blockTypes.get((value - 1) / directions).mass,
+										(value - 1) % directions));
+					}
+					occupancy.set(x, y, false);
+					occupancy.setAwake(x, y, false);
+					occupancy.setMagnetic(x, y, false);
+				});
+	}
+
+	static unsigned int getLocalCell(T cellX, T cellY) {
+		return (cellY % ChunkGrid<T>::chunkSize) * ChunkGrid<T>::chunkSize
+				+ cellX % ChunkGrid<T>::chunkSize;
+	}
+
+	/*
+	 * Makes one cell hold kind, returns whether anything changed
+	 */
+	bool setCell(T cellX, T cellY, int kind) {
+		if (getCellKind(cellX, cellY) == kind) {
+			return false;
+		}
+		if (occupancy.test(cellX, cellY)) {
+			remove((P) (cellX * blockSize), (P) (cellY * blockSize));
+		}
+		if (kind != emptyCell) {
+			place(cellX, cellY, *defaultType, kind);
+		}
+		return true;
+	}
+
 	BlockArr2D<P, T> *blockMap;
 	ForceTable<T, P> *forceTable;
+	MagnetQuadTree<P, T> *magnetTree;
+	bool magnetTreeDirty;
+	int editDepth;
+	T deferredRebuildLines;
 
 	T blockSize;
 	T blockMass;
 	T width, height;
 	float defaultMu;
 
-	TextureManager &textureManager;
+	BlockRegistry<P> &blockTypes;
+	const BlockType<P> *defaultType;
+	std::vector<std::shared_ptr<PalettedChunk>> restingChunks;
 	std::mt19937 &randDevice;
+	ThreadPool &threadPool;
+
+	ChunkGrid<T> chunkGrid;
+	std::vector<unsigned long> chunkRevisions;
+	OccupancyMap<T> occupancy;
+	LightMap<T> light;
+
+	// Cells to look at again, see collectChangedCells()
+	BitGrid<T> notified;
+	std::vector<Point<T>> changedCells;
+	std::vector<Point<T>> collectedCells;
+	std::vector<char> dirtyForceRows, dirtyForceColumns;
+	std::vector<T> dirtyRowList, dirtyColumnList;
+	// What the last force table rebuild did, kept to save the allocation
+	std::vector<T> rebuiltRows, rebuiltColumns;
+	bool magnetsChanged;
+	bool allChanged;
+
+	std::vector<Event> events, collectedEvents;
+	bool eventsEnabled;
+	Stats stats;
+	std::vector<Block<P>*> spareBlocks;
 
 	T magnetForce; // ASSUMPTION: magnetForce >= 0 Newtons
 };
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * BlockType.hpp
+ *
+ *  Created on: Oct 20, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_BLOCKTYPE_HPP_
+#define INCLUDE_BLOCKTYPE_HPP_
+
+#include <string>
+#include <deque>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#include <TextureManager.hpp>
+
+/**
+ * Properties every block of one kind shares. Blocks only point at their type,
+ * so a world full of the same few kinds of block pays for them once.
+ */
+template<class T>
+struct BlockType {
+	std::uint16_t id;
+	std::string name;
+	T length;
+	T mass; // in kg
+	float mu; // between 0 and 1
+	// Atlas tile for each magnet facing direction (0 - 4)
+	std::array<int, 5> tiles;
+};
+
+template<class T>
+class BlockRegistry {
+public:
+	static constexpr std::uint16_t maxTypes = 4096;
+
+	/*
+	 * Registers a new type, drawn with the plain and magnet tiles of the atlas
+	 */
+	const BlockType<T>& add(const std::string &name, T length, T mass,
+			float mu) {
+		return add(name, length, mass, mu,
+				{ TextureManager::NormalBlock, TextureManager::MagnetUpBlock,
+						TextureManager::MagnetDownBlock,
+						TextureManager::MagnetLeftBlock,
+						TextureManager::MagnetRightBlock });
+	}
+
+	const BlockType<T>& add(const std::string &name, T length, T mass,
+			float mu, const std::array<int, 5> &tiles) {
+		if (types.size() >= maxTypes) {
+			throw std::out_of_range("Too many block types: " + name);
+		}
+		// A deque never moves its elements, so the references handed out stay valid
+		types.push_back(BlockType<T> { (std::uint16_t) types.size(), name,
+				length, mass, mu, tiles });
+		return types.back();
+	}
+
+	const BlockType<T>& get(std::uint16_t id) const {
+		if (id >= types.size()) {
+			throw std::out_of_range("No block type " + std::to_string(id));
+		}
+		return types[id];
+	}
+
+	/*
+	 * nullptr if there is no type with that name
+	 */
+	const BlockType<T>* find(const std::string &name) const {
+		for (const BlockType<T> &type : types) {
+			if (type.name == name) {
+				return &type;
+			}
+		}
+		return nullptr;
+	}
+
+	std::size_t getCount() const {
+		return types.size();
+	}
+
+private:
+	std::deque<BlockType<T>> types;
+};
+
+#endif /* INCLUDE_BLOCKTYPE_HPP_ */
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Chunk.hpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_CHUNK_HPP_
+#define INCLUDE_CHUNK_HPP_
+
+#include <Point.hpp>
+
+/**
+ * Splits a grid of cells into square chunks of chunkSize x chunkSize cells.
+ * Chunks on the right and bottom edges are cut short by the grid.
+ * Chunks are numbered row by row, the same way as cells.
+ */
+template<class T>
+class ChunkGrid {
+public:
+	static constexpr T chunkSize = 16;
+
+	ChunkGrid(T width, T height) :
+			w(width), h(height), chunksX((width + chunkSize - 1) / chunkSize), chunksY(
+					(height + chunkSize - 1) / chunkSize) {
+	}
+
+	T getChunkIndex(T cellX, T cellY) const {
+		return (cellY / chunkSize) * chunksX + cellX / chunkSize;
+	}
+
+	T getChunkIndexOf(T chunkX, T chunkY) const {
+		return chunkY * chunksX + chunkX;
+	}
+
+	Point<T> getChunkCoord(T chunkIndex) const {
+		return Point<T>(chunkIndex % chunksX, chunkIndex / chunksX);
+	}
+
+	/*
+	 * First cell of a chunk
+	 */
+	Point<T> getChunkStart(T chunkX, T chunkY) const {
+		return Point<T>(chunkX * chunkSize, chunkY * chunkSize);
+	}
+
+	/*
+	 * One past the last cell of a chunk, clipped to the grid
+	 */
+	Point<T> getChunkEnd(T chunkX, T chunkY) const {
+		T endX = (chunkX + 1) * chunkSize;
+		T endY = (chunkY + 1) * chunkSize;
+		return Point<T>(endX < w ? endX : w, endY < h ? endY : h);
+	}
+
+	bool containsChunk(T chunkX, T chunkY) const {
+		return chunkX >= 0 && chunkY >= 0 && chunkX < chunksX && chunkY < chunksY;
+	}
+
+	T getChunkCount() const {
+		return chunksX * chunksY;
+	}
+
+	T getChunksX() const {
+		return chunksX;
+	}
+
+	T getChunksY() const {
+		return chunksY;
+	}
+
+	T getWidth() const {
+		return w;
+	}
+
+	T getHeight() const {
+		return h;
+	}
+
+private:
+	T w, h;
+	T chunksX, chunksY;
+};
+
+#endif /* INCLUDE_CHUNK_HPP_ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ChunkCodec.hpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_CHUNKCODEC_HPP_
+#define INCLUDE_CHUNKCODEC_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Packs up to maxValues 32 bit values (a chunk's worth of cells) that are
+ * mostly the same few values over and over:
+ *
+ *   byte palette size - 1, then the palette as little endian 32 bit words
+ *   unless the palette has a single value, the palette index of every
+ *   cell (a byte each) as a stream of tokens:
+ *     0x00 - 0x7F  literal: the next t + 1 indices as they are
+ *     0x80 - 0xBF  run: the last index again t - 0x80 + 1 times
+ *     0xC0 - 0xFF  match: t - 0xC0 + 3 indices copied from d + 1 back,
+ *                  d being the next byte (up to 256 back, so a whole chunk)
+ *
+ * Runs cover rows of one value, matches the patterns that repeat from row to
+ * row (a column of forces is the same value 16 cells apart). A chunk of one
+ * value takes 5 bytes.
+ */
+class ChunkCodec {
+public:
+	static constexpr unsigned int maxValues = 256;
+
+	/*
+	 * Appends the encoding of count values to out. Throws
+	 * std::invalid_argument for more than maxValues.
+	 */
+	static void encode(const std::uint32_t *values, unsigned int count,
+			std::vector<std::uint8_t> &out);
+
+	/*
+	 * Decodes count values from in, returns the number of bytes read
+	 */
+	static std::size_t decode(const std::uint8_t *in, std::uint32_t *values,
+			unsigned int count);
+
+	/*
+	 * Only value index, without writing out the others
+	 */
+	static std::uint32_t decodeAt(const std::uint8_t *in, unsigned int index);
+
+private:
+	// Decodes indices up to and including last into indices, returns the end of the stream read so far
+	static const std::uint8_t* decodeIndices(const std::uint8_t *in,
+			std::uint8_t *indices, unsigned int last);
+};
+
+#endif /* INCLUDE_CHUNKCODEC_HPP_ */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ChunkRenderer.hpp
+ *
+ *  Created on: Oct 15, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_CHUNKRENDERER_HPP_
+#define INCLUDE_CHUNKRENDERER_HPP_
+
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+#include <World.hpp>
+
+/**
+ * Draws a world from per-chunk vertex buffers that are only rebuilt when
+ * the chunk's revision changes, so a world at rest costs one draw call per
+ * visible chunk however many blocks it has.
+ *
+ * Chunks that keep changing (blocks in motion) aren't worth caching; their
+ * blocks go into one dynamic vertex array that is rebuilt every frame
+ * instead, until they settle down again. Only the dynamic layer is
+ * interpolated between ticks, cached chunks are drawn as of the last tick.
+ *
+ * Light levels go into the vertex colours when a chunk is built, so a chunk
+ * is also rebuilt when its light changes, and drawing costs nothing extra.
+ */
+class ChunkRenderer: public sf::Drawable {
+public:
+	ChunkRenderer();
+
+	/*
+	 * Syncs the layers with the world for the chunks inside view (in pixels).
+	 * alpha = how far between the previous tick and the last one to draw moving blocks.
+	 */
+	void update(World &world, const sf::FloatRect &view, float alpha);
+
+	/*
+	 * A chunk that changes again within this many frames goes to the dynamic
+	 * layer, and comes back once it has been quiet for as long. It covers
+	 * frame rates up to this many times the tick rate.
+	 */
+	static constexpr unsigned long coolFrames = 8;
+
+	// How bright (out of 255) a block with no light at all is drawn
+	static constexpr sf::Uint8 minBrightness = 40;
+
+	// Statistics of the last update()
+	unsigned int getRebuiltChunks() const {
+		return rebuiltChunks;
+	}
+
+	unsigned int getDynamicChunks() const {
+		return dynamicChunks;
+	}
+
+protected:
+	void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+
+private:
+	struct ChunkLayer {
+		std::vector<sf::Vertex> vertices;
+		sf::VertexBuffer buffer;
+		unsigned long revision = 0;
+		unsigned long lightRevision = 0;
+		unsigned long materialRevision = 0;
+		unsigned long lastChange = 0;
+		bool hot = false;
+		bool valid = false;
+	};
+
+	void rebuild(ChunkLayer &layer, World &world, gen chunkIndex);
+	static void appendChunk(std::vector<sf::Vertex> &vertices, World &world,
+			gen chunkIndex, float alpha);
+	static void appendMaterials(std::vector<sf::Vertex> &vertices,
+			World &world, gen chunkIndex);
+
+	std::vector<ChunkLayer> layers;
+	std::vector<gen> cachedInView;
+	std::vector<sf::Vertex> dynamicVertices;
+	const sf::Texture *atlas;
+	bool useBuffers;
+	unsigned long frame;
+
+	unsigned int rebuiltChunks, dynamicChunks;
+};
+
+#endif /* INCLUDE_CHUNKRENDERER_HPP_ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * DeltaCodec.hpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_DELTACODEC_HPP_
+#define INCLUDE_DELTACODEC_HPP_
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+#include <WorldSnapshot.hpp>
+#include <BitStream.hpp>
+
+/*
+ * A delta is a bit-packed list of the cells that differ from a baseline
+ * snapshot both sides already have:
+ *
+ *   varint tick, varint baseline tick + 1 (0 = none, diff against an empty world),
+ *   varint width, varint height, varint block size,
+ *   varint offset quantum, varint velocity quantum (in the snapshot's units)
+ *   per changed cell: varint gap to the previous changed cell (0 ends the list),
+ *     3 flag bits (state, offset, velocity), then the fields that changed:
+ *     3 bit state, zigzag offset x/y and velocity x/y differences in quanta,
+ *     as varints of 3 bit groups (they are nearly always +-1)
+ *
+ * Offsets go out on a grid of 1/offsetSteps of a cell, velocities on one of
+ * 1/velocitySteps of a cell per second, and only once they moved a whole
+ * step away from what the receiver has. Blocks creeping along or jittering
+ * in place cost nothing until they get somewhere. The encoder keeps the
+ * receiver's view, not the exact one, so the error never grows past a step.
+ *
+ * Only the sender's acknowledged snapshots are ever used as baselines, so a
+ * lost delta costs nothing but a slightly bigger next one.
+ */
+
+/**
+ * Sending side. Remembers what it sent until the receiver acknowledges a tick.
+ */
+class SnapshotEncoder {
+public:
+	SnapshotEncoder(std::size_t historySize, int offsetSteps =
+			defaultOffsetSteps, int velocitySteps = defaultVelocitySteps);
+
+	/*
+	 * Appends the delta from the newest acknowledged snapshot to current
+	 */
+	void encode(const WorldSnapshot &current, std::vector<std::uint8_t> &out);
+
+	/*
+	 * The receiver has the snapshot of this tick, it becomes the new baseline
+	 */
+	void acknowledge(unsigned long tick);
+
+	/*
+	 * Drops the baseline so the next delta is a keyframe
+	 */
+	void reset();
+
+	bool hasBaseline() const {
+		return baselineValid;
+	}
+
+	/*
+	 * The snapshot the receiver decodes from the last encode(), within a
+	 * step of the one passed in. Once acknowledged it is the baseline.
+	 */
+	const WorldSnapshot& getLastSent() const {
+		return sent.empty() ? baseline : sent.back();
+	}
+
+	/*
+	 * current is changed into what the receiver ends up with
+	 */
+	static void encodeDelta(const WorldSnapshot *baseline,
+			WorldSnapshot &current, std::vector<std::uint8_t> &out,
+			int offsetSteps = defaultOffsetSteps, int velocitySteps =
+					defaultVelocitySteps);
+
+	// Enough to draw a replay with: a 50 pixel block moves in steps of about 3
+	static constexpr int defaultOffsetSteps = 16;
+	// and is off by less than a pixel after a tick of extrapolating its velocity
+	static constexpr int defaultVelocitySteps = 4;
+
+private:
+	std::deque<WorldSnapshot> sent;
+	WorldSnapshot baseline;
+	bool baselineValid;
+	std::size_t maxHistory;
+	int offsetSteps, velocitySteps;
+};
+
+/**
+ * Receiving side. Keeps the last few decoded snapshots to serve as baselines.
+ */
+class SnapshotDecoder {
+public:
+	SnapshotDecoder(std::size_t historySize);
+
+	/*
+	 * Returns false for corrupt data or a baseline that is no longer around
+	 */
+	bool decode(const std::uint8_t *data, std::size_t size, WorldSnapshot &out);
+
+	/*
+	 * Tick to acknowledge back to the encoder
+	 */
+	unsigned long getLatestTick() const {
+		return history.empty() ? 0 : history.back().tick;
+	}
+
+	static bool decodeDelta(const WorldSnapshot *baseline, BitReader &reader,
+			WorldSnapshot &out);
+
+	/*
+	 * Reads only the baseline tick of a delta, or returns false for a keyframe
+	 */
+	static bool peekBaseline(const std::uint8_t *data, std::size_t size,
+			unsigned long &baselineTick);
+
+private:
+	std::deque<WorldSnapshot> history;
+	std::size_t maxHistory;
+};
+
+#endif /* INCLUDE_DELTACODEC_HPP_ */
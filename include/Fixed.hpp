@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Fixed.hpp
+ *
+ *  Created on: Oct 11, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_FIXED_HPP_
+#define INCLUDE_FIXED_HPP_
+
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <ostream>
+
+#include <TMath.hpp>
+
+/**
+ * Q16.16 fixed point number that can stand in for float as the precision
+ * type (P) of BlockManager, ForceTable, Block and Point.
+ *
+ * Every operation is plain integer math with a fixed rounding rule, so a
+ * simulation run with it gives the same bits on every compiler and machine.
+ * Conversions from float are explicit on purpose: any float that sneaks into
+ * the simulation breaks that promise. So are the ones from int, to keep
+ * mixed int math from quietly overflowing.
+ *
+ * Range is about +-32768 with a step of 1/65536, results outside of it wrap
+ * around (never signed overflow, which the compiler could do anything with).
+ * Floats outside of it saturate, and dividing by zero gives the largest value
+ * with the sign of the dividend, where float would give inf.
+ */
+class Fixed {
+public:
+	static constexpr int fractionBits = 16;
+	static constexpr std::int32_t one = 1 << fractionBits;
+
+	Fixed() :
+			raw(0) {
+	}
+	explicit Fixed(int value) :
+			raw(wrap((std::uint32_t) value << fractionBits)) {
+	}
+	explicit Fixed(unsigned int value) :
+			raw(wrap(value << fractionBits)) {
+	}
+	explicit Fixed(float value) :
+			raw(saturate((double) value * one)) {
+	}
+	explicit Fixed(double value) :
+			raw(saturate(value * one)) {
+	}
+
+	static Fixed fromRaw(std::int32_t rawValue) {
+		Fixed f;
+		f.raw = rawValue;
+		return f;
+	}
+
+	std::int32_t getRaw() const {
+		return raw;
+	}
+
+	// Rounds towards negative infinity, so cell indices of negative positions stay correct
+	explicit operator int() const {
+		return raw >> fractionBits;
+	}
+	explicit operator unsigned int() const {
+		return (unsigned int) (raw >> fractionBits);
+	}
+	explicit operator float() const {
+		return (float) raw / one;
+	}
+	explicit operator double() const {
+		return (double) raw / one;
+	}
+
+	Fixed operator-() const {
+		return fromRaw(wrap(0u - (std::uint32_t) raw));
+	}
+
+	Fixed& operator+=(Fixed f) {
+		raw = wrap((std::uint32_t) raw + (std::uint32_t) f.raw);
+		return *this;
+	}
+	Fixed& operator-=(Fixed f) {
+		raw = wrap((std::uint32_t) raw - (std::uint32_t) f.raw);
+		return *this;
+	}
+	Fixed& operator*=(Fixed f) {
+		raw = wrap((std::uint64_t) (((std::int64_t) raw * f.raw) >> fractionBits));
+		return *this;
+	}
+	Fixed& operator/=(Fixed f) {
+		raw = f.raw != 0 ?
+				wrap((std::uint64_t) (((std::int64_t) raw * one) / f.raw)) :
+				dividedByZero(raw);
+		return *this;
+	}
+	// Scaling by a whole number skips the widening multiply
+	Fixed& operator*=(int i) {
+		raw = wrap((std::uint32_t) raw * (std::uint32_t) i);
+		return *this;
+	}
+	Fixed& operator/=(int i) {
+		raw = i != 0 ?
+				wrap((std::uint64_t) ((std::int64_t) raw / i)) : dividedByZero(raw);
+		return *this;
+	}
+
+	friend Fixed operator+(Fixed a, Fixed b) {
+		return a += b;
+	}
+	friend Fixed operator-(Fixed a, Fixed b) {
+		return a -= b;
+	}
+	friend Fixed operator*(Fixed a, Fixed b) {
+		return a *= b;
+	}
+	friend Fixed operator/(Fixed a, Fixed b) {
+		return a /= b;
+	}
+	friend Fixed operator*(Fixed a, int i) {
+		return a *= i;
+	}
+	friend Fixed operator*(int i, Fixed a) {
+		return a *= i;
+	}
+	friend Fixed operator/(Fixed a, int i) {
+		return a /= i;
+	}
+
+	friend bool operator==(Fixed a, Fixed b) {
+		return a.raw == b.raw;
+	}
+	friend bool operator!=(Fixed a, Fixed b) {
+		return a.raw != b.raw;
+	}
+	friend bool operator<(Fixed a, Fixed b) {
+		return a.raw < b.raw;
+	}
+	friend bool operator>(Fixed a, Fixed b) {
+		return a.raw > b.raw;
+	}
+	friend bool operator<=(Fixed a, Fixed b) {
+		return a.raw <= b.raw;
+	}
+	friend bool operator>=(Fixed a, Fixed b) {
+		return a.raw >= b.raw;
+	}
+
+	friend std::ostream& operator<<(std::ostream &out, Fixed f) {
+		return out << (double) f;
+	}
+
+private:
+	/*
+	 * Results that don't fit wrap around, the same way on every machine,
+	 * instead of being signed overflow (which is undefined)
+	 */
+	static std::int32_t wrap(std::uint64_t bits) {
+		return (std::int32_t) (std::uint32_t) bits;
+	}
+
+	// Converting a float that doesn't fit into an int is undefined too
+	static std::int32_t saturate(double scaled) {
+		if (scaled != scaled) {
+			return 0;
+		}
+		if (scaled >= (double) std::numeric_limits<std::int32_t>::max()) {
+			return std::numeric_limits<std::int32_t>::max();
+		}
+		if (scaled <= (double) std::numeric_limits<std::int32_t>::min()) {
+			return std::numeric_limits<std::int32_t>::min();
+		}
+		return (std::int32_t) scaled;
+	}
+
+	static std::int32_t dividedByZero(std::int32_t dividend) {
+		if (dividend == 0) {
+			return 0;
+		}
+		return dividend > 0 ?
+				std::numeric_limits<std::int32_t>::max() :
+				std::numeric_limits<std::int32_t>::min();
+	}
+
+	std::int32_t raw;
+};
+
+/**
+ * Wide sum of Fixed values, Q47.16, for totals over many of them (like the
+ * nodes of MagnetQuadTree) that would overflow Fixed's range. Products and
+ * quotients are worked out in 128 bits, so only a result that doesn't fit
+ * wraps around; dividing by zero saturates like Fixed.
+ */
+class FixedSum {
+public:
+	FixedSum() :
+			raw(0) {
+	}
+	explicit FixedSum(int value) :
+			raw((std::int64_t) value * Fixed::one) {
+	}
+	explicit FixedSum(Fixed value) :
+			raw(value.getRaw()) {
+	}
+
+	static FixedSum fromRaw(std::int64_t rawValue) {
+		FixedSum f;
+		f.raw = rawValue;
+		return f;
+	}
+
+	std::int64_t getRaw() const {
+		return raw;
+	}
+
+	// Saturates when the sum is out of Fixed's range, a total must not flip its sign
+	explicit operator Fixed() const {
+		return Fixed::fromRaw(
+				(std::int32_t) std::clamp<std::int64_t>(raw,
+						std::numeric_limits<std::int32_t>::min(),
+						std::numeric_limits<std::int32_t>::max()));
+	}
+	explicit operator float() const {
+		return (float) raw / Fixed::one;
+	}
+
+	FixedSum& operator+=(FixedSum f) {
+		raw += f.raw;
+		return *this;
+	}
+	FixedSum& operator-=(FixedSum f) {
+		raw -= f.raw;
+		return *this;
+	}
+
+	friend FixedSum operator+(FixedSum a, FixedSum b) {
+		return a += b;
+	}
+	friend FixedSum operator-(FixedSum a, FixedSum b) {
+		return a -= b;
+	}
+	friend FixedSum operator*(FixedSum a, FixedSum b) {
+		a.raw = (std::int64_t) (((__int128) a.raw * b.raw) >> Fixed::fractionBits);
+		return a;
+	}
+	friend FixedSum operator/(FixedSum a, FixedSum b) {
+		if (b.raw == 0) {
+			a.raw = a.raw == 0 ? 0 :
+					a.raw > 0 ?
+							std::numeric_limits<std::int64_t>::max() :
+							std::numeric_limits<std::int64_t>::min();
+		} else {
+			a.raw = (std::int64_t) (((__int128) a.raw << Fixed::fractionBits)
+					/ b.raw);
+		}
+		return a;
+	}
+
+	friend bool operator==(FixedSum a, FixedSum b) {
+		return a.raw == b.raw;
+	}
+	friend bool operator!=(FixedSum a, FixedSum b) {
+		return a.raw != b.raw;
+	}
+	friend bool operator<(FixedSum a, FixedSum b) {
+		return a.raw < b.raw;
+	}
+	friend bool operator>(FixedSum a, FixedSum b) {
+		return a.raw > b.raw;
+	}
+
+private:
+	std::int64_t raw;
+};
+
+namespace tma {
+template<>
+struct Accumulator<Fixed> {
+	typedef FixedSum type;
+};
+
+/*
+ * Integer square root on the raw value, exact to the last bit
+ */
+template<>
+inline Fixed sqrt<Fixed>(Fixed x) {
+	if (x.getRaw() <= 0) {
+		return Fixed();
+	}
+	std::uint64_t n = (std::uint64_t) x.getRaw() << Fixed::fractionBits;
+	std::uint64_t result = 0;
+	std::uint64_t bit = (std::uint64_t) 1 << 62;
+	while (bit > n) {
+		bit >>= 2;
+	}
+	while (bit != 0) {
+		if (n >= result + bit) {
+			n -= result + bit;
+			result = (result >> 1) + bit;
+		} else {
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+	return Fixed::fromRaw((std::int32_t) result);
+}
+
+// Same for FixedSum, in 128 bits
+template<>
+inline FixedSum sqrt<FixedSum>(FixedSum x) {
+	if (x.getRaw() <= 0) {
+		return FixedSum();
+	}
+	unsigned __int128 n = (unsigned __int128) x.getRaw() << Fixed::fractionBits;
+	unsigned __int128 result = 0;
+	unsigned __int128 bit = (unsigned __int128) 1 << 126;
+	while (bit > n) {
+		bit >>= 2;
+	}
+	while (bit != 0) {
+		if (n >= result + bit) {
+			n -= result + bit;
+			result = (result >> 1) + bit;
+		} else {
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+	return FixedSum::fromRaw((std::int64_t) result);
+}
+}
+
+#endif /* INCLUDE_FIXED_HPP_ */
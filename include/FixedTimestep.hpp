@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * FixedTimestep.hpp
+ *
+ *  Created on: Oct 16, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_FIXEDTIMESTEP_HPP_
+#define INCLUDE_FIXEDTIMESTEP_HPP_
+
+/**
+ * Turns variable frame times into a whole number of fixed length ticks.
+ *
+ * Real time goes into an accumulator and comes out in tickLength slices.
+ * When the simulation can't keep up, at most maxSubsteps ticks run in one
+ * frame and the rest of the backlog is dropped (the game slows down rather
+ * than spending ever longer frames catching up, the "spiral of death").
+ */
+class FixedTimestep {
+public:
+	FixedTimestep(unsigned int tickRate, unsigned int maxSubsteps);
+
+	/*
+	 * Adds frameTime seconds of real time and returns how many ticks to run
+	 */
+	unsigned int advance(double frameTime);
+
+	/*
+	 * How far the current moment is between the last tick and the next, in
+	 * [0, 1). Renderers blend the last two states of the world with it.
+	 */
+	double getAlpha() const {
+		return accumulator / tickLength;
+	}
+
+	double getTickLength() const {
+		return tickLength;
+	}
+
+	unsigned int getTickRate() const {
+		return tickRate;
+	}
+
+	void setTickRate(unsigned int tickRate);
+
+	unsigned int getMaxSubsteps() const {
+		return maxSubsteps;
+	}
+
+	void setMaxSubsteps(unsigned int maxSubsteps) {
+		this->maxSubsteps = maxSubsteps;
+	}
+
+	// Ticks thrown away by the spiral of death guard so far
+	unsigned long getDroppedTicks() const {
+		return droppedTicks;
+	}
+
+	// Longest frame that is counted in full, anything above it (a debugger break, a dragged window) is cut down
+	static constexpr double maxFrameTime = 0.25;
+
+private:
+	unsigned int tickRate;
+	unsigned int maxSubsteps;
+	double tickLength;
+	double accumulator;
+	unsigned long droppedTicks;
+};
+
+#endif /* INCLUDE_FIXEDTIMESTEP_HPP_ */
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * FlowField.hpp
+ *
+ *  Created on: Oct 17, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_FLOWFIELD_HPP_
+#define INCLUDE_FLOWFIELD_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <functional>
+
+#include <BlockManager.hpp>
+#include <Chunk.hpp>
+#include <Point.hpp>
+#include <ThreadPool.hpp>
+
+/**
+ * Shared path finding towards one set of targets, for any number of walkers.
+ *
+ * The integration field holds every open cell's walking distance (in four
+ * way steps) to the nearest target, found with a breadth first search from
+ * all targets at once. From it every cell gets the direction of its
+ * cheapest neighbour, so a walker only has to look its cell up.
+ *
+ * The field follows the block map by itself: update() diffs the chunks
+ * whose revision moved and repairs the distances around the cells that
+ * changed, then recomputes the directions of the touched chunks in
+ * parallel. A new wall first takes back the distances that went through it
+ * and then fills them in again from the cells around, an opened cell is
+ * filled in from its neighbours.
+ *
+ * All coordinates are in cells, apart from getDirection(P, P).
+ */
+template<class P, class T>
+class FlowField {
+public:
+	static constexpr T unreachable = std::numeric_limits<T>::max();
+	static constexpr std::uint8_t noDirection = 8;
+	// More changed cells than 1 / fullRebuildRatio of the grid are cheaper to redo from scratch
+	static constexpr T fullRebuildRatio = 8;
+
+	FlowField(const ChunkGrid<T> &chunkGrid, T bSize,
+			const std::vector<Point<T>> &targetCells) :
+			grid(chunkGrid), w(chunkGrid.getWidth()), h(chunkGrid.getHeight()), blockSize(
+					bSize), needsRebuild(true) {
+		cost.assign(w * h, unreachable);
+		direction.assign(w * h, noDirection);
+		blocked.assign(w * h, 0);
+		target.assign(w * h, 0);
+		seenRevisions.assign(grid.getChunkCount(), 0);
+		chunkDirty.assign(grid.getChunkCount(), 0);
+		flips.resize(grid.getChunkCount());
+		setTargets(targetCells);
+	}
+
+	void setTargets(const std::vector<Point<T>> &targetCells) {
+		std::fill(target.begin(), target.end(), 0);
+		targets.clear();
+		for (const Point<T> &cell : targetCells) {
+			if (cell.x >= 0 && cell.y >= 0 && cell.x < w && cell.y < h) {
+				target[cell.y * w + cell.x] = 1;
+				targets.push_back(cell.y * w + cell.x);
+			}
+		}
+		needsRebuild = true;
+	}
+
+	/*
+	 * Catches up with the block map, call once per tick
+	 */
+	void update(BlockManager<P, T> &blockManager, ThreadPool &pool) {
+		changedChunks.clear();
+		for (T i = 0; i < grid.getChunkCount(); i++) {
+			unsigned long revision = blockManager.getChunkRevision(i);
+			if (revision != seenRevisions[i]) {
+				seenRevisions[i] = revision;
+				changedChunks.push_back(i);
+			}
+		}
+
+		// Cells that turned solid or open since the last update, one list per chunk
+		const BitGrid<T> &occupied = blockManager.getOccupancy().getOccupied();
+		pool.run(changedChunks.size(), [&](std::size_t k) {
+			flips[k].clear();
+			Point<T> chunk = grid.getChunkCoord(changedChunks[k]);
+			Point<T> start = grid.getChunkStart(chunk.x, chunk.y);
+			Point<T> end = grid.getChunkEnd(chunk.x, chunk.y);
+			for (T y = start.y; y < end.y; y++) {
+				for (T x = start.x; x < end.x; x++) {
+					T i = y * w + x;
+					if (occupied.test(x, y) != (blocked[i] != 0)) {
+						flips[k].push_back(i);
+					}
+				}
+			}
+		});
+
+		T numFlips = 0;
+		for (std::size_t k = 0; k < changedChunks.size(); k++) {
+			numFlips += flips[k].size();
+		}
+		if (needsRebuild || numFlips > w * h / fullRebuildRatio) {
+			for (std::size_t k = 0; k < changedChunks.size(); k++) {
+				for (T i : flips[k]) {
+					blocked[i] ^= 1;
+				}
+			}
+			rebuild(pool);
+			return;
+		}
+
+		reseed.clear();
+		for (std::size_t k = 0; k < changedChunks.size(); k++) {
+			for (T i : flips[k]) {
+				blocked[i] ^= 1;
+				// The corner rule makes the cells around see the change even if no distance moves
+				markAround(i);
+				if (blocked[i]) {
+					raise(i, reseed);
+				} else {
+					reseed.push_back(i);
+				}
+			}
+		}
+		lower(reseed);
+		updateDirtyChunks(pool);
+	}
+
+	/*
+	 * Recomputes the whole field
+	 */
+	void rebuild(ThreadPool &pool) {
+		std::fill(cost.begin(), cost.end(), unreachable);
+		// Breadth first, the vector is the queue and next its front
+		frontier.clear();
+		for (T i : targets) {
+			if (!blocked[i]) {
+				cost[i] = 0;
+				frontier.push_back(i);
+			}
+		}
+		for (std::size_t next = 0; next < frontier.size(); next++) {
+			T i = frontier[next];
+			forEachNeighbour(i, [&](T n) {
+				if (!blocked[n] && cost[n] == unreachable) {
+					cost[n] = cost[i] + 1;
+					frontier.push_back(n);
+				}
+			});
+		}
+		std::fill(chunkDirty.begin(), chunkDirty.end(), 0);
+		dirtyChunks.clear();
+		pool.run(grid.getChunkCount(), [this](std::size_t chunk) {
+			updateDirections((T) chunk);
+		});
+		needsRebuild = false;
+	}
+
+	/*
+	 * One step towards the nearest target as (-1..1, -1..1), (0, 0) on a
+	 * target or where there's no way to one
+	 */
+	Point<T> getCellDirection(T cellX, T cellY) const {
+		if (cellX < 0 || cellY < 0 || cellX >= w || cellY >= h) {
+			return Point<T>(0, 0);
+		}
+		std::uint8_t d = direction[cellY * w + cellX];
+		return d == noDirection ? Point<T>(0, 0) : Point<T>(offsetX[d], offsetY[d]);
+	}
+
+	Point<T> getDirection(P x, P y) const {
+		return getCellDirection((T) (x / blockSize), (T) (y / blockSize));
+	}
+
+	/*
+	 * Steps to the nearest target, unreachable if there is no way there
+	 */
+	T getDistance(T cellX, T cellY) const {
+		return cost[cellY * w + cellX];
+	}
+
+private:
+	template<class F>
+	void forEachNeighbour(T i, F visit) const {
+		T x = i % w, y = i / w;
+		if (x > 0) {
+			visit(i - 1);
+		}
+		if (x < w - 1) {
+			visit(i + 1);
+		}
+		if (y > 0) {
+			visit(i - w);
+		}
+		if (y < h - 1) {
+			visit(i + w);
+		}
+	}
+
+	/*
+	 * Cell i turned solid: takes back every distance that can't be reached
+	 * any more without it, and collects those cells for lower()
+	 */
+	void raise(T i, std::vector<T> &reseed) {
+		bool hadCost = cost[i] != unreachable;
+		setCost(i, unreachable);
+		if (!hadCost) {
+			return;
+		}
+		std::vector<T> &stack = raiseStack;
+		stack.clear();
+		stack.push_back(i);
+		while (!stack.empty()) {
+			T u = stack.back();
+			stack.pop_back();
+			forEachNeighbour(u, [&](T v) {
+				if (blocked[v] || target[v] || cost[v] == unreachable
+						|| hasSupport(v)) {
+					return;
+				}
+				setCost(v, unreachable);
+				reseed.push_back(v);
+				stack.push_back(v);
+			});
+		}
+	}
+
+	/*
+	 * Whether some neighbour of i is still one step closer to a target
+	 */
+	bool hasSupport(T i) const {
+		bool supported = false;
+		forEachNeighbour(i, [&](T n) {
+			if (!blocked[n] && cost[n] != unreachable && cost[n] + 1 == cost[i]) {
+				supported = true;
+			}
+		});
+		return supported;
+	}
+
+	/*
+	 * Fills in the distances of the given cells from their neighbours and
+	 * spreads any improvement outwards, closest first
+	 */
+	void lower(const std::vector<T> &cells) {
+		// A min-heap of (distance, cell)
+		std::vector<std::pair<T, T>> &open = lowerHeap;
+		auto closer = std::greater<std::pair<T, T>>();
+		open.clear();
+		for (T i : cells) {
+			if (blocked[i]) {
+				continue;
+			}
+			T best = target[i] ? 0 : unreachable;
+			forEachNeighbour(i, [&](T n) {
+				if (!blocked[n] && cost[n] != unreachable && cost[n] + 1 < best) {
+					best = cost[n] + 1;
+				}
+			});
+			if (best < cost[i]) {
+				setCost(i, best);
+				open.emplace_back(best, i);
+				std::push_heap(open.begin(), open.end(), closer);
+			}
+		}
+		while (!open.empty()) {
+			std::pop_heap(open.begin(), open.end(), closer);
+			std::pair<T, T> entry = open.back();
+			open.pop_back();
+			if (entry.first != cost[entry.second]) {
+				continue;
+			}
+			forEachNeighbour(entry.second, [&](T n) {
+				if (!blocked[n] && entry.first + 1 < cost[n]) {
+					setCost(n, entry.first + 1);
+					open.emplace_back(entry.first + 1, n);
+					std::push_heap(open.begin(), open.end(), closer);
+				}
+			});
+		}
+	}
+
+	/*
+	 * Changes a distance and marks every chunk whose directions could see it
+	 */
+	void setCost(T i, T value) {
+		cost[i] = value;
+		markAround(i);
+	}
+
+	void markAround(T i) {
+		T x = i % w, y = i / w;
+		T x0 = x > 0 ? x - 1 : x, x1 = x < w - 1 ? x + 1 : x;
+		T y0 = y > 0 ? y - 1 : y, y1 = y < h - 1 ? y + 1 : y;
+		markDirty(grid.getChunkIndex(x0, y0));
+		markDirty(grid.getChunkIndex(x1, y0));
+		markDirty(grid.getChunkIndex(x0, y1));
+		markDirty(grid.getChunkIndex(x1, y1));
+	}
+
+	void markDirty(T chunk) {
+		if (!chunkDirty[chunk]) {
+			chunkDirty[chunk] = 1;
+			dirtyChunks.push_back(chunk);
+		}
+	}
+
+	void updateDirtyChunks(ThreadPool &pool) {
+		pool.run(dirtyChunks.size(), [this](std::size_t k) {
+			updateDirections(dirtyChunks[k]);
+		});
+		for (T chunk : dirtyChunks) {
+			chunkDirty[chunk] = 0;
+		}
+		dirtyChunks.clear();
+	}
+
+	/*
+	 * Points every cell of a chunk at its cheapest neighbour. Diagonals are
+	 * only taken when both cells beside them are open, so walkers don't cut
+	 * corners, and straight moves win ties.
+	 */
+	void updateDirections(T chunk) {
+		Point<T> coord = grid.getChunkCoord(chunk);
+		Point<T> start = grid.getChunkStart(coord.x, coord.y);
+		Point<T> end = grid.getChunkEnd(coord.x, coord.y);
+		for (T y = start.y; y < end.y; y++) {
+			for (T x = start.x; x < end.x; x++) {
+				T i = y * w + x;
+				std::uint8_t best = noDirection;
+				T bestCost = cost[i];
+				if (!blocked[i] && bestCost != unreachable && bestCost > 0) {
+					for (std::uint8_t d = 0; d < 8; d++) {
+						T nx = x + offsetX[d], ny = y + offsetY[d];
+						if (nx < 0 || ny < 0 || nx >= w || ny >= h
+								|| blocked[ny * w + nx]) {
+							continue;
+						}
+						if (offsetX[d] != 0 && offsetY[d] != 0
+								&& (blocked[y * w + nx] || blocked[ny * w + x])) {
+							continue;
+						}
+						if (cost[ny * w + nx] < bestCost) {
+							bestCost = cost[ny * w + nx];
+							best = d;
+						}
+					}
+				}
+				direction[i] = best;
+			}
+		}
+	}
+
+	// Straight moves first, so they win ties
+	static constexpr int offsetX[8] = { 1, 0, -1, 0, 1, -1, -1, 1 };
+	static constexpr int offsetY[8] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+
+	const ChunkGrid<T> &grid;
+	T w, h;
+	T blockSize;
+	bool needsRebuild;
+
+	std::vector<T> cost;
+	std::vector<std::uint8_t> direction;
+	std::vector<std::uint8_t> blocked;
+	std::vector<std::uint8_t> target;
+	std::vector<T> targets;
+
+	std::vector<unsigned long> seenRevisions;
+	std::vector<std::uint8_t> chunkDirty;
+	std::vector<T> dirtyChunks;
+
+	// Scratch space of update() and friends, kept so a tick doesn't allocate
+	std::vector<T> changedChunks;
+	std::vector<std::vector<T>> flips; // cells that turned solid or open, per changed chunk
+	std::vector<T> reseed, raiseStack, frontier;
+	std::vector<std::pair<T, T>> lowerHeap;
+};
+
+#endif /* INCLUDE_FLOWFIELD_HPP_ */
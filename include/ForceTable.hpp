@@ -27,96 +27,732 @@
 #define INCLUDE_FORCETABLE_HPP_
 
 #include <cstdlib>
+#include <cstring>
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <array>
-#include <Arr2D.hpp>
+#include <vector>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+#include <Chunk.hpp>
+#include <Point.hpp>
+#include <ChunkCodec.hpp>
+#include <ThreadPool.hpp>
 
+/**
+ * Every cell's force, as the sum of the rays of all the sources in its row
+ * (x) and column (y), along with the sources themselves.
+ *
+ * Stored in chunk sized tiles. A tile no write has touched for a while can
+ * be packed with ChunkCodec by cool(): away from moving magnets the forces
+ * are a few long runs, so a cold tile takes tens to hundreds of bytes
+ * instead of NumGrids * tileCells values. rebuild() only writes the cells
+ * whose force changed, so a magnet moving about only keeps the tiles it
+ * actually changes warm. Reads straight from a cold tile decode just the
+ * cell they need and leave it cold (so they're safe from any number of
+ * threads), the first write unpacks it again.
+ */
 // G - general data points, P - precision data points
 template<class G, class P>
 class ForceTable {
 public:
+	static constexpr G tileSize = ChunkGrid<G>::chunkSize;
+	static constexpr G tileCells = tileSize * tileSize;
+	// Unpacked tiles kept for the next one to warm up, instead of being freed
+	static constexpr std::size_t maxSpareTiles = 16;
+
 	ForceTable(G width, G height, G bSize) :
-			w(width), h(height), blockSize(bSize) {
-		fx = new Arr2D<P, G>(width, height);
-		fy = new Arr2D<P, G>(width, height);
+			w(width), h(height), blockSize(bSize), tilesX(
+					(width + tileSize - 1) / tileSize), tilesY(
+					(height + tileSize - 1) / tileSize) {
+		static_assert(sizeof(P) == sizeof(std::uint32_t), "ChunkCodec packs 32 bit values");
+		// Everything starts out cold, and zero
+		std::uint32_t zero[tileCells] = { };
+		for (int grid = 0; grid < NumGrids; grid++) {
+			zeroOffsets[grid] = (std::uint32_t) zeroPacked.size();
+			ChunkCodec::encode(zero, tileCells, zeroPacked);
+		}
+		tiles.resize((std::size_t) tilesX * tilesY);
+		for (Tile &tile : tiles) {
+			tile.packed = zeroPacked;
+			tile.offsets = zeroOffsets;
+		}
+		coldTiles = (G) tiles.size();
+		packedBytes = tiles.size() * zeroPacked.size();
+		spareCells.reserve(maxSpareTiles);
+		rowSums.reset(height, tilesX);
+		columnSums.reset(width, tilesY);
+		rowDirty.assign(height, 0);
+		columnDirty.assign(width, 0);
+		cellsTouched = 0;
+		scan = 0;
+		decodes = 0;
+		decodeNanos = 0;
 	}
 	~ForceTable() {
-		delete fx;
-		delete fy;
+		for (Tile &tile : tiles) {
+			delete[] tile.cells;
+		}
+		for (P *cells : spareCells) {
+			delete[] cells;
+		}
 	}
+
+	ForceTable(const ForceTable&) = delete;
+	ForceTable& operator=(const ForceTable&) = delete;
+
 	/*
 	 * fx, fy is negative/positive
 	 */
 	void addForce(P x, P y, P forceX, P forceY) {
-		G newX = (G) (x / blockSize);
-		G newY = (G) (y / blockSize);
-		if (newX < 0 || newX >= w || newY < 0 || newY >= h) {
-			return;
+		applyForce(x, y, forceX, forceY, 1, false);
+	}
+
+	/*
+	 * Takes back a force given to addForce() with the same arguments
+	 */
+	void removeForce(P x, P y, P forceX, P forceY) {
+		applyForce(x, y, forceX, forceY, -1, false);
+	}
+
+	/*
+	 * Same as addForce()/removeForce(), except the rays are left alone until
+	 * rebuild(). Use these for many edits at once: the rebuild costs one sweep
+	 * per touched row and column instead of one ray per edit.
+	 */
+	void addSource(P x, P y, P forceX, P forceY) {
+		applyForce(x, y, forceX, forceY, 1, true);
+	}
+
+	void removeSource(P x, P y, P forceX, P forceY) {
+		applyForce(x, y, forceX, forceY, -1, true);
+	}
+
+	bool needsRebuild() const {
+		return !dirtyRows.empty() || !dirtyColumns.empty();
+	}
+
+	// Rows and columns waiting for rebuild()
+	G getDirtyLines() const {
+		return (G) (dirtyRows.size() + dirtyColumns.size());
+	}
+
+	/*
+	 * Recomputes the rows and columns touched by addSource()/removeSource()
+	 * from the sources, each one a prefix sum run on its own thread.
+	 * maxLines bounds the number of rows and columns done in one go, the
+	 * rest wait for the next call (and read their old forces until then).
+	 * The lines it did are added to rebuiltRows and rebuiltColumns, if given.
+	 */
+	void rebuild(ThreadPool &pool, G maxLines = std::numeric_limits<G>::max(),
+			std::vector<G> *rebuiltRows = nullptr,
+			std::vector<G> *rebuiltColumns = nullptr) {
+		G rows = std::min((G) dirtyRows.size(), maxLines);
+		G columns = std::min((G) dirtyColumns.size(), maxLines - rows);
+		// From the back of the lists, so what's left stays where it is
+		G firstRow = (G) dirtyRows.size() - rows;
+		G firstColumn = (G) dirtyColumns.size() - columns;
+		rebuildLines(pool, dirtyRows, firstRow, true);
+		rebuildLines(pool, dirtyColumns, firstColumn, false);
+		cellsTouched += (unsigned long long) rows * w
+				+ (unsigned long long) columns * h;
+		for (G i = firstRow; i < (G) dirtyRows.size(); i++) {
+			rowDirty[dirtyRows[i]] = 0;
 		}
-		if (fx > 0) {
-			for (G i = newX + 1; i < w; i++) {
-				fx->get(i, newY) += forceX;
-			}
-		} else if (fx < 0) {
-			for (G i = newX - 1; i >= 0; i--) {
-				fx->get(i, newY) += forceX;
-			}
+		for (G i = firstColumn; i < (G) dirtyColumns.size(); i++) {
+			columnDirty[dirtyColumns[i]] = 0;
 		}
-
-		if (fy > 0) {
-			for (G i = newY + 1; i < h; i++) {
-				fy->get(newX, i) += forceY;
-			}
-		} else if (fy < 0) {
-			for (G i = newY - 1; i >= 0; i--) {
-				fy->get(newX, i) += forceY;
-			}
+		if (rebuiltRows != nullptr) {
+			rebuiltRows->insert(rebuiltRows->end(), dirtyRows.begin() + firstRow,
+					dirtyRows.end());
 		}
+		if (rebuiltColumns != nullptr) {
+			rebuiltColumns->insert(rebuiltColumns->end(),
+					dirtyColumns.begin() + firstColumn, dirtyColumns.end());
+		}
+		dirtyRows.resize(firstRow);
+		dirtyColumns.resize(firstColumn);
 	}
 
-	void removeForce(P x, P y, P forceX, P forceY) {
-		addForce(x, y, -forceX, -forceY);
+	/*
+	 * Packs every tile that no write has touched during the last idleScans
+	 * calls (and that isn't waiting for rebuild()), returns how many it packed. Call it at a steady pace (every so
+	 * many ticks): idleScans times the pace is how long a tile has to be
+	 * left alone to go cold.
+	 */
+	G cool(unsigned long idleScans) {
+		scan++;
+		G cooled = 0;
+		for (G i = 0; i < (G) tiles.size(); i++) {
+			if (tiles[i].cells != nullptr && scan - tiles[i].lastWrite > idleScans
+					&& !hasDirtyLines(i)) {
+				pack(i);
+				cooled++;
+			}
+		}
+		return cooled;
 	}
 
 	void clearAllForces() {
 		if (w > 0 && h > 0) {
-			fx->clear();
-			fy->clear();
+			for (Tile &tile : tiles) {
+				releaseCells(tile.cells);
+				tile.cells = nullptr;
+				tile.packed = zeroPacked;
+				tile.offsets = zeroOffsets;
+			}
+			coldTiles = (G) tiles.size();
+			packedBytes = tiles.size() * zeroPacked.size();
+			rowSums.reset(h, tilesX);
+			columnSums.reset(w, tilesY);
 		} else {
 			throw -10;
 		}
 	}
 
-	Point<P> getForce(P x, P y) {
+	Point<P> getForce(P x, P y) const {
 		G accessX = (G) (x / blockSize);
 		G accessY = (G) (y / blockSize);
-		if (accessX < w && accessY < h) {
-			return Point<P> { fx->get(accessX, accessY), fy->get(accessX,
-					accessY) };
+		if (accessX >= 0 && accessY >= 0 && accessX < w && accessY < h) {
+			return Point<P> { read(ForceX, accessX, accessY), read(ForceY,
+					accessX, accessY) };
 		} else {
 			return Point<P>();
 		}
 
 	}
 
-	// TODO: fix this algorithm
+	/*
+	 * Writes every cell's force row by row, cold tiles included, converted to F
+	 */
+	template<class F>
+	void copyForces(F *forceX, F *forceY) const {
+		std::uint32_t bits[tileCells];
+		P values[tileCells];
+		for (G tileY = 0; tileY < tilesY; tileY++) {
+			for (G tileX = 0; tileX < tilesX; tileX++) {
+				const Tile &tile = tiles[tileY * tilesX + tileX];
+				G width = std::min(tileSize, w - tileX * tileSize);
+				G height = std::min(tileSize, h - tileY * tileSize);
+				for (int grid = ForceX; grid <= ForceY; grid++) {
+					const P *cells = tile.cells + grid * tileCells;
+					if (tile.cells == nullptr) {
+						ChunkCodec::decode(tile.packed.data() + tile.offsets[grid],
+								bits, tileCells);
+						for (G i = 0; i < tileCells; i++) {
+							values[i] = fromBits(bits[i]);
+						}
+						cells = values;
+					}
+					F *out = grid == ForceX ? forceX : forceY;
+					for (G y = 0; y < height; y++) {
+						for (G x = 0; x < width; x++) {
+							out[(tileY * tileSize + y) * w + tileX * tileSize + x] =
+									(F) cells[y * tileSize + x];
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/*
+	 * How many force cells have been written so far, by applying a force
+	 * straight away or by rebuilding a line
+	 */
+	unsigned long long getCellsTouched() const {
+		return cellsTouched;
+	}
+
+	// The cold tier: packed tiles, their size and what unpacking them has cost
+	G getTileCount() const {
+		return (G) tiles.size();
+	}
+
+	G getColdTiles() const {
+		return coldTiles;
+	}
+
+	std::size_t getPackedBytes() const {
+		return packedBytes;
+	}
+
+	// The same tiles unpacked
+	std::size_t getUnpackedBytes(G numTiles) const {
+		return (std::size_t) numTiles * NumGrids * tileCells * sizeof(P);
+	}
+
+	unsigned long long getDecodes() const {
+		return decodes;
+	}
+
+	unsigned long long getDecodeNanos() const {
+		return decodeNanos;
+	}
+
+	/*
+	 * Bytes held by the tiles, hot and cold, the spare ones and the sums
+	 * rebuild() remembers
+	 */
+	std::size_t getMemoryUsage() const {
+		std::size_t total = tiles.capacity() * sizeof(Tile)
+				+ getUnpackedBytes((G) (tiles.size() - coldTiles + spareCells.size()));
+		for (const Tile &tile : tiles) {
+			total += tile.packed.capacity();
+		}
+		total += (rowSums.starts.size() + rowSums.suffixes.size()
+				+ columnSums.starts.size() + columnSums.suffixes.size()) * sizeof(P);
+		return total;
+	}
+
 	void serialize(std::string &dest) {
-		dest += w + " " + h + "\n";
+		dest += std::to_string(w) + " " + std::to_string(h) + "\n";
 		for (G row = 0; row < h; row++) {
 			for (G col = 0; col < w; col++) {
-				dest += std::to_string(fx(row, col)) + " "
-						+ std::to_string(fy(row, col));
+				dest += std::to_string((float) read(ForceX, col, row)) + " "
+						+ std::to_string((float) read(ForceY, col, row)) + " ";
 			}
 			dest += "\n";
 		}
 	}
 
 private:
-	Arr2D<P, G> *fx;
-	Arr2D<P, G> *fy;
+	enum Grid {
+		ForceX, ForceY,
+		// Per cell force sources, split by which way along the axis they push
+		PositiveX, NegativeX, PositiveY, NegativeY,
+		NumGrids
+	};
+
+	// What rebuilding a line did to each tile along it
+	enum SegmentFlag {
+		Unchanged, Changed, Unpack
+	};
+
+	/*
+	 * The prefix sum at the start and the suffix sum at the end of every
+	 * tile along each row (or column), as of its last rebuild. Not known
+	 * for a line addForce()/removeForce() wrote to since.
+	 */
+	struct LineSums {
+		std::vector<P> starts, suffixes;
+		std::vector<unsigned char> known;
+
+		void reset(G lines, G segments) {
+			starts.assign((std::size_t) lines * segments, P(0));
+			suffixes.assign((std::size_t) lines * segments, P(0));
+			known.assign(lines, 1);
+		}
+	};
+
+	struct Tile {
+		// NumGrids * tileCells values, grid after grid, or nullptr while it's cold
+		P *cells = nullptr;
+		// While it's cold, one ChunkCodec stream per grid starting at offsets
+		std::vector<std::uint8_t> packed;
+		std::array<std::uint32_t, NumGrids> offsets;
+		unsigned long lastWrite = 0;
+	};
+
+	/*
+	 * A source pushes along its ray in the direction of its force, so the
+	 * sign of the force picks both the ray and the source grid.
+	 * sign = 1 adds the force, -1 takes it back.
+	 */
+	void applyForce(P x, P y, P forceX, P forceY, int sign, bool deferred) {
+		G newX = (G) (x / blockSize);
+		G newY = (G) (y / blockSize);
+		if (newX < 0 || newX >= w || newY < 0 || newY >= h) {
+			return;
+		}
+		P valueX = sign > 0 ? forceX : -forceX;
+		P valueY = sign > 0 ? forceY : -forceY;
+
+		if (forceX != P(0)) {
+			at(forceX > P(0) ? PositiveX : NegativeX, newX, newY) += valueX;
+			if (deferred) {
+				markRow(newY);
+			} else if (forceX > P(0)) {
+				addToLine(ForceX, newY, newX + 1, w, valueX, true);
+				cellsTouched += w - newX - 1;
+			} else {
+				addToLine(ForceX, newY, 0, newX, valueX, true);
+				cellsTouched += newX;
+			}
+			if (!deferred) {
+				rowSums.known[newY] = 0;
+			}
+		}
+
+		if (forceY != P(0)) {
+			at(forceY > P(0) ? PositiveY : NegativeY, newX, newY) += valueY;
+			if (deferred) {
+				markColumn(newX);
+			} else if (forceY > P(0)) {
+				addToLine(ForceY, newX, newY + 1, h, valueY, false);
+				cellsTouched += h - newY - 1;
+			} else {
+				addToLine(ForceY, newX, 0, newY, valueY, false);
+				cellsTouched += newY;
+			}
+			if (!deferred) {
+				columnSums.known[newX] = 0;
+			}
+		}
+	}
+
+	void markRow(G row) {
+		if (!rowDirty[row]) {
+			rowDirty[row] = 1;
+			dirtyRows.push_back(row);
+		}
+	}
+
+	void markColumn(G column) {
+		if (!columnDirty[column]) {
+			columnDirty[column] = 1;
+			dirtyColumns.push_back(column);
+		}
+	}
+
+	G getTileIndex(G x, G y) const {
+		return (y / tileSize) * tilesX + x / tileSize;
+	}
+
+	static G getLocalCell(G x, G y) {
+		return (y % tileSize) * tileSize + x % tileSize;
+	}
+
+	P read(Grid grid, G x, G y) const {
+		const Tile &tile = tiles[getTileIndex(x, y)];
+		if (tile.cells != nullptr) {
+			return tile.cells[grid * tileCells + getLocalCell(x, y)];
+		}
+		return fromBits(
+				ChunkCodec::decodeAt(tile.packed.data() + tile.offsets[grid],
+						getLocalCell(x, y)));
+	}
+
+	P& at(Grid grid, G x, G y) {
+		return getHotTile(getTileIndex(x, y))[grid * tileCells
+				+ getLocalCell(x, y)];
+	}
+
+	/*
+	 * The cells of a tile that's about to be written, unpacked if need be
+	 */
+	P* getHotTile(G index) {
+		Tile &tile = tiles[index];
+		if (tile.cells == nullptr) {
+			unpack(index);
+		}
+		tile.lastWrite = scan;
+		return tile.cells;
+	}
+
+	/*
+	 * Cells [begin, end) of a row (isRow) or column, in the tiles along it
+	 */
+	template<class F>
+	void forEachSegment(G line, G begin, G end, bool isRow, F visit) {
+		G stride = isRow ? 1 : tileSize;
+		while (begin < end) {
+			G segmentEnd = std::min(end, (begin / tileSize + 1) * tileSize);
+			G x = isRow ? begin : line, y = isRow ? line : begin;
+			visit(getHotTile(getTileIndex(x, y)) + getLocalCell(x, y),
+					segmentEnd - begin, stride);
+			begin = segmentEnd;
+		}
+	}
+
+	void addToLine(Grid grid, G line, G begin, G end, P value, bool isRow) {
+		forEachSegment(line, begin, end, isRow, [&](P *cells, G count, G stride) {
+			addRun(cells + grid * tileCells, count, stride, value);
+		});
+	}
+
+	/*
+	 * Rebuilds lines[first..] side by side. The threads only write to tiles
+	 * that are already unpacked, the cold ones whose forces turn out to have
+	 * changed are unpacked afterwards and their lines done again.
+	 */
+	void rebuildLines(ThreadPool &pool, const std::vector<G> &lines, G first,
+			bool isRow) {
+		G count = (G) lines.size() - first;
+		G segments = isRow ? tilesX : tilesY;
+		segmentFlags.assign((std::size_t) count * segments, Unchanged);
+		segmentStarts.resize((std::size_t) count * segments);
+		segmentSuffixes.resize((std::size_t) count * segments);
+		pool.parallelFor<G>(0, count, 4, [&](G begin, G end) {
+			for (G i = begin; i < end; i++) {
+				rebuildLine(lines[first + i], isRow, &segmentFlags[i * segments],
+						&segmentStarts[i * segments], &segmentSuffixes[i * segments]);
+			}
+		});
+		for (G i = 0; i < count; i++) {
+			bool again = false;
+			for (G s = 0; s < segments; s++) {
+				G index = getSegmentTile(lines[first + i], s, isRow);
+				if (segmentFlags[i * segments + s] == Unpack) {
+					getHotTile(index);
+					again = true;
+				} else if (segmentFlags[i * segments + s] == Changed) {
+					tiles[index].lastWrite = scan;
+				}
+			}
+			if (again) {
+				rebuildLine(lines[first + i], isRow, &segmentFlags[i * segments],
+						&segmentStarts[i * segments], &segmentSuffixes[i * segments]);
+			}
+		}
+	}
+
+	/*
+	 * One row (isRow) or column. Each cell feels every forward source before
+	 * it and every backward source after it, so it's an exclusive prefix sum
+	 * one way plus a suffix sum the other way, worked out tile by tile.
+	 *
+	 * Only cells that change are written. A cold tile can't have had its
+	 * sources changed (that would have unpacked it), so when the sums coming
+	 * into it are the ones the line's last rebuild saw, it's skipped without
+	 * decoding. Otherwise a changed cell in a cold tile flags it Unpack.
+	 */
+	void rebuildLine(G line, bool isRow, unsigned char *flags, P *starts,
+			P *suffixes) {
+		Grid force = isRow ? ForceX : ForceY;
+		Grid forward = isRow ? PositiveX : PositiveY;
+		Grid backward = isRow ? NegativeX : NegativeY;
+		G segments = isRow ? tilesX : tilesY;
+		LineSums &sums = isRow ? rowSums : columnSums;
+		const P *oldStarts = &sums.starts[line * segments];
+		const P *oldSuffixes = &sums.suffixes[line * segments];
+		bool known = sums.known[line];
+
+		P forwardCells[tileSize], backwardCells[tileSize], forceCells[tileSize];
+		P sum = P(0);
+		for (G s = 0; s < segments; s++) {
+			starts[s] = sum;
+			if (known && isSegmentCold(line, s, isRow) && s + 1 < segments
+					&& sameBits(sum, oldStarts[s])) {
+				sum = oldStarts[s + 1];
+				continue;
+			}
+			G n = readSegment(forward, line, s, isRow, forwardCells);
+			for (G i = 0; i < n; i++) {
+				sum += forwardCells[i];
+			}
+		}
+		sum = P(0);
+		for (G s = segments - 1; s >= 0; s--) {
+			suffixes[s] = sum;
+			if (known && isSegmentCold(line, s, isRow)
+					&& sameBits(starts[s], oldStarts[s])
+					&& sameBits(sum, oldSuffixes[s])) {
+				if (s > 0) {
+					sum = oldSuffixes[s - 1];
+				}
+				continue;
+			}
+			G n = readSegment(forward, line, s, isRow, forwardCells);
+			readSegment(backward, line, s, isRow, backwardCells);
+			readSegment(force, line, s, isRow, forceCells);
+			P prefix[tileSize];
+			prefix[0] = starts[s];
+			for (G i = 1; i < n; i++) {
+				prefix[i] = prefix[i - 1] + forwardCells[i - 1];
+			}
+			Tile &tile = tiles[getSegmentTile(line, s, isRow)];
+			G start = s * tileSize;
+			G local = isRow ? getLocalCell(start, line) : getLocalCell(line, start);
+			G stride = isRow ? 1 : tileSize;
+			for (G i = n - 1; i >= 0; i--) {
+				P value = prefix[i] + sum;
+				sum += backwardCells[i];
+				if (sameBits(value, forceCells[i])) {
+					continue;
+				}
+				if (tile.cells != nullptr) {
+					tile.cells[force * tileCells + local + i * stride] = value;
+					flags[s] = std::max(flags[s], (unsigned char) Changed);
+				} else {
+					flags[s] = Unpack;
+				}
+			}
+		}
+		std::copy(starts, starts + segments, &sums.starts[line * segments]);
+		std::copy(suffixes, suffixes + segments, &sums.suffixes[line * segments]);
+		sums.known[line] = 1;
+	}
+
+	/*
+	 * Copies the cells of segment s of a line out of one grid, returns how
+	 * many there are
+	 */
+	G readSegment(Grid grid, G line, G s, bool isRow, P *out) const {
+		const Tile &tile = tiles[getSegmentTile(line, s, isRow)];
+		G start = s * tileSize;
+		G n = std::min(tileSize, (isRow ? w : h) - start);
+		G local = isRow ? getLocalCell(start, line) : getLocalCell(line, start);
+		G stride = isRow ? 1 : tileSize;
+		if (tile.cells != nullptr) {
+			const P *cells = tile.cells + grid * tileCells + local;
+			for (G i = 0; i < n; i++) {
+				out[i] = cells[i * stride];
+			}
+		} else {
+			std::uint32_t bits[tileCells];
+			ChunkCodec::decode(tile.packed.data() + tile.offsets[grid], bits,
+					tileCells);
+			for (G i = 0; i < n; i++) {
+				out[i] = fromBits(bits[local + i * stride]);
+			}
+		}
+		return n;
+	}
+
+	bool isSegmentCold(G line, G s, bool isRow) const {
+		return tiles[getSegmentTile(line, s, isRow)].cells == nullptr;
+	}
+
+	// The tile holding segment s (cells s * tileSize onwards) of a line
+	G getSegmentTile(G line, G s, bool isRow) const {
+		return isRow ? (line / tileSize) * tilesX + s : s * tilesX + line / tileSize;
+	}
+
+	/*
+	 * Whether a row or column through the tile is waiting for rebuild(), its
+	 * sources then don't match the sums its lines remember
+	 */
+	bool hasDirtyLines(G index) const {
+		G startX = (index % tilesX) * tileSize, startY = (index / tilesX) * tileSize;
+		for (G y = startY; y < std::min(h, startY + tileSize); y++) {
+			if (rowDirty[y]) {
+				return true;
+			}
+		}
+		for (G x = startX; x < std::min(w, startX + tileSize); x++) {
+			if (columnDirty[x]) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool sameBits(P a, P b) {
+		return toBits(a) == toBits(b);
+	}
+
+	/*
+	 * Adds value to count cells, stride apart. Kept branch free inside the
+	 * loops so that the unit stride case vectorises, for float and Fixed alike.
+	 */
+	static void addRun(P *dst, G count, G stride, P value) {
+		if (stride == 1) {
+			for (G i = 0; i < count; i++) {
+				dst[i] += value;
+			}
+		} else {
+			for (G i = 0; i < count; i++) {
+				dst[i * stride] += value;
+			}
+		}
+	}
+
+	void unpack(G index) {
+		Tile &tile = tiles[index];
+		auto start = std::chrono::steady_clock::now();
+		tile.cells = takeCells();
+		std::uint32_t bits[tileCells];
+		for (int grid = 0; grid < NumGrids; grid++) {
+			ChunkCodec::decode(tile.packed.data() + tile.offsets[grid], bits,
+					tileCells);
+			P *cells = tile.cells + grid * tileCells;
+			for (G i = 0; i < tileCells; i++) {
+				cells[i] = fromBits(bits[i]);
+			}
+		}
+		coldTiles--;
+		packedBytes -= tile.packed.size();
+		// The buffer is kept for packing it again
+		tile.packed.clear();
+		decodes++;
+		decodeNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count();
+	}
+
+	void pack(G index) {
+		Tile &tile = tiles[index];
+		std::uint32_t bits[tileCells];
+		packScratch.clear();
+		for (int grid = 0; grid < NumGrids; grid++) {
+			const P *cells = tile.cells + grid * tileCells;
+			for (G i = 0; i < tileCells; i++) {
+				bits[i] = toBits(cells[i]);
+			}
+			tile.offsets[grid] = (std::uint32_t) packScratch.size();
+			ChunkCodec::encode(bits, tileCells, packScratch);
+		}
+		// Only as big as it has to be, unless it already had the room
+		tile.packed.assign(packScratch.begin(), packScratch.end());
+		releaseCells(tile.cells);
+		tile.cells = nullptr;
+		coldTiles++;
+		packedBytes += tile.packed.size();
+	}
+
+	P* takeCells() {
+		if (spareCells.empty()) {
+			return new P[NumGrids * tileCells];
+		}
+		P *cells = spareCells.back();
+		spareCells.pop_back();
+		return cells;
+	}
+
+	void releaseCells(P *cells) {
+		if (cells == nullptr) {
+			return;
+		}
+		if (spareCells.size() < maxSpareTiles) {
+			spareCells.push_back(cells);
+		} else {
+			delete[] cells;
+		}
+	}
+
+	static std::uint32_t toBits(P value) {
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static P fromBits(std::uint32_t bits) {
+		P value;
+		std::memcpy(static_cast<void*>(&value), &bits, sizeof(bits));
+		return value;
+	}
+
+	std::vector<Tile> tiles;
+	std::vector<P*> spareCells;
+	std::vector<std::uint8_t> zeroPacked, packScratch;
+	// Kept between rebuilds to save the allocation
+	std::vector<unsigned char> segmentFlags;
+	std::vector<P> segmentStarts, segmentSuffixes;
+	LineSums rowSums, columnSums;
+	std::array<std::uint32_t, NumGrids> zeroOffsets;
+	std::vector<unsigned char> rowDirty, columnDirty;
+	std::vector<G> dirtyRows, dirtyColumns;
 	G w, h;
 	G blockSize;
+	G tilesX, tilesY;
+	G coldTiles;
+	std::size_t packedBytes;
+	unsigned long long cellsTouched;
+	// Number of cool() calls so far, tiles remember the last one they were written in
+	unsigned long scan;
+	unsigned long long decodes, decodeNanos;
 };
 
 #endif /* INCLUDE_FORCETABLE_HPP_ */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * FrameScheduler.hpp
+ *
+ *  Created on: Oct 29, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_FRAMESCHEDULER_HPP_
+#define INCLUDE_FRAMESCHEDULER_HPP_
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <SFML/System/Clock.hpp>
+#include <Metrics.hpp>
+
+/**
+ * Runs background jobs (chunk generation, force rebuilds after bulk edits)
+ * on the main thread in whatever time a frame has left, so they never push
+ * a frame over its deadline.
+ *
+ * A job is a slice function that does a little of the work and returns
+ * whether there is more. Slices should take well under a millisecond: the
+ * budget is only checked between them. Jobs run highest priority first and
+ * take turns within a priority; a job whose slice returned false is asked
+ * again next frame.
+ *
+ * The budget is the time left until the target frame time, minus a reserve
+ * for presenting the frame, times a factor that halves whenever a frame
+ * ran late and creeps back up while frames are on time. Every frame gets at
+ * least minBudget, so the jobs can't starve on a machine that never makes
+ * its target.
+ */
+class FrameScheduler {
+public:
+	typedef std::function<bool()> Slice;
+
+	/*
+	 * targetSeconds = the frame time to stay under, e.g. 1 / 60
+	 */
+	FrameScheduler(float targetSeconds);
+
+	/*
+	 * Returns an id for remove(). Bigger priorities run first.
+	 */
+	int add(const std::string &name, int priority, const Slice &slice);
+	void remove(int id);
+
+	/*
+	 * Call at the start of every frame, before anything else
+	 */
+	void beginFrame();
+
+	/*
+	 * Runs slices until the frame's budget is used up or no job has work,
+	 * call once the frame is drawn and before it's presented. Returns the
+	 * number of slices run.
+	 */
+	unsigned int runBackground();
+
+	float getTargetSeconds() const {
+		return target;
+	}
+
+	// Budget of the last runBackground(), in seconds
+	float getLastBudget() const {
+		return lastBudget;
+	}
+
+	// Seconds of the last runBackground() spent in slices
+	float getLastUsed() const {
+		return lastUsed;
+	}
+
+	bool hasPendingWork() const;
+
+	// Kept back for presenting the frame (the swap and the driver)
+	static constexpr float presentReserve = 0.002f;
+	static constexpr float minBudget = 0.0005f;
+	// A frame this much over the target counts as late
+	static constexpr float lateFactor = 1.1f;
+
+private:
+	struct Job {
+		int id;
+		std::string name;
+		int priority;
+		Slice slice;
+		bool pending;
+		unsigned long lastRun;
+		Metrics::Counter *seconds;
+	};
+
+	std::vector<Job> jobs;
+	int nextId;
+	float target;
+	float scale;
+	float lastBudget, lastUsed;
+	unsigned long turn;
+	bool frameStarted;
+	sf::Clock frameClock;
+	Metrics::Gauge *budgetGauge;
+	Metrics::Counter *lateFrames;
+};
+
+#endif /* INCLUDE_FRAMESCHEDULER_HPP_ */
@@ -29,42 +29,122 @@
 #include <string>
 #include <thread>
 #include <random>
+#include <vector>
 
 #include "../include/SFML/Graphics.hpp"
-#include "../include/BlockManager.hpp"
+#include "../include/World.hpp"
+#include "../include/NetClient.hpp"
 #include "../include/TextureManager.hpp"
-
-typedef int gen;
-typedef float accur;
+#include "../include/ThreadPool.hpp"
+#include "../include/ChunkRenderer.hpp"
+#include "../include/OverviewRenderer.hpp"
+#include "../include/ParticleSystem.hpp"
+#include "../include/FixedTimestep.hpp"
+#include "../include/WorldHistory.hpp"
+#include "../include/SharedWorldView.hpp"
+#include "../include/MetricsExporter.hpp"
+#include "../include/FrameScheduler.hpp"
 
 class Game {
 public:
 	Game(std::string windowTitle, const Point<unsigned int> &dimensions);
-	Game(std::string windowTitle, unsigned int width, unsigned int height);
+	/*
+	 * worldSize, worldWidth, worldHeight = size of the world in pixels, the
+	 * window's size if 0
+	 */
+	Game(std::string windowTitle, const Point<unsigned int> &dimensions,
+			const Point<unsigned int> &worldSize);
+	Game(std::string windowTitle, unsigned int width, unsigned int height,
+			unsigned int worldWidth = 0, unsigned int worldHeight = 0);
+	/*
+	 * Client mode: shows the world hosted by the server at serverHost:serverPort
+	 * and sends edits there instead of simulating locally
+	 */
+	Game(std::string windowTitle, unsigned int width, unsigned int height,
+			const std::string &serverHost, unsigned short serverPort);
 	~Game();
 
 	void startGameLoop();
 
+	/*
+	 * Publishes the world in shared memory under name after every tick,
+	 * see SharedWorldView
+	 */
+	void shareWorld(const std::string &name);
+
+	/*
+	 * Serves the Metrics for Prometheus on localhost:port, see MetricsExporter
+	 */
+	void serveMetrics(unsigned short port);
+
 	void handleAllUserInteractions(sf::Event &event, sf::RenderWindow &window);
 	void handleMousePresses(sf::Event &event);
+	void handleMouseMoves(sf::Event &event);
 	void handleKeyPresses(sf::Event &event);
 
 	void drawAllBlocks(sf::RenderWindow &window);
 
-	// Calculations
-	void updateBlockForces();
-	void updateBlockVelocity();
-	void updateBlockPositions();
-	void enforceBoxBounds(); // only temporary, changes as the player moves
+	FixedTimestep& getTimestep() {
+		return timestep;
+	}
+
+	static constexpr unsigned int defaultTickRate = 60;
+	static constexpr unsigned int targetFrameRate = 60;
+	// Background work per slice, see FrameScheduler
+	static constexpr gen forceLinesPerSlice = 32;
+	static constexpr gen chunksPerSlice = 1;
+	// Edits touching more force table lines than this finish in the background
+	static constexpr gen deferredForceLines = 64;
+	static constexpr unsigned int maxSubsteps = 5;
+	// Edits that can be undone (Z)
+	static constexpr unsigned int undoDepth = 1000;
+	// Ticks kept for rewinding the simulation (R goes back a second)
+	static constexpr unsigned int rewindTicks = 10 * defaultTickRate;
+	// Middle mouse pours a square of material this many cells out from the cursor (M switches sand/water)
+	static constexpr gen pourRadius = 3;
+	// The mouse wheel zooms by this much a notch, and W A S D move by this much of the window
+	static constexpr float zoomStep = 1.25f;
+	static constexpr float panStep = 0.25f;
+	static constexpr float minZoom = 0.25f;
+	// Zoomed out so far that a block is less than this many pixels, the overview map is drawn instead
+	static constexpr float overviewBlockPixels = 4;
 
 protected:
 private:
-	BlockManager<accur, gen> *blockManager;
-	std::mt19937 randDevice;
+	void loadTextures();
+	void startEffects();
+	void startBackgroundJobs();
+	void paintTo(gen cellX, gen cellY);
+	void applyStroke();
+	void zoomAt(sf::RenderWindow &window, int pixelX, int pixelY, float delta);
+	void updateViewport();
+
+	World *world;
+	NetClient *client;
+	// Only when simulating locally, the server owns the history of a remote world
+	WorldHistory *undoHistory;
+	WorldHistory *rewindHistory;
 	TextureManager textureManager;
+	ThreadPool threadPool;
+	ChunkRenderer chunkRenderer;
+	ParticleSystem particles;
+	SharedWorldView *sharedView;
+	unsigned long tickCount, frameCount;
+	MetricsExporter *metricsExporter;
+	Metrics::Histogram *frameTime;
+	FrameScheduler background;
+	FixedTimestep timestep;
+	OverviewRenderer overview;
+	// What part of the world the window shows, zoom = world pixels per window pixel
+	sf::View camera;
+	float zoom;
 
-	accur defaultMu;
-	accur defaultBlockSize;
+	// Left mouse drags paint (or erase) every cell they cross, applied once per frame
+	std::vector<Point<gen>> strokeCells;
+	Point<gen> lastPaintCell;
+	int strokeKind;
+	bool painting;
+	MaterialGrid<gen>::Material pourMaterial;
 
 	sf::Time deltaTime;
 	std::string title;
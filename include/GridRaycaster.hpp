@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * GridRaycaster.hpp
+ *
+ *  Created on: Oct 18, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_GRIDRAYCASTER_HPP_
+#define INCLUDE_GRIDRAYCASTER_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <limits>
+
+#include <OccupancyMap.hpp>
+#include <Point.hpp>
+#include <ThreadPool.hpp>
+
+/**
+ * Ray and line of sight queries against the block grid.
+ *
+ * Rays walk the grid cell by cell (Amanatides & Woo DDA), but before looking
+ * at a cell they check the occupancy of its chunk and 8x8 tile, and jump
+ * straight out of the ones that are empty. A ray therefore costs about one
+ * step per occupied tile it crosses, not one per cell of its length.
+ *
+ * Rays are given in pixels; the ray math itself is done in double so it
+ * behaves the same for float and fixed point worlds.
+ */
+template<class P, class T>
+class GridRaycaster {
+public:
+	struct Ray {
+		P x, y; // origin
+		P dx, dy; // direction, any length
+		P maxDistance;
+	};
+
+	struct Hit {
+		bool hit;
+		T cellX, cellY; // cell that was hit
+		P distance; // from the origin to where the ray enters that cell
+		int normalX, normalY; // face of the cell the ray came through, (0, 0) if it started inside
+	};
+
+	GridRaycaster(const OccupancyMap<T> &occupancyMap, T bSize) :
+			occupancy(occupancyMap), blockSize(bSize) {
+	}
+
+	Hit cast(const Ray &ray) const {
+		return cast(ray.x, ray.y, ray.dx, ray.dy, ray.maxDistance);
+	}
+
+	/*
+	 * First block along the ray, up to maxDistance pixels away
+	 */
+	Hit cast(P x, P y, P dx, P dy, P maxDistance) const {
+		return march(x, y, dx, dy, maxDistance, false);
+	}
+
+	/*
+	 * Whether nothing stands between the two points (in pixels). The cells
+	 * holding the two end points don't count, so an enemy inside a block
+	 * can still see out of it.
+	 */
+	bool hasLineOfSight(P fromX, P fromY, P toX, P toY) const {
+		P dx = toX - fromX, dy = toY - fromY;
+		double length = std::sqrt((double) dx * (double) dx + (double) dy * (double) dy);
+		Hit hit = march(fromX, fromY, dx, dy, (P) length, true);
+		return !hit.hit
+				|| (hit.cellX == (T) (toX / blockSize)
+						&& hit.cellY == (T) (toY / blockSize));
+	}
+
+	/*
+	 * Casts every ray, spread across the pool. hits[i] is the answer to rays[i].
+	 */
+	void castAll(const std::vector<Ray> &rays, std::vector<Hit> &hits,
+			ThreadPool &pool) const {
+		hits.resize(rays.size());
+		pool.parallelFor<std::size_t>(0, rays.size(), 64,
+				[&](std::size_t begin, std::size_t end) {
+					for (std::size_t i = begin; i < end; i++) {
+						hits[i] = cast(rays[i]);
+					}
+				});
+	}
+
+private:
+	/*
+	 * The DDA walk behind cast(). skipStart ignores the block in the first cell.
+	 */
+	Hit march(P x, P y, P dx, P dy, P maxDistance, bool skipStart) const {
+		Hit result { false, 0, 0, 0, 0, 0 };
+		double length = std::sqrt((double) dx * (double) dx + (double) dy * (double) dy);
+		if (length == 0) {
+			return result;
+		}
+		// Everything below is in cells, with a unit direction so that t is a distance
+		double ox = (double) x / blockSize, oy = (double) y / blockSize;
+		double dirX = (double) dx / length, dirY = (double) dy / length;
+		double maxT = (double) maxDistance / blockSize;
+		double w = occupancy.getWidth(), h = occupancy.getHeight();
+
+		// Clip the ray to the grid
+		double tEnter = 0, tLeave = maxT;
+		if (!clipAxis(ox, dirX, w, tEnter, tLeave)
+				|| !clipAxis(oy, dirY, h, tEnter, tLeave)) {
+			return result;
+		}
+
+		Walk walk;
+		walk.stepX = dirX > 0 ? 1 : -1;
+		walk.stepY = dirY > 0 ? 1 : -1;
+		walk.t = tEnter;
+		walk.normalX = 0;
+		walk.normalY = 0;
+		if (tEnter > 0) {
+			// Entered through a face of the grid
+			double ex = ox + dirX * tEnter, ey = oy + dirY * tEnter;
+			walk.cellX = clampCell(std::floor(ex), occupancy.getWidth());
+			walk.cellY = clampCell(std::floor(ey), occupancy.getHeight());
+			if (ex <= 0 || ex >= w) {
+				walk.normalX = -walk.stepX;
+			} else {
+				walk.normalY = -walk.stepY;
+			}
+		} else {
+			walk.cellX = clampCell(std::floor(ox), occupancy.getWidth());
+			walk.cellY = clampCell(std::floor(oy), occupancy.getHeight());
+		}
+		resetBoundaries(walk, ox, oy, dirX, dirY);
+		T startX = tEnter > 0 ? -1 : walk.cellX, startY = walk.cellY;
+
+		const ChunkGrid<T> &grid = occupancy.getChunkGrid();
+		while (walk.t <= tLeave) {
+			if (occupancy.isChunkEmpty(walk.cellX, walk.cellY)) {
+				Point<T> chunk(walk.cellX / ChunkGrid<T>::chunkSize,
+						walk.cellY / ChunkGrid<T>::chunkSize);
+				Point<T> start = grid.getChunkStart(chunk.x, chunk.y);
+				Point<T> end = grid.getChunkEnd(chunk.x, chunk.y);
+				if (!leaveBox(walk, ox, oy, dirX, dirY, start.x, start.y, end.x,
+						end.y)) {
+					break;
+				}
+				continue;
+			}
+			if (occupancy.isTileEmpty(walk.cellX, walk.cellY)) {
+				T size = OccupancyMap<T>::tileSize;
+				T x0 = walk.cellX / size * size, y0 = walk.cellY / size * size;
+				T x1 = std::min(x0 + size, occupancy.getWidth());
+				T y1 = std::min(y0 + size, occupancy.getHeight());
+				if (!leaveBox(walk, ox, oy, dirX, dirY, x0, y0, x1, y1)) {
+					break;
+				}
+				continue;
+			}
+			if (occupancy.test(walk.cellX, walk.cellY)
+					&& !(skipStart && walk.cellX == startX && walk.cellY == startY)) {
+				result.hit = true;
+				result.cellX = walk.cellX;
+				result.cellY = walk.cellY;
+				result.distance = (P) (walk.t * blockSize);
+				result.normalX = walk.normalX;
+				result.normalY = walk.normalY;
+				return result;
+			}
+			// One cell along
+			if (walk.nextX < walk.nextY) {
+				walk.t = walk.nextX;
+				walk.cellX += walk.stepX;
+				walk.nextX += walk.deltaX;
+				walk.normalX = -walk.stepX;
+				walk.normalY = 0;
+			} else {
+				walk.t = walk.nextY;
+				walk.cellY += walk.stepY;
+				walk.nextY += walk.deltaY;
+				walk.normalX = 0;
+				walk.normalY = -walk.stepY;
+			}
+			if (walk.cellX < 0 || walk.cellY < 0 || walk.cellX >= occupancy.getWidth()
+					|| walk.cellY >= occupancy.getHeight()) {
+				break;
+			}
+		}
+		return result;
+	}
+
+private:
+	struct Walk {
+		T cellX, cellY;
+		int stepX, stepY;
+		double t; // distance travelled so far
+		double nextX, nextY; // distance at which the next x / y face is crossed
+		double deltaX, deltaY; // distance between two x / y faces
+		int normalX, normalY;
+	};
+
+	/*
+	 * Slab test for one axis, narrows [tEnter, tLeave] to the part inside [0, size)
+	 */
+	static bool clipAxis(double origin, double dir, double size,
+			double &tEnter, double &tLeave) {
+		if (dir == 0) {
+			return origin >= 0 && origin < size;
+		}
+		double t0 = (0 - origin) / dir, t1 = (size - origin) / dir;
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+		tEnter = std::max(tEnter, t0);
+		tLeave = std::min(tLeave, t1);
+		return tEnter <= tLeave;
+	}
+
+	static T clampCell(double cell, T size) {
+		if (cell < 0) {
+			return 0;
+		}
+		if (cell >= size) {
+			return size - 1;
+		}
+		return (T) cell;
+	}
+
+	/*
+	 * Recomputes the next face crossings from the origin, so that jumps
+	 * don't pile up rounding errors
+	 */
+	static void resetBoundaries(Walk &walk, double ox, double oy, double dirX,
+			double dirY) {
+		const double infinity = std::numeric_limits<double>::infinity();
+		walk.deltaX = dirX != 0 ? std::abs(1 / dirX) : infinity;
+		walk.deltaY = dirY != 0 ? std::abs(1 / dirY) : infinity;
+		walk.nextX = dirX != 0 ?
+				((walk.cellX + (walk.stepX > 0 ? 1 : 0)) - ox) / dirX : infinity;
+		walk.nextY = dirY != 0 ?
+				((walk.cellY + (walk.stepY > 0 ? 1 : 0)) - oy) / dirY : infinity;
+	}
+
+	/*
+	 * Moves the walk to the first cell past the box [x0, x1) x [y0, y1).
+	 * Returns false once that is outside the grid.
+	 */
+	bool leaveBox(Walk &walk, double ox, double oy, double dirX, double dirY,
+			T x0, T y0, T x1, T y1) const {
+		const double infinity = std::numeric_limits<double>::infinity();
+		double exitX = dirX != 0 ? ((walk.stepX > 0 ? x1 : x0) - ox) / dirX : infinity;
+		double exitY = dirY != 0 ? ((walk.stepY > 0 ? y1 : y0) - oy) / dirY : infinity;
+		if (exitX <= exitY) {
+			walk.t = exitX;
+			walk.cellX = walk.stepX > 0 ? x1 : x0 - 1;
+			walk.cellY = std::clamp((T) std::floor(oy + dirY * exitX), y0, y1 - 1);
+			walk.normalX = -walk.stepX;
+			walk.normalY = 0;
+		} else {
+			walk.t = exitY;
+			walk.cellY = walk.stepY > 0 ? y1 : y0 - 1;
+			walk.cellX = std::clamp((T) std::floor(ox + dirX * exitY), x0, x1 - 1);
+			walk.normalX = 0;
+			walk.normalY = -walk.stepY;
+		}
+		if (walk.cellX < 0 || walk.cellY < 0 || walk.cellX >= occupancy.getWidth()
+				|| walk.cellY >= occupancy.getHeight()) {
+			return false;
+		}
+		resetBoundaries(walk, ox, oy, dirX, dirY);
+		return true;
+	}
+
+	/*
+	 * Distance (in pixels) from (x, y) to where the ray leaves cell (cellX, cellY)
+	 */
+	P exitDistance(P x, P y, P dx, P dy, T cellX, T cellY, double length) const {
+		const double infinity = std::numeric_limits<double>::infinity();
+		double dirX = (double) dx / length, dirY = (double) dy / length;
+		double px = (double) x, py = (double) y;
+		double exitX = dirX > 0 ? ((cellX + 1) * blockSize - px) / dirX :
+						dirX < 0 ? (cellX * blockSize - px) / dirX : infinity;
+		double exitY = dirY > 0 ? ((cellY + 1) * blockSize - py) / dirY :
+						dirY < 0 ? (cellY * blockSize - py) / dirY : infinity;
+		// A little past the face, so the next cast starts in the next cell
+		return (P) (std::min(exitX, exitY) + 1e-3);
+	}
+
+	const OccupancyMap<T> &occupancy;
+	T blockSize;
+};
+
+#endif /* INCLUDE_GRIDRAYCASTER_HPP_ */
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * LightMap.hpp
+ *
+ *  Created on: Oct 23, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_LIGHTMAP_HPP_
+#define INCLUDE_LIGHTMAP_HPP_
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+
+#include <Chunk.hpp>
+#include <Point.hpp>
+#include <BitGrid.hpp>
+#include <OccupancyMap.hpp>
+#include <ThreadPool.hpp>
+
+/**
+ * Light level (0 - maxLight) of every cell, kept next to each chunk as one
+ * byte per cell: sky light in the high nibble, block light in the low one.
+ *
+ * Sky light is maxLight in every open cell with nothing solid above it.
+ * Block light comes from magnets (magnetLight). Both lose one level per step
+ * into the cells around, through open cells only; a solid cell is lit by
+ * its brightest neighbour but passes nothing on, unless it is the magnet
+ * giving off the light.
+ *
+ * Changes are incremental breadth first floods. A cell that changed first
+ * takes back (un-spreads) all the light that could have come through it,
+ * then the cells left lit around that area and any sources in it spread
+ * again. Light never gets further than maxLight cells, which is less than
+ * a chunk, so the work for one chunk only touches the chunks right next to
+ * it: chunks three apart in both directions are done side by side, in nine
+ * rounds.
+ */
+template<class T>
+class LightMap {
+public:
+	static constexpr std::uint8_t maxLight = 15;
+	static constexpr std::uint8_t magnetLight = 12;
+	static constexpr int sky = 0, block = 1;
+	// More changed cells than 1 / fullRebuildRatio of the grid are cheaper to redo from scratch
+	static constexpr T fullRebuildRatio = 8;
+
+	LightMap(const ChunkGrid<T> &chunkGrid) :
+			grid(chunkGrid), w(chunkGrid.getWidth()), h(chunkGrid.getHeight()), changedBits(
+					w, h), needsRebuild(false) {
+		// An empty world is all sky
+		LightChunk empty;
+		empty.fill(maxLight << 4);
+		chunks.assign(grid.getChunkCount(), empty);
+		revisions.assign(grid.getChunkCount(), 0);
+		skyDepth.assign(w, h);
+		removals.resize(grid.getChunkCount());
+		seeds.resize(grid.getChunkCount());
+	}
+
+	/*
+	 * Cell (x, y) turned solid or open, or became or stopped being a magnet
+	 */
+	void markChanged(T cellX, T cellY) {
+		if (cellX >= 0 && cellY >= 0 && cellX < w && cellY < h
+				&& !changedBits.test(cellX, cellY)) {
+			changedBits.set(cellX, cellY, true);
+			changed.emplace_back(cellX, cellY);
+		}
+	}
+
+	/*
+	 * Everything changed, the next update() starts over
+	 */
+	void markAllChanged() {
+		needsRebuild = true;
+	}
+
+	/*
+	 * Catches up with the cells marked since the last call
+	 */
+	void update(const OccupancyMap<T> &occupancy, ThreadPool &pool) {
+		if (!needsRebuild && changed.size() > (std::size_t) (w * h / fullRebuildRatio)) {
+			needsRebuild = true;
+		}
+		for (const Point<T> &cell : changed) {
+			changedBits.set(cell.x, cell.y, false);
+		}
+		if (needsRebuild) {
+			changed.clear();
+			rebuild(occupancy, pool);
+			return;
+		}
+		if (changed.empty()) {
+			return;
+		}
+
+		// Columns whose first solid cell moved gain or lose sky from the old to the new depth
+		for (const Point<T> &cell : changed) {
+			addRemoval(cell.x, cell.y, sky);
+			addRemoval(cell.x, cell.y, block);
+			T depth = skyDepth[cell.x];
+			if (cell.y > depth) {
+				continue;
+			}
+			T newDepth = cell.y;
+			const BitGrid<T> &occupied = occupancy.getOccupied();
+			if (!occupied.test(cell.x, cell.y)) {
+				for (newDepth = 0; newDepth < h && !occupied.test(cell.x, newDepth);
+						newDepth++) {
+				}
+			}
+			for (T y = std::min(depth, newDepth); y < std::max(depth, newDepth);
+					y++) {
+				addRemoval(cell.x, y, sky);
+			}
+			skyDepth[cell.x] = newDepth;
+		}
+		changed.clear();
+
+		inRounds(removals, pool, [&](T chunk) {
+			unspread(chunk, occupancy);
+		});
+		inRounds(seeds, pool, [&](T chunk) {
+			spread(chunk, occupancy);
+		});
+	}
+
+	/*
+	 * Brightest of the sky and block light of a cell
+	 */
+	std::uint8_t getLevel(T cellX, T cellY) const {
+		std::uint8_t value = chunks[grid.getChunkIndex(cellX, cellY)][getLocalCell(
+				cellX, cellY)];
+		return std::max(value >> 4, value & 15);
+	}
+
+	std::uint8_t getLevel(T cellX, T cellY, int channel) const {
+		return get(cellY * w + cellX, channel);
+	}
+
+	/*
+	 * Goes up whenever a light level in the chunk changes
+	 */
+	unsigned long getChunkRevision(T chunkIndex) const {
+		return revisions[chunkIndex];
+	}
+
+	/*
+	 * Recomputes everything from the sources
+	 */
+	void rebuild(const OccupancyMap<T> &occupancy, ThreadPool &pool) {
+		const BitGrid<T> &occupied = occupancy.getOccupied();
+		for (T x = 0; x < w; x++) {
+			T depth = 0;
+			while (depth < h && !occupied.test(x, depth)) {
+				depth++;
+			}
+			skyDepth[x] = depth;
+		}
+		for (T i = 0; i < grid.getChunkCount(); i++) {
+			chunks[i].fill(0);
+			revisions[i]++;
+			removals[i].clear();
+			seeds[i].clear();
+		}
+		for (T x = 0; x < w; x++) {
+			for (T y = 0; y < skyDepth[x]; y++) {
+				addSeed(y * w + x, sky);
+			}
+		}
+		occupancy.getMagnetic().forEach([this](T x, T y) {
+			addSeed(y * w + x, block);
+		});
+		inRounds(seeds, pool, [&](T chunk) {
+			spread(chunk, occupancy);
+		});
+		needsRebuild = false;
+	}
+
+private:
+	typedef std::array<std::uint8_t, ChunkGrid<T>::chunkSize * ChunkGrid<T>::chunkSize> LightChunk;
+
+	struct Node {
+		T cell;
+		std::uint8_t level;
+		std::uint8_t channel;
+	};
+
+	static unsigned int getLocalCell(T cellX, T cellY) {
+		return (cellY % ChunkGrid<T>::chunkSize) * ChunkGrid<T>::chunkSize
+				+ cellX % ChunkGrid<T>::chunkSize;
+	}
+
+	T getChunkOf(T cell) const {
+		return grid.getChunkIndex(cell % w, cell / w);
+	}
+
+	std::uint8_t get(T cell, int channel) const {
+		std::uint8_t value = chunks[getChunkOf(cell)][getLocalCell(cell % w,
+				cell / w)];
+		return channel == sky ? value >> 4 : value & 15;
+	}
+
+	void set(T cell, int channel, std::uint8_t level) {
+		T chunk = getChunkOf(cell);
+		std::uint8_t &value = chunks[chunk][getLocalCell(cell % w, cell / w)];
+		std::uint8_t updated =
+				channel == sky ? (value & 15) | (level << 4) : (value & 0xF0) | level;
+		if (updated != value) {
+			value = updated;
+			revisions[chunk]++;
+		}
+	}
+
+	/*
+	 * What a cell gives off by itself, in the current world
+	 */
+	std::uint8_t getEmitted(T cell, int channel,
+			const OccupancyMap<T> &occupancy) const {
+		T x = cell % w, y = cell / w;
+		if (channel == sky) {
+			return y < skyDepth[x] ? maxLight : 0;
+		}
+		return occupancy.testMagnetic(x, y) ? magnetLight : 0;
+	}
+
+	/*
+	 * Whether light goes on from the cell to the cells around
+	 */
+	bool passes(T cell, int channel, const OccupancyMap<T> &occupancy) const {
+		T x = cell % w, y = cell / w;
+		return !occupancy.test(x, y)
+				|| (channel == block && occupancy.testMagnetic(x, y));
+	}
+
+	template<class F>
+	void forEachNeighbour(T i, F visit) const {
+		T x = i % w, y = i / w;
+		if (x > 0) {
+			visit(i - 1);
+		}
+		if (x < w - 1) {
+			visit(i + 1);
+		}
+		if (y > 0) {
+			visit(i - w);
+		}
+		if (y < h - 1) {
+			visit(i + w);
+		}
+	}
+
+	void addRemoval(T x, T y, int channel) {
+		T cell = y * w + x;
+		removals[grid.getChunkIndex(x, y)].push_back(Node { cell, 0,
+				(std::uint8_t) channel });
+	}
+
+	void addSeed(T cell, int channel) {
+		seeds[getChunkOf(cell)].push_back(Node { cell, 0, (std::uint8_t) channel });
+	}
+
+	/*
+	 * Runs work(chunk) for every chunk with something in lists, chunks three
+	 * apart at the same time
+	 */
+	template<class F>
+	void inRounds(std::vector<std::vector<Node>> &lists, ThreadPool &pool,
+			F work) {
+		for (T round = 0; round < 9; round++) {
+			roundChunks.clear();
+			for (T i = 0; i < grid.getChunkCount(); i++) {
+				Point<T> coord = grid.getChunkCoord(i);
+				if (!lists[i].empty() && coord.x % 3 + coord.y % 3 * 3 == round) {
+					roundChunks.push_back(i);
+				}
+			}
+			pool.run(roundChunks.size(), [&](std::size_t k) {
+				work(roundChunks[k]);
+			});
+		}
+	}
+
+	/*
+	 * Takes back the light that could have come through the changed cells
+	 * of a chunk. Cells left lit at the edge of that area, the sources in
+	 * it and the cells right around a change become seeds for spread().
+	 */
+	void unspread(T chunk, const OccupancyMap<T> &occupancy) {
+		// One per pool thread, so it keeps its capacity from one update to the next
+		static thread_local std::vector<Node> queue;
+		queue.clear();
+		for (const Node &origin : removals[chunk]) {
+			queue.push_back(Node { origin.cell, get(origin.cell, origin.channel),
+					origin.channel });
+			set(origin.cell, origin.channel, 0);
+			addSeed(origin.cell, origin.channel);
+			forEachNeighbour(origin.cell, [&](T n) {
+				addSeed(n, origin.channel);
+			});
+		}
+		removals[chunk].clear();
+		for (std::size_t k = 0; k < queue.size(); k++) {
+			Node node = queue[k];
+			forEachNeighbour(node.cell, [&](T n) {
+				std::uint8_t level = get(n, node.channel);
+				if (level == 0) {
+					return;
+				}
+				if (level < node.level) {
+					set(n, node.channel, 0);
+					queue.push_back(Node { n, level, node.channel });
+					if (getEmitted(n, node.channel, occupancy) > 0) {
+						addSeed(n, node.channel);
+					}
+				} else {
+					addSeed(n, node.channel);
+				}
+			});
+		}
+	}
+
+	/*
+	 * Spreads the light of a chunk's seeds outwards
+	 */
+	void spread(T chunk, const OccupancyMap<T> &occupancy) {
+		static thread_local std::vector<Node> queue;
+		queue.clear();
+		for (const Node &seed : seeds[chunk]) {
+			std::uint8_t level = std::max(get(seed.cell, seed.channel),
+					getEmitted(seed.cell, seed.channel, occupancy));
+			if (level > 0) {
+				set(seed.cell, seed.channel, level);
+				queue.push_back(Node { seed.cell, level, seed.channel });
+			}
+		}
+		seeds[chunk].clear();
+		for (std::size_t k = 0; k < queue.size(); k++) {
+			Node node = queue[k];
+			if (node.level <= 1 || get(node.cell, node.channel) != node.level
+					|| !passes(node.cell, node.channel, occupancy)) {
+				continue;
+			}
+			forEachNeighbour(node.cell, [&](T n) {
+				if (node.level - 1 > get(n, node.channel)) {
+					set(n, node.channel, node.level - 1);
+					queue.push_back(Node { n, (std::uint8_t) (node.level - 1),
+							node.channel });
+				}
+			});
+		}
+	}
+
+	const ChunkGrid<T> &grid;
+	T w, h;
+
+	std::vector<LightChunk> chunks;
+	std::vector<unsigned long> revisions;
+	// First solid cell of every column (h if there is none)
+	std::vector<T> skyDepth;
+
+	BitGrid<T> changedBits;
+	std::vector<Point<T>> changed;
+	bool needsRebuild;
+
+	// Per chunk work for the next round, kept between updates to save the allocations
+	std::vector<std::vector<Node>> removals;
+	std::vector<std::vector<Node>> seeds;
+	std::vector<T> roundChunks;
+};
+
+#endif /* INCLUDE_LIGHTMAP_HPP_ */
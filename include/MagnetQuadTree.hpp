@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * MagnetQuadTree.hpp
+ *
+ *  Created on: Oct 10, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_MAGNETQUADTREE_HPP_
+#define INCLUDE_MAGNETQUADTREE_HPP_
+
+#include <vector>
+#include <algorithm>
+
+#include <Point.hpp>
+#include <ThreadPool.hpp>
+#include <BitGrid.hpp>
+#include <TMath.hpp>
+
+/**
+ * Barnes-Hut tree over the magnetic blocks of the block grid, used for
+ * magnet-to-magnet forces at a distance.
+ *
+ * The tree is a region quadtree laid over the block grid: level 0 splits the
+ * grid into leafSize x leafSize buckets of cells and every level above merges
+ * 2x2 nodes of the one below, up to a single root. Each node keeps the summed
+ * magnetic moment of the magnets inside it and their moment-weighted centre,
+ * added up in tma::Accumulator<P> so that a node over many magnets can't run
+ * out of range (Fixed would overflow at a few thousand of them). Distances
+ * and forces are worked out in it too, and only the final force goes back to P.
+ * Since a cell always maps to the same path of nodes, a magnet that moves by a
+ * cell can be taken out of one path and put into another without a rebuild.
+ *
+ * All distances are measured in cells.
+ */
+template<class P, class T>
+class MagnetQuadTree {
+public:
+	typedef typename tma::Accumulator<P>::type Sum;
+
+	struct Node {
+		Sum mx, my; // summed magnetic moment
+		Sum wx, wy; // moment-weighted position sum
+		Sum weight; // sum of |moment|
+		T count;
+	};
+
+	/*
+	 * width, height = size of the block grid in cells
+	 * openingAngle = Barnes-Hut theta; 0 is exact, bigger is faster and rougher
+	 */
+	MagnetQuadTree(T width, T height, P openingAngle) :
+			w(width), h(height), theta(openingAngle) {
+		softening = (P) 1 / 4;
+		T levelW = (width + leafSize - 1) / leafSize;
+		T levelH = (height + leafSize - 1) / leafSize;
+		while (true) {
+			levelWidths.push_back(levelW);
+			levelHeights.push_back(levelH);
+			levels.push_back(std::vector<Node>(levelW * levelH));
+			if (levelW <= 1 && levelH <= 1) {
+				break;
+			}
+			levelW = (levelW + 1) / 2;
+			levelH = (levelH + 1) / 2;
+		}
+	}
+
+	/*
+	 * Rebuilds every node from scratch. Each level is filled in parallel, one
+	 * row of nodes per task, and only depends on the level below it.
+	 * magnets = the magnetic cells, momentAt(x, y) = the moment of one of them
+	 */
+	template<class M>
+	void rebuild(const BitGrid<T> &magnets, M momentAt, ThreadPool &pool) {
+		pool.parallelFor<T>(0, levelHeights[0], 1, [&](T begin, T end) {
+			for (T ny = begin; ny < end; ny++) {
+				for (T nx = 0; nx < levelWidths[0]; nx++) {
+					Node node = emptyNode();
+					T endX = std::min((nx + 1) * leafSize, w);
+					T endY = std::min((ny + 1) * leafSize, h);
+					magnets.forEachInRect(nx * leafSize, ny * leafSize, endX, endY,
+							[&](T x, T y) {
+								addToNode(node, x, y, momentAt(x, y));
+							});
+					levels[0][ny * levelWidths[0] + nx] = node;
+				}
+			}
+		});
+
+		for (std::size_t level = 1; level < levels.size(); level++) {
+			pool.parallelFor<T>(0, levelHeights[level], 1, [&](T begin, T end) {
+				for (T ny = begin; ny < end; ny++) {
+					for (T nx = 0; nx < levelWidths[level]; nx++) {
+						Node node = emptyNode();
+						for (T child = 0; child < 4; child++) {
+							T cx = nx * 2 + (child & 1);
+							T cy = ny * 2 + (child >> 1);
+							if (cx < levelWidths[level - 1]
+									&& cy < levelHeights[level - 1]) {
+								mergeNode(node,
+										levels[level - 1][cy
+												* levelWidths[level - 1] + cx]);
+							}
+						}
+						levels[level][ny * levelWidths[level] + nx] = node;
+					}
+				}
+			});
+		}
+	}
+
+	void addMagnet(T cellX, T cellY, const Point<P> &moment) {
+		updatePath(cellX, cellY, moment, 1);
+	}
+
+	void removeMagnet(T cellX, T cellY, const Point<P> &moment) {
+		updatePath(cellX, cellY, moment, -1);
+	}
+
+	/*
+	 * Incremental update for a magnet that moved to a neighbouring cell.
+	 * Returns false (and changes nothing) for longer moves, which need a rebuild.
+	 */
+	bool moveMagnet(T fromX, T fromY, T toX, T toY, const Point<P> &moment) {
+		if (tma::abs(toX - fromX) > 1 || tma::abs(toY - fromY) > 1) {
+			return false;
+		}
+		removeMagnet(fromX, fromY, moment);
+		addMagnet(toX, toY, moment);
+		return true;
+	}
+
+	/*
+	 * Force on a magnet with the given moment sitting in (cellX, cellY) from
+	 * every other magnet in the tree.
+	 * Pairs attract when their moments line up and repel when they oppose,
+	 * falling off with the square of the distance.
+	 * magnets and momentAt are the same as for rebuild().
+	 */
+	template<class M>
+	Point<P> getForce(const BitGrid<T> &magnets, M momentAt, T cellX, T cellY,
+			const Point<P> &moment, P strength) const {
+		Point<P> force;
+		Point<Sum> total(Sum(0), Sum(0));
+		if (cellX < 0 || cellY < 0 || cellX >= w || cellY >= h
+				|| (moment.x == (P) 0 && moment.y == (P) 0)) {
+			return force;
+		}
+		P tx = (P) cellX + (P) 1 / 2;
+		P ty = (P) cellY + (P) 1 / 2;
+
+		struct Entry {
+			T level, nx, ny;
+		};
+		// Depth first, so at most three siblings wait per level (plus the four just pushed)
+		Entry stack[3 * maxLevels + 4];
+		int top = 0;
+		stack[top++] = { (T) levels.size() - 1, 0, 0 };
+		while (top > 0) {
+			Entry e = stack[--top];
+			const Node &node = levels[e.level][e.ny * levelWidths[e.level] + e.nx];
+			if (node.count == 0) {
+				continue;
+			}
+			T extent = leafSize << e.level;
+			bool containsTarget = cellX >= e.nx * extent
+					&& cellX < (e.nx + 1) * extent && cellY >= e.ny * extent
+					&& cellY < (e.ny + 1) * extent;
+			if (!containsTarget && node.weight > Sum(0)) {
+				P cx = (P) (node.wx / node.weight);
+				P cy = (P) (node.wy / node.weight);
+				P dx = cx - tx, dy = cy - ty;
+				Sum size((P) extent);
+				// Far enough away to be treated as a single magnet
+				if (size * size < Sum(theta * theta) * getDistance2(dx, dy)) {
+					addPairForce(total, dx, dy, moment, node.mx, node.my,
+							strength);
+					continue;
+				}
+			}
+			if (e.level == 0) {
+				T endX = std::min((e.nx + 1) * leafSize, w);
+				T endY = std::min((e.ny + 1) * leafSize, h);
+				magnets.forEachInRect(e.nx * leafSize, e.ny * leafSize, endX, endY,
+						[&](T x, T y) {
+							if (x == cellX && y == cellY) {
+								return;
+							}
+							Point<P> m = momentAt(x, y);
+							addPairForce(total, (P) x + (P) 1 / 2 - tx,
+									(P) y + (P) 1 / 2 - ty, moment, Sum(m.x),
+									Sum(m.y), strength);
+						});
+			} else {
+				for (T child = 0; child < 4; child++) {
+					T cx = e.nx * 2 + (child & 1);
+					T cy = e.ny * 2 + (child >> 1);
+					if (cx < levelWidths[e.level - 1]
+							&& cy < levelHeights[e.level - 1]) {
+						stack[top++] = { e.level - 1, cx, cy };
+					}
+				}
+			}
+		}
+		force.x = (P) total.x;
+		force.y = (P) total.y;
+		return force;
+	}
+
+	const Node& getRoot() const {
+		return levels.back()[0];
+	}
+
+	P getOpeningAngle() const {
+		return theta;
+	}
+
+	void setOpeningAngle(P openingAngle) {
+		this->theta = openingAngle;
+	}
+
+	P getSoftening() const {
+		return softening;
+	}
+
+	void setSoftening(P softening) {
+		this->softening = softening;
+	}
+
+	static constexpr T leafSize = 4;
+	// Each level halves the grid, 32 of them cover anything an int can index
+	static constexpr int maxLevels = 32;
+
+private:
+	static Node emptyNode() {
+		return Node { Sum(0), Sum(0), Sum(0), Sum(0), Sum(0), 0 };
+	}
+
+	static void addToNode(Node &node, T x, T y, const Point<P> &moment) {
+		Sum weight(tma::abs(moment.x) + tma::abs(moment.y));
+		node.mx += Sum(moment.x);
+		node.my += Sum(moment.y);
+		node.wx += weight * Sum((P) x + (P) 1 / 2);
+		node.wy += weight * Sum((P) y + (P) 1 / 2);
+		node.weight += weight;
+		node.count++;
+	}
+
+	static void mergeNode(Node &node, const Node &child) {
+		node.mx += child.mx;
+		node.my += child.my;
+		node.wx += child.wx;
+		node.wy += child.wy;
+		node.weight += child.weight;
+		node.count += child.count;
+	}
+
+	void updatePath(T cellX, T cellY, const Point<P> &moment, T sign) {
+		if (cellX < 0 || cellY < 0 || cellX >= w || cellY >= h) {
+			return;
+		}
+		Sum weight((tma::abs(moment.x) + tma::abs(moment.y)) * (P) sign);
+		Sum px((P) cellX + (P) 1 / 2);
+		Sum py((P) cellY + (P) 1 / 2);
+		T nx = cellX / leafSize;
+		T ny = cellY / leafSize;
+		for (std::size_t level = 0; level < levels.size(); level++) {
+			Node &node = levels[level][ny * levelWidths[level] + nx];
+			node.mx += Sum(moment.x * (P) sign);
+			node.my += Sum(moment.y * (P) sign);
+			node.wx += weight * px;
+			node.wy += weight * py;
+			node.weight += weight;
+			node.count += sign;
+			nx /= 2;
+			ny /= 2;
+		}
+	}
+
+	/*
+	 * Squared distances (and summed moments) leave Fixed's range about 128
+	 * cells out, so they stay in Sum
+	 */
+	static Sum getDistance2(P dx, P dy) {
+		return Sum(dx) * Sum(dx) + Sum(dy) * Sum(dy);
+	}
+
+	/*
+	 * Adds the force from a source (dx, dy) away with the moment (smx, smy).
+	 * getForce() only brings the total back to P.
+	 */
+	void addPairForce(Point<Sum> &force, P dx, P dy, const Point<P> &moment,
+			Sum smx, Sum smy, P strength) const {
+		Sum r2 = getDistance2(dx, dy) + Sum(softening);
+		Sum r = tma::sqrt(r2);
+		Sum pull = Sum(strength)
+				* (Sum(moment.x) * smx + Sum(moment.y) * smy);
+		force.x += pull * Sum(dx) / r2 / r;
+		force.y += pull * Sum(dy) / r2 / r;
+	}
+
+	std::vector<std::vector<Node>> levels;
+	std::vector<T> levelWidths, levelHeights;
+	T w, h;
+	P theta;
+	P softening;
+};
+
+#endif /* INCLUDE_MAGNETQUADTREE_HPP_ */
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * MaterialGrid.hpp
+ *
+ *  Created on: Oct 24, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_MATERIALGRID_HPP_
+#define INCLUDE_MATERIALGRID_HPP_
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+#include <Chunk.hpp>
+#include <OccupancyMap.hpp>
+#include <ThreadPool.hpp>
+
+/**
+ * Falling and flowing materials (sand, water), one per cell, moved by a
+ * cellular automaton on the Margolus neighbourhood: every tick the grid is
+ * cut into 2x2 squares, shifted by one cell on every other tick, and each
+ * square only rearranges its own four cells. No two squares share a cell,
+ * so they all update side by side without locks and no cell is moved twice
+ * in a tick, whatever order they run in.
+ *
+ * Blocks are walls to the materials. Cells that hold a block and a
+ * material at once (a block was put on top of it) keep the material
+ * hidden until the block goes away.
+ *
+ * Every chunk remembers the area that moved in the last two ticks (or was
+ * woken up from outside), and only the squares around it are looked at, so
+ * settled sand costs nothing.
+ */
+template<class T>
+class MaterialGrid {
+public:
+	// Heavier materials sink through lighter ones, in this order
+	enum Material {
+		Empty, Water, Sand, NumMaterials
+	};
+
+	MaterialGrid(const ChunkGrid<T> &chunkGrid) :
+			grid(chunkGrid), w(chunkGrid.getWidth()), h(chunkGrid.getHeight()), cells(
+					w * h, Empty), tick(0), scannedCells(0) {
+		recent[0].resize(grid.getChunkCount());
+		recent[1].resize(grid.getChunkCount());
+		active.resize(grid.getChunkCount());
+		revisions.assign(grid.getChunkCount(), 0);
+	}
+
+	Material get(T cellX, T cellY) const {
+		return (Material) cells[cellY * w + cellX];
+	}
+
+	/*
+	 * Puts material in a cell (Empty clears it), regardless of what was there
+	 */
+	void set(T cellX, T cellY, Material material) {
+		cells[cellY * w + cellX] = (std::uint8_t) material;
+		revisions[grid.getChunkIndex(cellX, cellY)]++;
+		wake(cellX, cellY);
+	}
+
+	/*
+	 * Something next to the cell changed (a block came or went), so the
+	 * material around it gets looked at again
+	 */
+	void wake(T cellX, T cellY) {
+		recent[(tick + 1) % 2][grid.getChunkIndex(cellX, cellY)].add(cellX,
+				cellY, cellX + 1, cellY + 1);
+	}
+
+	/*
+	 * Moves every material that can move by one step
+	 */
+	void step(const OccupancyMap<T> &occupancy, ThreadPool &pool) {
+		T offset = (T) (tick % 2);
+		std::vector<Rect> &moved = recent[tick % 2];
+		std::vector<Rect> &movedBefore = recent[(tick + 1) % 2];
+
+		activeChunks.clear();
+		for (T i = 0; i < grid.getChunkCount(); i++) {
+			activate(moved[i]);
+			activate(movedBefore[i]);
+			moved[i] = Rect();
+		}
+		scannedCells = 0;
+		for (T chunk : activeChunks) {
+			scannedCells += (active[chunk].x1 - active[chunk].x0)
+					* (active[chunk].y1 - active[chunk].y0);
+		}
+
+		// Each chunk runs the squares starting in it, and only writes down what moved in its own slot
+		pool.run(activeChunks.size(), [&](std::size_t k) {
+			T chunk = activeChunks[k];
+			const Rect &area = active[chunk];
+			T firstX = area.x0 + (area.x0 % 2 != offset);
+			T firstY = area.y0 + (area.y0 % 2 != offset);
+			for (T y = firstY; y < area.y1; y += 2) {
+				for (T x = firstX; x < area.x1; x += 2) {
+					if (updateSquare(x, y, occupancy)) {
+						moved[chunk].add(x, y, x + 2, y + 2);
+					}
+				}
+			}
+		});
+
+		for (T chunk : activeChunks) {
+			bumpRevisions(moved[chunk]);
+			active[chunk] = Rect();
+		}
+		tick++;
+	}
+
+	/*
+	 * Goes up whenever a cell of the chunk changes
+	 */
+	unsigned long getChunkRevision(T chunkIndex) const {
+		return revisions[chunkIndex];
+	}
+
+	// Statistics of the last step()
+	T getActiveChunks() const {
+		return (T) activeChunks.size();
+	}
+
+	T getScannedCells() const {
+		return scannedCells;
+	}
+
+private:
+	/*
+	 * Cells [x0, x1) x [y0, y1), empty when nothing was added
+	 */
+	struct Rect {
+		T x0 = std::numeric_limits<T>::max(), y0 = std::numeric_limits<T>::max();
+		T x1 = std::numeric_limits<T>::min(), y1 = std::numeric_limits<T>::min();
+
+		bool isEmpty() const {
+			return x0 >= x1 || y0 >= y1;
+		}
+
+		void add(T left, T top, T right, T bottom) {
+			x0 = std::min(x0, left);
+			y0 = std::min(y0, top);
+			x1 = std::max(x1, right);
+			y1 = std::max(y1, bottom);
+		}
+	};
+
+	// Stands for a cell that nothing can move into or out of
+	static constexpr std::uint8_t wall = NumMaterials;
+
+	/*
+	 * Hands the squares around a changed area out to the chunks they start
+	 * in. Squares starting a cell up or left still overlap the area, and
+	 * a cell next to it can now move too.
+	 */
+	void activate(const Rect &area) {
+		if (area.isEmpty()) {
+			return;
+		}
+		T x0 = std::max(area.x0 - 2, (T) 0), y0 = std::max(area.y0 - 2, (T) 0);
+		T x1 = std::min(area.x1 + 1, w), y1 = std::min(area.y1 + 1, h);
+		for (T chunkY = y0 / ChunkGrid<T>::chunkSize;
+				chunkY <= (y1 - 1) / ChunkGrid<T>::chunkSize; chunkY++) {
+			for (T chunkX = x0 / ChunkGrid<T>::chunkSize;
+					chunkX <= (x1 - 1) / ChunkGrid<T>::chunkSize; chunkX++) {
+				Point<T> start = grid.getChunkStart(chunkX, chunkY);
+				Point<T> end = grid.getChunkEnd(chunkX, chunkY);
+				T chunk = grid.getChunkIndexOf(chunkX, chunkY);
+				if (active[chunk].isEmpty()) {
+					activeChunks.push_back(chunk);
+				}
+				active[chunk].add(std::max(x0, start.x), std::max(y0, start.y),
+						std::min(x1, end.x), std::min(y1, end.y));
+			}
+		}
+	}
+
+	void bumpRevisions(const Rect &area) {
+		if (area.isEmpty()) {
+			return;
+		}
+		T x1 = std::min(area.x1, w), y1 = std::min(area.y1, h);
+		for (T chunkY = area.y0 / ChunkGrid<T>::chunkSize;
+				chunkY <= (y1 - 1) / ChunkGrid<T>::chunkSize; chunkY++) {
+			for (T chunkX = area.x0 / ChunkGrid<T>::chunkSize;
+					chunkX <= (x1 - 1) / ChunkGrid<T>::chunkSize; chunkX++) {
+				revisions[grid.getChunkIndexOf(chunkX, chunkY)]++;
+			}
+		}
+	}
+
+	static int getDensity(std::uint8_t cell) {
+		return cell;
+	}
+
+	/*
+	 * Whether from can swap places with to, i.e. sinks into it
+	 */
+	static bool sinksInto(std::uint8_t from, std::uint8_t to) {
+		return from != wall && to != wall && getDensity(from) > getDensity(to);
+	}
+
+	std::uint8_t load(T x, T y, const OccupancyMap<T> &occupancy) const {
+		if (x >= w || y >= h || occupancy.test(x, y)) {
+			return wall;
+		}
+		return cells[y * w + x];
+	}
+
+	/*
+	 * Same pseudo random bits for the same square and tick on every machine
+	 */
+	std::uint32_t getNoise(T x, T y) const {
+		std::uint32_t bits = (std::uint32_t) x * 0x9E3779B1u
+				^ (std::uint32_t) y * 0x85EBCA77u
+				^ (std::uint32_t) tick * 0xC2B2AE3Du;
+		bits ^= bits >> 15;
+		bits *= 0x2C1B3C6Du;
+		return bits ^ (bits >> 12);
+	}
+
+	/*
+	 * The square with (x, y) as its top left cell:
+	 *   a b
+	 *   c d
+	 * with down being +y. Materials fall, then slide down diagonally if
+	 * the way is clear, and water that can do neither flows sideways
+	 * (half the time). Returns whether anything moved or could have.
+	 */
+	bool updateSquare(T x, T y, const OccupancyMap<T> &occupancy) {
+		std::uint8_t a = load(x, y, occupancy), b = load(x + 1, y, occupancy);
+		std::uint8_t c = load(x, y + 1, occupancy), d = load(x + 1, y + 1,
+				occupancy);
+		if ((a == Empty || a == wall) && (b == Empty || b == wall)
+				&& (c == Empty || c == wall) && (d == Empty || d == wall)) {
+			return false;
+		}
+		std::uint8_t oldA = a, oldB = b, oldC = c, oldD = d;
+		std::uint32_t noise = getNoise(x, y);
+
+		bool leftFell = sinksInto(a, c), rightFell = sinksInto(b, d);
+		if (leftFell) {
+			std::swap(a, c);
+		}
+		if (rightFell) {
+			std::swap(b, d);
+		}
+		if (!leftFell && !rightFell) {
+			// Which side goes first changes from square to square, so piles don't lean one way
+			bool leftFirst = noise & 1;
+			for (int side = 0; side < 2; side++) {
+				if ((side == 0) == leftFirst) {
+					if (sinksInto(a, d) && sinksInto(a, b)) {
+						std::swap(a, d);
+						break;
+					}
+				} else if (sinksInto(b, c) && sinksInto(b, a)) {
+					std::swap(b, c);
+					break;
+				}
+			}
+		}
+		if (a == oldA && b == oldB && c == oldC && d == oldD) {
+			bool bottomFlows = (c == Water && d == Empty)
+					|| (c == Empty && d == Water);
+			bool topFlows = (a == Water && b == Empty)
+					|| (a == Empty && b == Water);
+			// Water that only stayed put by chance has to be looked at again
+			if ((noise & 2) == 0) {
+				return bottomFlows || topFlows;
+			}
+			if (bottomFlows) {
+				std::swap(c, d);
+			} else if (topFlows) {
+				std::swap(a, b);
+			} else {
+				return false;
+			}
+		}
+		// Walls never move, so only real cells are written back
+		if (a != wall) {
+			cells[y * w + x] = a;
+		}
+		if (b != wall) {
+			cells[y * w + x + 1] = b;
+		}
+		if (c != wall) {
+			cells[(y + 1) * w + x] = c;
+		}
+		if (d != wall) {
+			cells[(y + 1) * w + x + 1] = d;
+		}
+		return true;
+	}
+
+	const ChunkGrid<T> &grid;
+	T w, h;
+	std::vector<std::uint8_t> cells;
+
+	// What moved per chunk in the last two ticks, indexed by tick % 2
+	std::vector<Rect> recent[2];
+	// Squares to update this tick, by the chunk they start in
+	std::vector<Rect> active;
+	std::vector<T> activeChunks;
+	std::vector<unsigned long> revisions;
+
+	unsigned long tick;
+	T scannedCells;
+};
+
+#endif /* INCLUDE_MATERIALGRID_HPP_ */
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Metrics.hpp
+ *
+ *  Created on: Oct 27, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_METRICS_HPP_
+#define INCLUDE_METRICS_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+
+/**
+ * Process wide counters, gauges and histograms for monitoring, written out
+ * in the Prometheus text format by write() (see MetricsExporter).
+ *
+ * Registering a metric takes a lock and is meant for start up; the returned
+ * reference stays valid for the life of the process. Updating one never
+ * locks: counters and histograms are split into per thread shards, each on
+ * its own cache line, which are only added up when they are read.
+ *
+ * Metrics of the same name with different labels (e.g. phase="forces") are
+ * written out as one family.
+ */
+class Metrics {
+public:
+	static constexpr unsigned int numShards = 16;
+
+	class Counter {
+	public:
+		void add(std::uint64_t n = 1) {
+			shards[getShard()].value.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		std::uint64_t getValue() const;
+
+	private:
+		struct alignas(64) Shard {
+			std::atomic<std::uint64_t> value { 0 };
+		};
+		Shard shards[numShards];
+	};
+
+	class Gauge {
+	public:
+		void set(double newValue) {
+			value.store(newValue, std::memory_order_relaxed);
+		}
+
+		double getValue() const {
+			return value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<double> value { 0 };
+	};
+
+	/*
+	 * Histogram of durations (or any other values >= 0) in seconds, with
+	 * the given upper bucket bounds in ascending order
+	 */
+	class Histogram {
+	public:
+		Histogram(const std::vector<double> &upperBounds);
+
+		void observe(double seconds);
+
+		const std::vector<double>& getBounds() const {
+			return bounds;
+		}
+
+		// Observations per bucket (the last one being +Inf), not cumulative
+		std::vector<std::uint64_t> getBucketCounts() const;
+		double getSum() const;
+
+	private:
+		struct alignas(64) Shard {
+			std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+			std::atomic<std::uint64_t> sumNanos { 0 };
+		};
+		std::vector<double> bounds;
+		Shard shards[numShards];
+	};
+
+	/*
+	 * labels are Prometheus labels without the braces, e.g. phase="forces".
+	 * Asking for a metric that's already there returns it again, asking for
+	 * it as a different kind throws std::invalid_argument. A counter's value
+	 * is multiplied by scale when written, so that e.g. nanoseconds can be
+	 * counted with integers and still come out as seconds.
+	 */
+	static Counter& counter(const std::string &name, const std::string &help,
+			const std::string &labels = "", double scale = 1);
+	static Gauge& gauge(const std::string &name, const std::string &help,
+			const std::string &labels = "");
+	static Histogram& histogram(const std::string &name,
+			const std::string &help, const std::vector<double> &upperBounds,
+			const std::string &labels = "");
+
+	// Every metric, in the Prometheus text exposition format
+	static void write(std::ostream &out);
+	static std::string write();
+
+	/*
+	 * Buckets from 0.1 ms to about 1.6 s, doubling each time, for tick and
+	 * frame times
+	 */
+	static std::vector<double> timeBuckets();
+
+	static unsigned int getShard() {
+		thread_local unsigned int shard = nextShard.fetch_add(1,
+				std::memory_order_relaxed) % numShards;
+		return shard;
+	}
+
+private:
+	enum Kind {
+		CounterKind, GaugeKind, HistogramKind
+	};
+
+	struct Entry {
+		std::string name, help, labels;
+		Kind kind;
+		double scale;
+		std::unique_ptr<Counter> counter;
+		std::unique_ptr<Gauge> gauge;
+		std::unique_ptr<Histogram> histogram;
+	};
+
+	static Metrics& getInstance();
+	// nullptr if there's no such metric yet, the caller holds the lock
+	Entry* find(const std::string &name, const std::string &labels, Kind kind);
+	Entry& add(const std::string &name, const std::string &help,
+			const std::string &labels, Kind kind);
+
+	std::mutex mutex;
+	// A deque, so entries never move once registered
+	std::deque<Entry> entries;
+
+	static std::atomic<unsigned int> nextShard;
+};
+
+#endif /* INCLUDE_METRICS_HPP_ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * MetricsExporter.hpp
+ *
+ *  Created on: Oct 27, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_METRICSEXPORTER_HPP_
+#define INCLUDE_METRICSEXPORTER_HPP_
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Gets the Metrics out of the process on a thread of its own: as a
+ * Prometheus scrape endpoint on localhost (GET /metrics), and/or as a text
+ * file rewritten every few seconds for headless runs without a scraper.
+ * The file is written next to its path and renamed over it, so whoever
+ * reads it never sees half a dump.
+ */
+class MetricsExporter {
+public:
+	/*
+	 * port = 0 serves no endpoint, an empty dumpPath writes no file. Throws
+	 * std::runtime_error if the port can't be bound.
+	 */
+	MetricsExporter(std::uint16_t port, const std::string &dumpPath,
+			double dumpSeconds = 10);
+	~MetricsExporter();
+
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+	std::uint16_t getPort() const {
+		return boundPort;
+	}
+
+	// Writes the file right away, also done one last time on destruction
+	void dump();
+
+private:
+	void serve();
+	void answer(int client);
+
+	int listener;
+	std::uint16_t boundPort;
+	std::string path;
+	double interval;
+	std::atomic<bool> stopping;
+	std::thread thread;
+};
+
+#endif /* INCLUDE_METRICSEXPORTER_HPP_ */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * NetClient.hpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_NETCLIENT_HPP_
+#define INCLUDE_NETCLIENT_HPP_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include <World.hpp>
+#include <UdpSocket.hpp>
+#include <NetProtocol.hpp>
+
+/**
+ * Client side of a shared world. Keeps a replica World filled from the
+ * server's chunk states and forwards edits to the server instead of
+ * applying them. Has no window of its own, so it works just as well for
+ * bots and localhost tests as it does under Game.
+ */
+class NetClient {
+public:
+	NetClient(const std::string &host, std::uint16_t port,
+			TextureManager &manager, ThreadPool &pool);
+	~NetClient();
+
+	/*
+	 * Says hello until the server answers, then builds the replica world.
+	 * Returns false if the server didn't answer within timeoutMillis.
+	 */
+	bool connect(int timeoutMillis);
+
+	/*
+	 * Applies every chunk state that has arrived and keeps the connection alive
+	 */
+	void poll();
+
+	void sendCommand(CommandAction action, gen x, gen y);
+
+	/*
+	 * Area of interest, in cells
+	 */
+	void setViewport(gen x, gen y, gen w, gen h);
+
+	World* getWorld() {
+		return world;
+	}
+
+	bool isConnected() const {
+		return world != nullptr;
+	}
+
+	unsigned long getChunksReceived() const {
+		return chunksReceived;
+	}
+
+	static constexpr int keepAliveMillis = 250;
+
+private:
+	void sendViewport(MessageType type);
+	void applyChunk(PacketReader &reader);
+
+	UdpSocket socket;
+	NetAddress server;
+	TextureManager &textureManager;
+	ThreadPool &threadPool;
+	World *world;
+
+	gen viewX, viewY, viewW, viewH;
+	std::chrono::steady_clock::time_point lastSent;
+	std::vector<unsigned long> chunkTicks;
+	unsigned long chunksReceived;
+	std::vector<std::uint8_t> receiveBuffer;
+};
+
+#endif /* INCLUDE_NETCLIENT_HPP_ */
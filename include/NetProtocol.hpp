@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * NetProtocol.hpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_NETPROTOCOL_HPP_
+#define INCLUDE_NETPROTOCOL_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Every datagram starts with protocolId (u32) and a MessageType (u8).
+ * All numbers are little endian.
+ *
+ * Hello, Viewport (client -> server): i32 cellX, i32 cellY, u16 cellsWide, u16 cellsHigh
+ * Welcome (server -> client): u32 width, u32 height (pixels), u16 blockSize, u16 tickRate
+ * Command (client -> server): u8 CommandAction, i32 x, i32 y (pixels)
+ * ChunkState (server -> client): u32 tick, u16 chunkX, u16 chunkY, then one
+ *   u8 per cell of the chunk, row by row (0 = empty, 1 + magnet direction
+ *   otherwise), each occupied cell followed by i32 x, i32 y in 1/256 pixels
+ * Bye (both ways): no payload
+ */
+const std::uint32_t protocolId = 0x31434345; // "ECC1"
+
+enum class MessageType : std::uint8_t {
+	Hello = 1, Welcome, Viewport, Command, ChunkState, Bye
+};
+
+enum class CommandAction : std::uint8_t {
+	AddBlock = 1, RemoveBlock, RotateBlock
+};
+
+const int positionScale = 256;
+
+class PacketWriter {
+public:
+	PacketWriter(MessageType type) {
+		writeU32(protocolId);
+		writeU8((std::uint8_t) type);
+	}
+
+	void writeU8(std::uint8_t value) {
+		bytes.push_back(value);
+	}
+
+	void writeU16(std::uint16_t value) {
+		bytes.push_back(value & 0xFF);
+		bytes.push_back(value >> 8);
+	}
+
+	void writeU32(std::uint32_t value) {
+		for (int i = 0; i < 4; i++) {
+			bytes.push_back((value >> (i * 8)) & 0xFF);
+		}
+	}
+
+	void writeI32(std::int32_t value) {
+		writeU32((std::uint32_t) value);
+	}
+
+	const std::vector<std::uint8_t>& getBytes() const {
+		return bytes;
+	}
+
+	std::size_t getSize() const {
+		return bytes.size();
+	}
+
+private:
+	std::vector<std::uint8_t> bytes;
+};
+
+/**
+ * Reads a datagram back. Reading past the end returns zeros and clears
+ * isValid(), so a short or hostile packet can be dropped after parsing.
+ */
+class PacketReader {
+public:
+	PacketReader(const std::vector<std::uint8_t> &data) :
+			bytes(data), position(0), valid(true) {
+		valid = readU32() == protocolId;
+		type = (MessageType) readU8();
+	}
+
+	std::uint8_t readU8() {
+		if (position + 1 > bytes.size()) {
+			valid = false;
+			return 0;
+		}
+		return bytes[position++];
+	}
+
+	std::uint16_t readU16() {
+		if (position + 2 > bytes.size()) {
+			valid = false;
+			return 0;
+		}
+		std::uint16_t value = bytes[position] | (bytes[position + 1] << 8);
+		position += 2;
+		return value;
+	}
+
+	std::uint32_t readU32() {
+		if (position + 4 > bytes.size()) {
+			valid = false;
+			return 0;
+		}
+		std::uint32_t value = 0;
+		for (int i = 0; i < 4; i++) {
+			value |= (std::uint32_t) bytes[position + i] << (i * 8);
+		}
+		position += 4;
+		return value;
+	}
+
+	std::int32_t readI32() {
+		return (std::int32_t) readU32();
+	}
+
+	MessageType getType() const {
+		return type;
+	}
+
+	bool isValid() const {
+		return valid;
+	}
+
+private:
+	const std::vector<std::uint8_t> &bytes;
+	std::size_t position;
+	bool valid;
+	MessageType type;
+};
+
+#endif /* INCLUDE_NETPROTOCOL_HPP_ */
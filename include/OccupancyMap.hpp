@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * OccupancyMap.hpp
+ *
+ *  Created on: Oct 18, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_OCCUPANCYMAP_HPP_
+#define INCLUDE_OCCUPANCYMAP_HPP_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include <Chunk.hpp>
+#include <BitGrid.hpp>
+
+/**
+ * Which cells of the block grid hold a block, which of those are magnets
+ * and which are awake (have a Block of their own rather than resting in a
+ * chunk palette), as one BitGrid each. On top of the bits, every chunk keeps a
+ * count of its blocks, so queries that walk the grid can skip a whole empty
+ * chunk or 8x8 tile in one step instead of looking at every cell. The totals
+ * of all three are kept as well, for the metrics.
+ */
+template<class T>
+class OccupancyMap {
+public:
+	static constexpr T tileSize = 8;
+
+	OccupancyMap(const ChunkGrid<T> &chunkGrid) :
+			grid(chunkGrid), occupied(chunkGrid.getWidth(),
+					chunkGrid.getHeight()), magnetic(chunkGrid.getWidth(),
+					chunkGrid.getHeight()), awake(chunkGrid.getWidth(),
+					chunkGrid.getHeight()) {
+		chunkCounts.assign(grid.getChunkCount(), 0);
+		count = magnetCount = awakeCount = 0;
+	}
+
+	void set(T cellX, T cellY, bool occupy) {
+		if (occupied.test(cellX, cellY) == occupy) {
+			return;
+		}
+		occupied.set(cellX, cellY, occupy);
+		chunkCounts[grid.getChunkIndex(cellX, cellY)] += occupy ? 1 : -1;
+		count += occupy ? 1 : -1;
+	}
+
+	void setMagnetic(T cellX, T cellY, bool isMagnet) {
+		if (magnetic.test(cellX, cellY) == isMagnet) {
+			return;
+		}
+		magnetic.set(cellX, cellY, isMagnet);
+		magnetCount += isMagnet ? 1 : -1;
+	}
+
+	void setAwake(T cellX, T cellY, bool isAwake) {
+		if (awake.test(cellX, cellY) == isAwake) {
+			return;
+		}
+		awake.set(cellX, cellY, isAwake);
+		awakeCount += isAwake ? 1 : -1;
+	}
+
+	bool test(T cellX, T cellY) const {
+		return occupied.test(cellX, cellY);
+	}
+
+	bool testMagnetic(T cellX, T cellY) const {
+		return magnetic.test(cellX, cellY);
+	}
+
+	bool testAwake(T cellX, T cellY) const {
+		return awake.test(cellX, cellY);
+	}
+
+	void clear() {
+		occupied.clear();
+		magnetic.clear();
+		awake.clear();
+		std::fill(chunkCounts.begin(), chunkCounts.end(), 0);
+		count = magnetCount = awakeCount = 0;
+	}
+
+	T getChunkCount(T chunkIndex) const {
+		return chunkCounts[chunkIndex];
+	}
+
+	long getCount() const {
+		return count;
+	}
+
+	long getMagnetCount() const {
+		return magnetCount;
+	}
+
+	long getAwakeCount() const {
+		return awakeCount;
+	}
+
+	bool isChunkEmpty(T cellX, T cellY) const {
+		return chunkCounts[grid.getChunkIndex(cellX, cellY)] == 0;
+	}
+
+	/*
+	 * Tiles are aligned to 8 cells, so each of their rows is one byte of a word
+	 */
+	bool isTileEmpty(T cellX, T cellY) const {
+		T x0 = cellX / tileSize * tileSize, y0 = cellY / tileSize * tileSize;
+		T y1 = std::min(y0 + tileSize, occupied.getHeight());
+		std::uint64_t any = 0;
+		for (T y = y0; y < y1; y++) {
+			any |= occupied.getBits(x0, y, tileSize);
+		}
+		return any == 0;
+	}
+
+	const BitGrid<T>& getOccupied() const {
+		return occupied;
+	}
+
+	const BitGrid<T>& getMagnetic() const {
+		return magnetic;
+	}
+
+	const BitGrid<T>& getAwake() const {
+		return awake;
+	}
+
+	const ChunkGrid<T>& getChunkGrid() const {
+		return grid;
+	}
+
+	T getWidth() const {
+		return occupied.getWidth();
+	}
+
+	T getHeight() const {
+		return occupied.getHeight();
+	}
+
+private:
+	const ChunkGrid<T> &grid;
+	BitGrid<T> occupied, magnetic, awake;
+	std::vector<T> chunkCounts;
+	long count, magnetCount, awakeCount;
+};
+
+#endif /* INCLUDE_OCCUPANCYMAP_HPP_ */
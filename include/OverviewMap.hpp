@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * OverviewMap.hpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_OVERVIEWMAP_HPP_
+#define INCLUDE_OVERVIEWMAP_HPP_
+
+#include <vector>
+#include <cstdint>
+
+#include <Chunk.hpp>
+#include <BlockManager.hpp>
+
+/**
+ * Downsampled summary of every chunk, for drawing a world zoomed out too
+ * far to draw its blocks. Each chunk keeps numLevels mip levels: 16 x 16
+ * (a cell per block), 4 x 4 and 1 x 1. A summary cell holds the dominant
+ * block type under it and how much of it is blocks and magnets, so drawing
+ * a chunk at any level costs the same however many blocks it holds.
+ *
+ * A chunk is summarised again when its revision in the BlockManager moves
+ * on, and only when someone asks for it, so chunks nobody looks at cost
+ * nothing. The bottom level is read from the blocks, every other level is
+ * made from the one below it.
+ */
+template<class T>
+class OverviewMap {
+public:
+	struct Cell {
+		// Most common block type under the cell, noType when there are no blocks
+		std::uint16_t type;
+		// Share of the cells under it holding a block, and a magnet, out of 255
+		std::uint8_t blocks;
+		std::uint8_t magnets;
+	};
+
+	static constexpr int numLevels = 3;
+	static constexpr std::uint16_t noType = 0xFFFF;
+
+	OverviewMap(const ChunkGrid<T> &chunkGrid) :
+			grid(chunkGrid) {
+		cells.resize(
+				(std::size_t) grid.getChunkCount() * cellsPerChunk,
+				Cell { noType, 0, 0 });
+		// One behind every real revision, so each chunk is summarised on first use
+		revisions.assign(grid.getChunkCount(), (unsigned long) -1);
+	}
+
+	/*
+	 * Cells of one side of the chunk at level (0 is the finest)
+	 */
+	static constexpr T getSide(int level) {
+		return ChunkGrid<T>::chunkSize >> (2 * level);
+	}
+
+	/*
+	 * Brings the summary of a chunk up to date, returns whether it changed
+	 */
+	template<class P>
+	bool refresh(T chunkIndex, BlockManager<P, T> &blockManager) {
+		unsigned long revision = blockManager.getChunkRevision(chunkIndex);
+		if (revisions[chunkIndex] == revision) {
+			return false;
+		}
+		revisions[chunkIndex] = revision;
+		summarise(chunkIndex, blockManager);
+		return true;
+	}
+
+	/*
+	 * getSide(level)^2 cells, row by row
+	 */
+	const Cell* getLevel(T chunkIndex, int level) const {
+		return &cells[(std::size_t) chunkIndex * cellsPerChunk
+				+ levelOffsets[level]];
+	}
+
+	std::size_t getMemoryUsage() const {
+		return cells.size() * sizeof(Cell)
+				+ revisions.size() * sizeof(unsigned long);
+	}
+
+private:
+	static constexpr T size = ChunkGrid<T>::chunkSize;
+	static constexpr T levelOffsets[numLevels] = { 0, size * size, size * size
+			+ (size / 4) * (size / 4) };
+	static constexpr T cellsPerChunk = levelOffsets[numLevels - 1] + 1;
+
+	Cell* getLevelCells(T chunkIndex, int level) {
+		return &cells[(std::size_t) chunkIndex * cellsPerChunk
+				+ levelOffsets[level]];
+	}
+
+	template<class P>
+	void summarise(T chunkIndex, BlockManager<P, T> &blockManager) {
+		const OccupancyMap<T> &occupancy = blockManager.getOccupancy();
+		Point<T> chunk = grid.getChunkCoord(chunkIndex);
+		Point<T> start = grid.getChunkStart(chunk.x, chunk.y);
+		Point<T> end = grid.getChunkEnd(chunk.x, chunk.y);
+		Cell *finest = getLevelCells(chunkIndex, 0);
+		T side = getSide(0);
+		for (T i = 0; i < side * side; i++) {
+			finest[i] = Cell { noType, 0, 0 };
+		}
+		occupancy.getOccupied().forEachInRect(start.x, start.y, end.x, end.y,
+				[&](T x, T y) {
+					Cell &cell = finest[(y - start.y) * side + (x - start.x)];
+					cell.type = blockManager.getCellType(x, y)->id;
+					cell.blocks = 255;
+					cell.magnets = occupancy.testMagnetic(x, y) ? 255 : 0;
+				});
+		for (int level = 1; level < numLevels; level++) {
+			downsample(getLevelCells(chunkIndex, level - 1), getSide(level - 1),
+					getLevelCells(chunkIndex, level));
+		}
+	}
+
+	/*
+	 * Each 4 x 4 block of cells of the level below becomes one cell: the
+	 * averages of the shares, and the type that covers the most of it
+	 */
+	static void downsample(const Cell *below, T belowSide, Cell *level) {
+		T side = belowSide / 4;
+		for (T y = 0; y < side; y++) {
+			for (T x = 0; x < side; x++) {
+				std::uint16_t types[16];
+				unsigned int weights[16];
+				int numTypes = 0;
+				unsigned int blocks = 0, magnets = 0;
+				for (T dy = 0; dy < 4; dy++) {
+					for (T dx = 0; dx < 4; dx++) {
+						const Cell &cell = below[(y * 4 + dy) * belowSide + x * 4
+								+ dx];
+						blocks += cell.blocks;
+						magnets += cell.magnets;
+						if (cell.type == noType) {
+							continue;
+						}
+						int found = 0;
+						while (found < numTypes && types[found] != cell.type) {
+							found++;
+						}
+						if (found == numTypes) {
+							types[numTypes] = cell.type;
+							weights[numTypes++] = 0;
+						}
+						weights[found] += cell.blocks;
+					}
+				}
+				int dominant = -1;
+				for (int i = 0; i < numTypes; i++) {
+					if (dominant < 0 || weights[i] > weights[dominant]) {
+						dominant = i;
+					}
+				}
+				level[y * side + x] = Cell { dominant < 0 ? noType : types[dominant],
+						(std::uint8_t) (blocks / 16), (std::uint8_t) (magnets / 16) };
+			}
+		}
+	}
+
+	ChunkGrid<T> grid;
+	std::vector<Cell> cells;
+	std::vector<unsigned long> revisions;
+};
+
+#endif /* INCLUDE_OVERVIEWMAP_HPP_ */
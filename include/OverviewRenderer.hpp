@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * OverviewRenderer.hpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_OVERVIEWRENDERER_HPP_
+#define INCLUDE_OVERVIEWRENDERER_HPP_
+
+#include <vector>
+#include <memory>
+
+#include <SFML/Graphics.hpp>
+#include <World.hpp>
+#include <OverviewMap.hpp>
+
+/**
+ * Draws a zoomed out world from its OverviewMap instead of its blocks: one
+ * flat coloured quad per summary cell, at the finest level whose cells are
+ * still minCellPixels wide on screen. Each visible chunk costs at most
+ * 256 quads (a single one when far out), whatever it holds, all in one
+ * draw call.
+ *
+ * The colour comes from the dominant block type, turning red with the
+ * share of magnets, and the share of blocks sets how opaque it is.
+ */
+class OverviewRenderer: public sf::Drawable {
+public:
+	OverviewRenderer();
+
+	/*
+	 * Syncs with the world for the chunks inside view (in pixels).
+	 * scale = screen pixels per world pixel.
+	 */
+	void update(World &world, const sf::FloatRect &view, float scale);
+
+	static constexpr float minCellPixels = 4;
+
+	// Statistics of the last update()
+	int getLevel() const {
+		return level;
+	}
+
+	unsigned int getRefreshedChunks() const {
+		return refreshedChunks;
+	}
+
+protected:
+	void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+
+private:
+	static sf::Color getColor(const OverviewMap<gen>::Cell &cell);
+
+	std::unique_ptr<OverviewMap<gen>> map;
+	const World *mappedWorld;
+	std::vector<sf::Vertex> vertices;
+	int level;
+	unsigned int refreshedChunks;
+};
+
+#endif /* INCLUDE_OVERVIEWRENDERER_HPP_ */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * PalettedChunk.hpp
+ *
+ *  Created on: Oct 20, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_PALETTEDCHUNK_HPP_
+#define INCLUDE_PALETTEDCHUNK_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * A fixed number of 16 bit values stored as a palette of the distinct
+ * values plus one small index per cell, bit-packed into 64 bit words.
+ * Indices take 0, 1, 2, 4, 8 or 16 bits (whatever the palette needs), so
+ * they never straddle two words. Value 0 is always palette entry 0, which
+ * makes an empty chunk cost nothing but the palette.
+ *
+ * Palette entries are reference counted and reused once no cell points at
+ * them any more, so the indices only widen when a chunk really holds more
+ * distinct values at once.
+ */
+class PalettedChunk {
+public:
+	PalettedChunk(unsigned int numCells);
+
+	std::uint16_t get(unsigned int cell) const {
+		if (bits == 0) {
+			return palette[0];
+		}
+		unsigned int perWord = 64 / bits;
+		std::uint64_t word = packed[cell / perWord];
+		unsigned int shift = (cell % perWord) * bits;
+		return palette[(word >> shift) & ((std::uint64_t(1) << bits) - 1)];
+	}
+
+	void set(unsigned int cell, std::uint16_t value);
+
+	unsigned int getBitsPerCell() const {
+		return bits;
+	}
+
+	std::size_t getPaletteSize() const {
+		return palette.size();
+	}
+
+	/*
+	 * Bytes held by this chunk, not counting the object itself
+	 */
+	std::size_t getMemoryUsage() const;
+
+private:
+	unsigned int getIndex(unsigned int cell) const;
+	void setIndex(unsigned int cell, unsigned int index);
+	unsigned int findOrAddEntry(std::uint16_t value);
+	void repack(unsigned int newBits);
+
+	unsigned int cells;
+	unsigned int bits;
+	std::vector<std::uint16_t> palette;
+	std::vector<unsigned int> useCounts;
+	std::vector<std::uint64_t> packed;
+};
+
+#endif /* INCLUDE_PALETTEDCHUNK_HPP_ */
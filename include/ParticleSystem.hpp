@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ParticleSystem.hpp
+ *
+ *  Created on: Oct 25, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_PARTICLESYSTEM_HPP_
+#define INCLUDE_PARTICLESYSTEM_HPP_
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#include <SFML/Graphics.hpp>
+#include <World.hpp>
+#include <ThreadPool.hpp>
+
+/**
+ * Short lived effect particles (dust, sparks), drawn as small tinted tiles
+ * of the texture atlas from a single vertex array.
+ *
+ * Particles are kept as a structure of arrays with a fixed capacity, so
+ * the update is a straight loop over plain float arrays the compiler can
+ * vectorize, split into slices across the thread pool, and nothing is
+ * allocated after construction. Dead
+ * particles are swap-removed (the last one moves into the hole), which
+ * keeps the live ones packed at the front. The vertex array has a quad for
+ * every slot with its texture coordinates set once, so a frame only writes
+ * positions and colours and draws the front of it.
+ */
+class ParticleSystem: public sf::Drawable {
+public:
+	static constexpr std::size_t defaultCapacity = 1 << 17;
+	// Pixels per second squared, down
+	static constexpr float gravity = 400;
+
+	ParticleSystem(std::size_t maxParticles = defaultCapacity);
+
+	/*
+	 * Adds one particle, or nothing when the system is full
+	 */
+	void emit(float x, float y, float vx, float vy, float life, float size,
+			sf::Color color);
+
+	/*
+	 * count particles flying out of (x, y) in random directions at up to speed
+	 */
+	void burst(float x, float y, unsigned int count, float speed, float life,
+			sf::Color color);
+
+	/*
+	 * Turns the block events of the world since the last call into bursts
+	 */
+	void emitBlockEvents(World &world);
+
+	/*
+	 * Moves every particle by dt seconds, drops the dead ones and refills
+	 * the vertex array
+	 */
+	void update(float dt, ThreadPool &pool);
+
+	// Particles per slice of the update
+	static constexpr std::size_t grain = 8192;
+
+	void clear() {
+		count = 0;
+	}
+
+	std::size_t getCount() const {
+		return count;
+	}
+
+	std::size_t getCapacity() const {
+		return capacity;
+	}
+
+	/*
+	 * Particles are drawn as the tile of the atlas
+	 */
+	void setTexture(const sf::Texture *texture, const sf::IntRect &tile);
+
+protected:
+	void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
+
+private:
+	void integrate(std::size_t begin, std::size_t end, float dt);
+	void removeDead();
+	void buildVertices(std::size_t begin, std::size_t end);
+
+	std::size_t capacity, count;
+	std::vector<float> x, y, vx, vy, life, inverseLifetime, halfSize;
+	std::vector<sf::Color> color;
+
+	sf::VertexArray vertices;
+	const sf::Texture *atlas;
+	std::minstd_rand random;
+};
+
+#endif /* INCLUDE_PARTICLESYSTEM_HPP_ */
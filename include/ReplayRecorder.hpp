@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ReplayRecorder.hpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_REPLAYRECORDER_HPP_
+#define INCLUDE_REPLAYRECORDER_HPP_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+
+#include <World.hpp>
+#include <WorldSnapshot.hpp>
+#include <DeltaCodec.hpp>
+
+/**
+ * Writes one delta per tick to a replay file. Every frame is a u32 byte
+ * count followed by a SnapshotEncoder delta against the frame before it,
+ * with a keyframe (delta against nothing) every keyframeInterval ticks so a
+ * replay can be entered part way through.
+ */
+class ReplayRecorder {
+public:
+	/*
+	 * Throws std::runtime_error if the file can't be opened
+	 */
+	ReplayRecorder(const std::string &path, unsigned long keyframeInterval);
+
+	void record(World &world, unsigned long tick);
+
+	/*
+	 * Bytes per tick against a naive dump, and how long encoding took
+	 */
+	void printStats(std::ostream &out) const;
+
+	/*
+	 * Reads a whole replay back, checking every frame decodes. Returns the
+	 * number of frames, or -1 at the first bad one.
+	 */
+	static long verify(const std::string &path, double &decodeSeconds);
+
+private:
+	std::ofstream file;
+	SnapshotEncoder encoder;
+	WorldSnapshot snapshot;
+	std::vector<std::uint8_t> buffer;
+	unsigned long keyframes;
+
+	unsigned long frames;
+	unsigned long long encodedBytes;
+	unsigned long long naiveBytes;
+	double encodeSeconds;
+};
+
+#endif /* INCLUDE_REPLAYRECORDER_HPP_ */
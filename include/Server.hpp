@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Server.hpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_SERVER_HPP_
+#define INCLUDE_SERVER_HPP_
+
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <World.hpp>
+#include <UdpSocket.hpp>
+#include <NetProtocol.hpp>
+#include <ReplayRecorder.hpp>
+#include <SharedWorldView.hpp>
+
+/**
+ * Authoritative host for a shared world. Clients send the same edits the
+ * mouse makes locally, the server applies them, steps the world at a fixed
+ * rate and sends every client the chunks around its viewport.
+ *
+ * A client only ever costs the chunks inside its area of interest, and of
+ * those only the ones whose revision changed (plus a slow resend to cover
+ * lost datagrams), no matter how big the world gets.
+ */
+class Server {
+public:
+	Server(World &world, std::uint16_t port, unsigned int tickRate);
+
+	/*
+	 * Ticks at the fixed rate until running turns false
+	 */
+	void run(const std::atomic<bool> &running);
+
+	/*
+	 * One server tick: handle incoming packets, step the world, replicate
+	 */
+	void tick();
+
+	std::uint16_t getPort() const {
+		return socket.getPort();
+	}
+
+	unsigned long getTick() const {
+		return tickCount;
+	}
+
+	std::size_t getClientCount() const {
+		return clients.size();
+	}
+
+	/*
+	 * Records every tick from now on, nullptr stops recording
+	 */
+	void setRecorder(ReplayRecorder *replayRecorder) {
+		recorder = replayRecorder;
+	}
+
+	/*
+	 * Publishes every tick from now on, nullptr stops
+	 */
+	void setSharedView(SharedWorldView *view) {
+		sharedView = view;
+	}
+
+	// Chunks outside the viewport that are still sent, so scrolling doesn't pop
+	static constexpr gen interestMargin = 1;
+	// Widest and tallest viewport (in cells) a client gets, whatever it asks for
+	static constexpr gen maxViewCells = 256;
+	// Unchanged chunks are sent again after this many ticks in case the last copy was lost
+	static constexpr unsigned long resendTicks = 30;
+	static constexpr int clientTimeoutSeconds = 5;
+
+private:
+	struct ChunkSendState {
+		unsigned long revision;
+		unsigned long tick;
+	};
+
+	struct ClientState {
+		gen viewX, viewY, viewW, viewH; // in cells
+		std::chrono::steady_clock::time_point lastHeard;
+		std::unordered_map<gen, ChunkSendState> sentChunks;
+	};
+
+	void receivePackets();
+	void handlePacket(const NetAddress &from, PacketReader &reader);
+	void dropSilentClients();
+	void replicate(const NetAddress &address, ClientState &client);
+	void writeChunk(PacketWriter &writer, gen chunkX, gen chunkY);
+
+	World &world;
+	UdpSocket socket;
+	unsigned int tickRate;
+	accur tickLength;
+	unsigned long tickCount;
+	ReplayRecorder *recorder;
+	SharedWorldView *sharedView;
+
+	std::map<NetAddress, ClientState> clients;
+	std::vector<std::uint8_t> receiveBuffer;
+};
+
+#endif /* INCLUDE_SERVER_HPP_ */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * SharedWorldLayout.hpp
+ *
+ *  Created on: Oct 26, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_SHAREDWORLDLAYOUT_HPP_
+#define INCLUDE_SHAREDWORLDLAYOUT_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Layout of the shared memory segment a running world is published in (see
+ * SharedWorldView), for tools in other processes (see SharedWorldReader).
+ * Host byte order, every array starts 64 byte aligned:
+ *
+ * SharedWorldHeader
+ * occupied: height rows of wordsPerRow u64, bit x % 64 of word x / 64
+ * magnetic: the same for magnets
+ * forceX, forceY: width * height f32, row by row, the ForceTable of the
+ *   world in Newtons
+ *
+ * The header's sequence is a seqlock: odd while a tick is being written.
+ * A reader copies what it needs and keeps the copy only if the sequence
+ * was even and didn't change in the meantime.
+ */
+const std::uint32_t sharedWorldMagic = 0x56574345; // "ECWV"
+const std::uint32_t sharedWorldVersion = 1;
+
+struct SharedWorldHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::atomic<std::uint64_t> sequence;
+
+	// Counters of the writer as of the last published tick
+	std::uint64_t tick;
+	std::uint64_t frame;
+	std::uint64_t publishedNanos; // steady clock of the writer
+
+	std::uint32_t width, height; // in cells
+	std::uint32_t blockSize; // pixels per cell
+	std::uint32_t wordsPerRow;
+
+	// In bytes from the start of the segment
+	std::uint64_t occupiedOffset, magneticOffset;
+	std::uint64_t forceXOffset, forceYOffset;
+	std::uint64_t totalSize;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+		"The seqlock has to work across processes");
+
+#endif /* INCLUDE_SHAREDWORLDLAYOUT_HPP_ */
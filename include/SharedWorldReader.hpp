@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * SharedWorldReader.hpp
+ *
+ *  Created on: Oct 26, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_SHAREDWORLDREADER_HPP_
+#define INCLUDE_SHAREDWORLDREADER_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <SharedWorldLayout.hpp>
+
+/**
+ * One consistent tick of a published world, copied out of the segment
+ */
+struct SharedWorldFrame {
+	std::uint64_t tick = 0, frame = 0, publishedNanos = 0;
+	std::uint32_t width = 0, height = 0, blockSize = 0, wordsPerRow = 0;
+	std::vector<std::uint64_t> occupied, magnetic;
+	std::vector<float> forceX, forceY;
+
+	bool isOccupied(std::uint32_t x, std::uint32_t y) const {
+		return (occupied[y * wordsPerRow + x / 64] >> (x % 64)) & 1;
+	}
+
+	bool isMagnetic(std::uint32_t x, std::uint32_t y) const {
+		return (magnetic[y * wordsPerRow + x / 64] >> (x % 64)) & 1;
+	}
+
+	float getForceX(std::uint32_t x, std::uint32_t y) const {
+		return forceX[y * width + x];
+	}
+
+	float getForceY(std::uint32_t x, std::uint32_t y) const {
+		return forceY[y * width + x];
+	}
+};
+
+/**
+ * Reading side of SharedWorldView, for tools in other processes. Only
+ * needs this header and SharedWorldReader.cpp, nothing of the game.
+ */
+class SharedWorldReader {
+public:
+	/*
+	 * Maps the segment read only, throws std::runtime_error if there is no
+	 * such segment
+	 */
+	SharedWorldReader(const std::string &segmentName);
+	~SharedWorldReader();
+
+	SharedWorldReader(const SharedWorldReader&) = delete;
+	SharedWorldReader& operator=(const SharedWorldReader&) = delete;
+
+	/*
+	 * Copies the last published tick into frame. Returns false if the
+	 * segment isn't (yet) a published world, or the writer was in the way
+	 * maxAttempts times in a row.
+	 */
+	bool read(SharedWorldFrame &frame, int maxAttempts = 1000) const;
+
+	/*
+	 * Changes with every published tick, so polling tools can skip reads
+	 */
+	std::uint64_t getSequence() const {
+		return header->sequence.load(std::memory_order_acquire);
+	}
+
+private:
+	std::size_t size;
+	const unsigned char *base;
+	const SharedWorldHeader *header;
+};
+
+#endif /* INCLUDE_SHAREDWORLDREADER_HPP_ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * SharedWorldView.hpp
+ *
+ *  Created on: Oct 26, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_SHAREDWORLDVIEW_HPP_
+#define INCLUDE_SHAREDWORLDVIEW_HPP_
+
+#include <string>
+#include <cstdint>
+
+#include <SharedWorldLayout.hpp>
+#include <World.hpp>
+
+/**
+ * Publishes a world into a POSIX shared memory segment once per tick, so
+ * tools in other processes (viewers, inspectors, test oracles) can watch
+ * it without going through the game. publish() writes the occupancy bits
+ * and forces straight from the world into the segment under the seqlock,
+ * and never waits for a reader.
+ *
+ * The segment is removed again when the view is destroyed.
+ */
+class SharedWorldView {
+public:
+	/*
+	 * name = shm_open() name, e.g. "/enemycraft". Throws std::runtime_error
+	 * if the segment can't be created.
+	 */
+	SharedWorldView(const std::string &segmentName, World &w);
+	~SharedWorldView();
+
+	SharedWorldView(const SharedWorldView&) = delete;
+	SharedWorldView& operator=(const SharedWorldView&) = delete;
+
+	/*
+	 * Writes the world as of now, with the given counters
+	 */
+	void publish(std::uint64_t tick, std::uint64_t frame);
+
+	const std::string& getName() const {
+		return name;
+	}
+
+	std::size_t getSize() const {
+		return size;
+	}
+
+private:
+	std::string name;
+	World &world;
+	std::size_t size;
+	unsigned char *base;
+	SharedWorldHeader *header;
+};
+
+#endif /* INCLUDE_SHAREDWORLDVIEW_HPP_ */
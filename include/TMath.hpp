@@ -26,11 +26,27 @@
 #ifndef INCLUDE_TMATH_HPP_
 #define INCLUDE_TMATH_HPP_
 
+#include <cmath>
+
 namespace tma {
 template<class T>
 T abs(T x) {
-	return (x < 0) ? -x : x;
+	return (x < (T) 0) ? -x : x;
+}
+
+template<class T>
+T sqrt(T x) {
+	return std::sqrt(x);
 }
+
+/*
+ * What to add up many T in without running out of range, T itself unless a
+ * specialisation says otherwise (see Fixed)
+ */
+template<class T>
+struct Accumulator {
+	typedef T type;
+};
 }
 
 #endif /* INCLUDE_TMATH_HPP_ */
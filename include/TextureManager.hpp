@@ -28,60 +28,88 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #include <SFML/Graphics.hpp>
+#include <ThreadPool.hpp>
 
+/**
+ * Owns every tile image, packed into a single atlas texture.
+ *
+ * The first start decodes the source images in parallel, packs them and
+ * bakes the result into a cache file keyed by the path and content hash of
+ * every source. Later starts only hash the sources and, if nothing changed,
+ * copy the baked pixels straight into the atlas without decoding anything.
+ */
 class TextureManager {
 public:
-	bool loadNormalBlock(std::string path);
-	bool loadMagnetUpBlock(std::string path);
-	bool loadMagnetDownBlock(std::string path);
-	bool loadMagnetLeftBlock(std::string path);
-	bool loadMagnetRightBlock(std::string path);
-
-	sf::Texture& getMagnetDownBlock() {
-		return magnetDownBlock;
-	}
-
-	void setMagnetDownBlock(sf::Texture &magnetDownBlock) {
-		this->magnetDownBlock = magnetDownBlock;
-	}
-
-	sf::Texture& getMagnetLeftBlock() {
-		return magnetLeftBlock;
+	// Tile order expected by getBlockRect
+	enum BlockTexture {
+		NormalBlock,
+		MagnetUpBlock,
+		MagnetDownBlock,
+		MagnetLeftBlock,
+		MagnetRightBlock,
+		NumBlockTextures
+	};
+
+	TextureManager();
+
+	/*
+	 * Loads the tiles in the given order, throws std::runtime_error naming
+	 * the first file that can't be read or decoded
+	 */
+	void loadTiles(const std::vector<std::string> &paths,
+			const std::string &cachePath, ThreadPool &pool);
+
+	sf::Texture& getAtlas() {
+		return atlas;
 	}
 
-	void setMagnetLeftBlock(sf::Texture &magnetLeftBlock) {
-		this->magnetLeftBlock = magnetLeftBlock;
+	const sf::IntRect& getTileRect(std::size_t tile) const {
+		return tile < tileRects.size() ? tileRects[tile] : emptyRect;
 	}
 
-	sf::Texture& getMagnetRightBlock() {
-		return magnetRightBlock;
+	/*
+	 * Tile for a block with the given magnet direction (0 - 4, see Block)
+	 */
+	const sf::IntRect& getBlockRect(int magnetFacingDirection) const {
+		if (magnetFacingDirection < 0
+				|| magnetFacingDirection >= NumBlockTextures) {
+			magnetFacingDirection = NormalBlock;
+		}
+		return getTileRect(magnetFacingDirection);
 	}
 
-	void setMagnetRightBlock(sf::Texture &magnetRightBlock) {
-		this->magnetRightBlock = magnetRightBlock;
+	std::size_t getTileCount() const {
+		return tileRects.size();
 	}
 
-	sf::Texture& getMagnetUpBlock() {
-		return magnetUpBlock;
+	bool wasLoadedFromCache() const {
+		return loadedFromCache;
 	}
 
-	void setMagnetUpBlock(sf::Texture &magnetUpBlock) {
-		this->magnetUpBlock = magnetUpBlock;
-	}
-
-	sf::Texture& getNormalBlock() {
-		return normalBlock;
-	}
-
-	void setNormalBlock(sf::Texture &normalBlock) {
-		this->normalBlock = normalBlock;
-	}
+	static std::uint64_t hashBytes(const std::vector<char> &bytes);
 
 private:
-	sf::Texture normalBlock, magnetUpBlock, magnetDownBlock, magnetLeftBlock,
-			magnetRightBlock;
+	struct Source {
+		std::string path;
+		std::vector<char> bytes;
+		std::uint64_t hash;
+		bool readOk;
+	};
+
+	bool loadCache(const std::string &cachePath,
+			const std::vector<Source> &sources);
+	void bakeAtlas(std::vector<Source> &sources, const std::string &cachePath,
+			ThreadPool &pool);
+	void writeCache(const std::string &cachePath,
+			const std::vector<Source> &sources, const sf::Image &image);
+
+	sf::Texture atlas;
+	std::vector<sf::IntRect> tileRects;
+	sf::IntRect emptyRect;
+	bool loadedFromCache;
 };
 
 #endif /* INCLUDE_TEXTUREMANAGER_HPP_ */
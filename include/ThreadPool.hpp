@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ThreadPool.hpp
+ *
+ *  Created on: Oct 10, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_THREADPOOL_HPP_
+#define INCLUDE_THREADPOOL_HPP_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+
+#include <Metrics.hpp>
+#include <AllocationTracker.hpp>
+
+/**
+ * Fixed set of worker threads that run batches of independent tasks.
+ * The calling thread takes part in every batch, so a pool of zero workers
+ * simply runs everything inline.
+ *
+ * How long the threads spend running tasks is counted in the Metrics, which
+ * over the number of threads gives the pool's occupancy.
+ *
+ * Tasks are taken by reference and called through a plain function pointer,
+ * never copied into a std::function, so starting a batch doesn't allocate.
+ */
+class ThreadPool {
+public:
+	ThreadPool();
+	ThreadPool(unsigned int numWorkers);
+	~ThreadPool();
+
+	/*
+	 * Runs task(0) ... task(numTasks - 1) and returns once all of them have finished
+	 */
+	template<class F>
+	void run(std::size_t numTasks, const F &task) {
+		runTasks(numTasks, [](const void *context, std::size_t i) {
+			(*(const F*) context)(i);
+		}, &task);
+	}
+
+	/*
+	 * Splits [begin, end) into contiguous slices of at least grain items and
+	 * calls task(sliceBegin, sliceEnd) for each of them
+	 */
+	template<class T, class F>
+	void parallelFor(T begin, T end, T grain, const F &task) {
+		if (end <= begin) {
+			return;
+		}
+		if (grain < 1) {
+			grain = 1;
+		}
+		T numSlices = (end - begin + grain - 1) / grain;
+		run((std::size_t) numSlices, [&](std::size_t slice) {
+			T sliceBegin = begin + (T) slice * grain;
+			T sliceEnd = (sliceBegin + grain < end) ? sliceBegin + grain : end;
+			task(sliceBegin, sliceEnd);
+		});
+	}
+
+	unsigned int getNumThreads() const {
+		return (unsigned int) workers.size() + 1;
+	}
+
+private:
+	typedef void (*TaskFunction)(const void*, std::size_t);
+
+	void runTasks(std::size_t numTasks, TaskFunction function,
+			const void *context);
+	void workerLoop();
+	void drainTasks();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeUp, batchDone;
+
+	TaskFunction currentTask;
+	const void *currentContext;
+	// Workers count their allocations towards whatever the caller was doing
+	AllocationTracker::Tag currentTag;
+	std::size_t taskCount;
+	std::atomic<std::size_t> nextTask;
+	std::size_t finishedTasks;
+	unsigned int activeWorkers;
+	unsigned long batchId;
+	bool stopping;
+
+	Metrics::Counter &busyTime, &tasksRun;
+};
+
+#endif /* INCLUDE_THREADPOOL_HPP_ */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * TickScheduler.hpp
+ *
+ *  Created on: Oct 22, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_TICKSCHEDULER_HPP_
+#define INCLUDE_TICKSCHEDULER_HPP_
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+
+/**
+ * Block actions due on a later tick, kept in a hierarchical timing wheel.
+ *
+ * Level l of the wheel has slots buckets of slots^l ticks each. An entry
+ * goes into the lowest level whose span covers its delay, in the bucket its
+ * tick falls into. Whenever a level comes round to a new bucket, that bucket
+ * of the level above is spread over the levels below, so entries only ever
+ * move down and each tick only touches the entries that are due (plus the
+ * rare cascade). Scheduling and running an entry are O(1).
+ */
+template<class T>
+class TickScheduler {
+public:
+	static constexpr unsigned int slotBits = 6;
+	static constexpr unsigned long slots = 1ul << slotBits;
+	static constexpr unsigned int levels = 4;
+	// Furthest ahead an action can be scheduled, about three days at 60 Hz
+	static constexpr unsigned long maxDelay = (1ul << (slotBits * levels)) - 1;
+
+	struct Entry {
+		unsigned long tick;
+		T x, y;
+		int action;
+	};
+
+	TickScheduler() :
+			now(0), count(0) {
+		wheel.resize(levels * slots);
+	}
+
+	/*
+	 * Runs action on cell (x, y) delay ticks from now (at least 1)
+	 */
+	void schedule(T x, T y, int action, unsigned long delay) {
+		if (delay == 0 || delay > maxDelay) {
+			throw std::out_of_range(
+					"Can't schedule an action " + std::to_string(delay)
+							+ " ticks ahead");
+		}
+		insert(Entry { now + delay, x, y, action });
+		count++;
+	}
+
+	/*
+	 * Moves on to the next tick and calls run(x, y, action) for everything
+	 * due on it. run may schedule more actions. Returns how many ran.
+	 */
+	template<class F>
+	std::size_t advance(F run) {
+		now++;
+		unsigned int top = 0;
+		while (top + 1 < levels
+				&& (now & ((1ul << (slotBits * (top + 1))) - 1)) == 0) {
+			top++;
+		}
+		for (unsigned int level = top; level >= 1; level--) {
+			cascade(level);
+		}
+		due.clear();
+		due.swap(wheel[now & (slots - 1)]);
+		count -= due.size();
+		for (const Entry &entry : due) {
+			run(entry.x, entry.y, entry.action);
+		}
+		return due.size();
+	}
+
+	unsigned long getTick() const {
+		return now;
+	}
+
+	// Actions waiting to run
+	std::size_t getCount() const {
+		return count;
+	}
+
+private:
+	void insert(const Entry &entry) {
+		unsigned long delay = entry.tick - now;
+		unsigned int level = 0;
+		while (delay >= (1ul << (slotBits * (level + 1)))) {
+			level++;
+		}
+		wheel[level * slots + ((entry.tick >> (slotBits * level)) & (slots - 1))].push_back(
+				entry);
+	}
+
+	void cascade(unsigned int level) {
+		std::vector<Entry> &slot = wheel[level * slots
+				+ ((now >> (slotBits * level)) & (slots - 1))];
+		moving.clear();
+		moving.swap(slot);
+		for (const Entry &entry : moving) {
+			insert(entry);
+		}
+	}
+
+	unsigned long now;
+	std::size_t count;
+	std::vector<std::vector<Entry>> wheel;
+	// Kept between ticks to save the allocations
+	std::vector<Entry> due;
+	std::vector<Entry> moving;
+};
+
+#endif /* INCLUDE_TICKSCHEDULER_HPP_ */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * UdpSocket.hpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_UDPSOCKET_HPP_
+#define INCLUDE_UDPSOCKET_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * IPv4 address and port, both in host byte order
+ */
+struct NetAddress {
+	std::uint32_t host;
+	std::uint16_t port;
+
+	NetAddress() :
+			host(0), port(0) {
+	}
+	NetAddress(std::uint32_t h, std::uint16_t p) :
+			host(h), port(p) {
+	}
+
+	/*
+	 * Looks up a host name or dotted address, throws std::runtime_error if it can't
+	 */
+	static NetAddress resolve(const std::string &hostName, std::uint16_t port);
+
+	bool operator==(const NetAddress &a) const {
+		return host == a.host && port == a.port;
+	}
+	bool operator!=(const NetAddress &a) const {
+		return !(*this == a);
+	}
+	bool operator<(const NetAddress &a) const {
+		return host < a.host || (host == a.host && port < a.port);
+	}
+
+	std::string toString() const;
+};
+
+/**
+ * Non-blocking UDP socket
+ */
+class UdpSocket {
+public:
+	/*
+	 * port = 0 picks any free port. Throws std::runtime_error if the socket
+	 * can't be opened or bound.
+	 */
+	UdpSocket(std::uint16_t port);
+	~UdpSocket();
+
+	UdpSocket(const UdpSocket&) = delete;
+	UdpSocket& operator=(const UdpSocket&) = delete;
+
+	bool send(const NetAddress &to, const std::vector<std::uint8_t> &data);
+
+	/*
+	 * Returns false when there is nothing left to read
+	 */
+	bool receive(NetAddress &from, std::vector<std::uint8_t> &data);
+
+	std::uint16_t getPort() const {
+		return boundPort;
+	}
+
+	static constexpr std::size_t maxDatagramSize = 65507;
+
+private:
+	int handle;
+	std::uint16_t boundPort;
+};
+
+#endif /* INCLUDE_UDPSOCKET_HPP_ */
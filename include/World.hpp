@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * World.hpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_WORLD_HPP_
+#define INCLUDE_WORLD_HPP_
+
+#include <random>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <string>
+
+#include <BlockManager.hpp>
+#include <TextureManager.hpp>
+#include <ThreadPool.hpp>
+#include <Fixed.hpp>
+#include <FlowField.hpp>
+#include <GridRaycaster.hpp>
+#include <TickScheduler.hpp>
+#include <MaterialGrid.hpp>
+#include <Metrics.hpp>
+#include <AllocationTracker.hpp>
+
+typedef int gen;
+// Build with ENEMYCRAFT_FIXED_POINT for a bit-identical simulation on every machine
+#ifdef ENEMYCRAFT_FIXED_POINT
+typedef Fixed accur;
+#else
+typedef float accur;
+#endif
+
+/**
+ * One block world and its physics, without any window attached.
+ * Game draws one of these, the dedicated server runs one headless.
+ *
+ * Every step is timed phase by phase and, along with the block counts,
+ * handed to the Metrics at the end of the step.
+ *
+ * All of its state belongs to the instance, so any number of worlds can run
+ * side by side (see WorldHost) as long as each is only stepped by one thread
+ * at a time. They can share the TextureManager and the block types.
+ */
+class World {
+public:
+	/*
+	 * width, height = size of the world in pixels
+	 * sharedTypes = block types to use instead of a registry of its own, left
+	 *   alone apart from adding the default "Block" if it's missing
+	 * name = labels this world's metrics with world="name", for processes
+	 *   that run more than one
+	 */
+	World(unsigned int width, unsigned int height, TextureManager &manager,
+			ThreadPool &pool, unsigned int seed,
+			BlockRegistry<accur> *sharedTypes = nullptr,
+			const std::string &name = "");
+	~World();
+
+	/*
+	 * Generates the whole world before returning
+	 */
+	void generate();
+
+	/*
+	 * Generates the world a few chunks at a time, nearest chunks to (x, y)
+	 * first. Each step() generates (on the thread pool) and adds a few so the
+	 * frame never waits, or, with setChunksPerStep(0), each call to
+	 * commitGeneratedChunks() does. That returns the number of chunks it added.
+	 */
+	void startGenerating(accur x, accur y);
+	int commitGeneratedChunks(int maxChunks);
+
+	bool isGenerating() const {
+		return generator != nullptr;
+	}
+
+	void setChunksPerStep(int chunks) {
+		generatedPerStep = chunks;
+	}
+
+	/*
+	 * Force table tiles (one per chunk) nothing has written to for this many
+	 * steps get packed in memory, and unpacked again on the next write.
+	 * 0 keeps everything unpacked.
+	 */
+	void setColdTicks(unsigned long ticks) {
+		coldTicks = ticks;
+	}
+
+	/*
+	 * Advances the physics by dt seconds. Once the world is warmed up, a
+	 * step without edits or new chunks makes no heap allocations, see
+	 * AllocationTracker.
+	 */
+	void step(accur dt);
+
+	// Edits, coordinates in pixels. They return false when nothing changed.
+	bool addBlock(accur x, accur y);
+	bool removeBlock(accur x, accur y);
+	bool rotateBlock(accur x, accur y);
+	bool addMaterial(accur x, accur y, MaterialGrid<gen>::Material material);
+	bool contains(accur x, accur y) const;
+
+	/*
+	 * Path finding towards targets (in cells), kept up to date every step.
+	 * The world owns the field until removeFlowField().
+	 */
+	FlowField<accur, gen>* addFlowField(const std::vector<Point<gen>> &targets);
+	void removeFlowField(FlowField<accur, gen> *field);
+
+	/*
+	 * Timed block logic. addBlockAction() registers what to do to a cell and
+	 * returns its id, scheduleBlockAction() runs it on (x, y) (in cells)
+	 * delay ticks from now, at the start of that step. Actions run whether or
+	 * not the cell still holds a block.
+	 */
+	int addBlockAction(const std::function<void(gen, gen)> &action);
+	void scheduleBlockAction(gen x, gen y, int action, unsigned long delay);
+
+	const TickScheduler<gen>& getScheduler() const {
+		return scheduler;
+	}
+
+	/*
+	 * Ray and line of sight queries, always in step with the block map
+	 */
+	const GridRaycaster<accur, gen>& getRaycaster() const {
+		return *raycaster;
+	}
+
+	/*
+	 * Sand and water, stepped along with the blocks
+	 */
+	MaterialGrid<gen>& getMaterials() {
+		return *materials;
+	}
+
+	// Calculations
+	void updateBlockForces();
+	void updateBlockVelocity(accur dt);
+	void updateBlockPositions(accur dt);
+	void enforceBoxBounds(); // only temporary, changes as the player moves
+
+	BlockManager<accur, gen>*& getBlockManager() {
+		return blockManager;
+	}
+
+	BlockRegistry<accur>& getBlockTypes() {
+		return blockTypes;
+	}
+
+	TextureManager& getTextureManager() {
+		return textureManager;
+	}
+
+	unsigned int getWidth() const {
+		return w;
+	}
+
+	unsigned int getHeight() const {
+		return h;
+	}
+
+	// Tick rate the force constants were tuned for
+	static constexpr int forceTuningRate = 60;
+
+	// Generated chunks added to the world per step, unless setChunksPerStep() says otherwise
+	static constexpr int chunksPerStep = 4;
+
+	// Steps before an untouched force table tile is packed, see setColdTicks()
+	static constexpr unsigned long defaultColdTicks = 600;
+	// Steps between two looks for cold tiles
+	static constexpr unsigned long coolInterval = 60;
+
+private:
+	enum StepPhase {
+		SchedulerPhase,
+		GenerationPhase,
+		ForcesPhase,
+		VelocityPhase,
+		BoundsPhase,
+		PositionsPhase,
+		MaterialsPhase,
+		FlowFieldPhase,
+		LightPhase,
+		CoolingPhase,
+		NumPhases
+	};
+
+	void wakePushedBlocks();
+	std::chrono::steady_clock::time_point endPhase(StepPhase phase,
+			std::chrono::steady_clock::time_point start);
+	void publishMetrics();
+
+	BlockRegistry<accur> ownBlockTypes;
+	BlockRegistry<accur> &blockTypes;
+	BlockManager<accur, gen> *blockManager;
+	WorldGenerator<gen> *generator;
+	std::vector<FlowField<accur, gen>*> flowFields;
+	GridRaycaster<accur, gen> *raycaster;
+	MaterialGrid<gen> *materials;
+	std::vector<Point<gen>> movingCells; // kept between steps to save the allocation
+	std::vector<char> pushed; // which of the changed cells get woken up
+	TickScheduler<gen> scheduler;
+	std::vector<std::function<void(gen, gen)>> blockActions;
+	std::mt19937 randDevice;
+	TextureManager &textureManager;
+	ThreadPool &threadPool;
+
+	accur defaultMu;
+	accur defaultBlockSize;
+
+	unsigned int w, h;
+	gen residentChunks;
+	int generatedPerStep;
+	unsigned long coldTicks;
+	unsigned long ticks;
+
+	Metrics::Counter *phaseTimes[NumPhases];
+	Metrics::Histogram *stepTime;
+	Metrics::Counter *blocksAdded, *blocksRemoved, *blocksMoved, *blocksWoken,
+			*blocksSlept, *forceCellsTouched, *coldDecodes, *coldDecodeTime;
+	Metrics::Gauge *blockCount, *magnetCount, *awakeCount, *chunksResident,
+			*poolThreads, *coldChunks, *coldRatio, *forceTableBytes;
+	// What the counters had already been given
+	BlockManager<accur, gen>::Stats publishedStats;
+	unsigned long long publishedCellsTouched;
+	unsigned long long publishedDecodes, publishedDecodeNanos;
+};
+
+#endif /* INCLUDE_WORLD_HPP_ */
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldGenerator.hpp
+ *
+ *  Created on: Oct 14, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_WORLDGENERATOR_HPP_
+#define INCLUDE_WORLDGENERATOR_HPP_
+
+#include <vector>
+#include <deque>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include <Chunk.hpp>
+#include <Point.hpp>
+#include <ThreadPool.hpp>
+
+/**
+ * Chunk based world generation.
+ *
+ * Every chunk is built from nothing but the world seed and its own
+ * coordinate, in three passes:
+ *   1. terrain - fractal value noise gives a surface height per column,
+ *      everything below it is solid
+ *   2. ores - some solid cells become magnets, drawn from the chunk's own RNG
+ *   3. structures - small stamps sat on the surface. A stamp may hang over
+ *      into the next chunk, so each chunk also replays the stamps of its
+ *      eight neighbours and keeps the cells that land inside it.
+ *
+ * Since no pass looks at another chunk's output, chunks can be generated on
+ * any number of threads in any order and still come out the same. The
+ * generator has no threads of its own, generate() splits its batch across
+ * the thread pool the world already steps with.
+ */
+template<class T>
+class WorldGenerator {
+public:
+	struct ChunkData {
+		T chunkX, chunkY;
+		// Row by row over the chunk's cells: 0 = empty, 1 + magnet direction otherwise
+		std::vector<std::uint8_t> cells;
+	};
+
+	WorldGenerator(const ChunkGrid<T> &chunkGrid, std::uint64_t worldSeed) :
+			grid(chunkGrid), seed(worldSeed) {
+	}
+
+	WorldGenerator(const WorldGenerator&) = delete;
+	WorldGenerator& operator=(const WorldGenerator&) = delete;
+
+	void generateChunk(T chunkX, T chunkY, ChunkData &out) const {
+		Point<T> start = grid.getChunkStart(chunkX, chunkY);
+		Point<T> end = grid.getChunkEnd(chunkX, chunkY);
+		T w = end.x - start.x;
+		out.chunkX = chunkX;
+		out.chunkY = chunkY;
+		out.cells.assign(w * (end.y - start.y), 0);
+
+		// Terrain
+		for (T x = start.x; x < end.x; x++) {
+			T surface = getSurfaceHeight(x);
+			for (T y = std::max(start.y, surface); y < end.y; y++) {
+				out.cells[(y - start.y) * w + (x - start.x)] = 1;
+			}
+		}
+
+		// Ores
+		std::mt19937_64 rands(getChunkSeed(chunkX, chunkY));
+		for (std::uint8_t &cell : out.cells) {
+			if (cell != 0 && below(rands, 100) < magnetPercent) {
+				cell = 2 + below(rands, 4);
+			}
+		}
+
+		// Structures, including the ones of neighbours that reach in here
+		for (T ny = chunkY - 1; ny <= chunkY + 1; ny++) {
+			for (T nx = chunkX - 1; nx <= chunkX + 1; nx++) {
+				if (grid.containsChunk(nx, ny)) {
+					stampStructure(nx, ny, start, end, out);
+				}
+			}
+		}
+	}
+
+	/*
+	 * Queues a chunk for generate()
+	 */
+	void request(T chunkX, T chunkY) {
+		pending.push_back(Point<T>(chunkX, chunkY));
+	}
+
+	/*
+	 * Generates up to maxChunks of the queued chunks in one batch on the
+	 * pool, returns how many
+	 */
+	T generate(ThreadPool &pool, T maxChunks) {
+		T count = std::min(maxChunks, (T) pending.size());
+		if (count <= 0) {
+			return 0;
+		}
+		std::size_t first = finished.size();
+		finished.resize(first + count);
+		pool.run((std::size_t) count, [&](std::size_t i) {
+			generateChunk(pending[i].x, pending[i].y, finished[first + i]);
+		});
+		pending.erase(pending.begin(), pending.begin() + count);
+		return count;
+	}
+
+	/*
+	 * Hands out generated chunks in the order they were requested, so the
+	 * world they go into is built the same way every run. Returns false if
+	 * generate() hasn't got to the next one yet.
+	 */
+	bool takeNext(ChunkData &out) {
+		if (finished.empty()) {
+			return false;
+		}
+		out = std::move(finished.front());
+		finished.pop_front();
+		return true;
+	}
+
+	bool hasOutstanding() const {
+		return !pending.empty() || !finished.empty();
+	}
+
+	/*
+	 * Surface row of a world column; cells at or below it are solid
+	 */
+	T getSurfaceHeight(T x) const {
+		T height = grid.getHeight();
+		double noise = valueNoise(x, 16, 0) * 0.65 + valueNoise(x, 5, 1) * 0.35;
+		return height / 2 + (T) (noise * height * 0.3);
+	}
+
+	std::uint64_t getChunkSeed(T chunkX, T chunkY) const {
+		return mix(
+				mix(seed ^ 0x43484E4BULL, (std::uint64_t) chunkX),
+				(std::uint64_t) chunkY);
+	}
+
+	static constexpr int magnetPercent = 6;
+	static constexpr int structurePercent = 60;
+
+private:
+	/*
+	 * The standard distributions differ between library vendors, mt19937_64 itself doesn't
+	 */
+	static T below(std::mt19937_64 &rands, T n) {
+		return (T) (rands() % (std::uint64_t) n);
+	}
+
+	// splitmix64 finaliser over (a, b)
+	static std::uint64_t mix(std::uint64_t a, std::uint64_t b) {
+		std::uint64_t z = a + 0x9E3779B97F4A7C15ULL * (b + 1);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	/*
+	 * Smoothly interpolated random values on lattice points period cells apart, in [0, 1)
+	 */
+	double valueNoise(T x, T period, std::uint64_t octave) const {
+		T cell = x >= 0 ? x / period : (x - period + 1) / period;
+		double t = (double) (x - cell * period) / period;
+		t = t * t * (3 - 2 * t);
+		double a = (mix(seed + octave, (std::uint64_t) cell) >> 11)
+				* (1.0 / 9007199254740992.0);
+		double b = (mix(seed + octave, (std::uint64_t) (cell + 1)) >> 11)
+				* (1.0 / 9007199254740992.0);
+		return a + (b - a) * t;
+	}
+
+	void stampStructure(T chunkX, T chunkY, const Point<T> &start,
+			const Point<T> &end, ChunkData &out) const {
+		// Separate stream from the ores so the two passes can change independently
+		std::mt19937_64 rands(getChunkSeed(chunkX, chunkY) ^ 0x53545255ULL);
+		if (below(rands, 100) >= structurePercent) {
+			return;
+		}
+		Point<T> chunkStart = grid.getChunkStart(chunkX, chunkY);
+		Point<T> chunkEnd = grid.getChunkEnd(chunkX, chunkY);
+		T anchorX = chunkStart.x + below(rands, chunkEnd.x - chunkStart.x);
+		const Stamp &stamp = stamps[below(rands, numStamps)];
+		T surface = getSurfaceHeight(anchorX);
+		// Only stamp in the chunk that owns the surface at that column
+		if (surface < chunkStart.y || surface >= chunkEnd.y) {
+			return;
+		}
+
+		T w = end.x - start.x;
+		for (T row = 0; row < stamp.height; row++) {
+			T y = surface - stamp.height + row;
+			for (T col = 0; stamp.rows[row][col] != '\0'; col++) {
+				T x = anchorX + col;
+				if (x < start.x || x >= end.x || y < start.y || y >= end.y) {
+					continue;
+				}
+				out.cells[(y - start.y) * w + (x - start.x)] = stampCell(
+						stamp.rows[row][col]);
+			}
+		}
+	}
+
+	struct Stamp {
+		T height;
+		const char *rows[4];
+	};
+
+	/*
+	 * '#' block, '.' carved out, '^' 'v' '<' '>' magnets facing that way
+	 */
+	static std::uint8_t stampCell(char c) {
+		switch (c) {
+		case '#':
+			return 1;
+		case '^':
+			return 2;
+		case 'v':
+			return 3;
+		case '<':
+			return 4;
+		case '>':
+			return 5;
+		default:
+			return 0;
+		}
+	}
+
+	static constexpr int numStamps = 3;
+	static constexpr Stamp stamps[numStamps] = {
+			{ 3, { "^", "#", "#" } },
+			{ 3, { ">##<", "#..#", "#..#" } },
+			{ 2, { "v#v", "###" } } };
+
+	ChunkGrid<T> grid;
+	std::uint64_t seed;
+
+	std::deque<Point<T>> pending;
+	std::deque<ChunkData> finished;
+};
+
+#endif /* INCLUDE_WORLDGENERATOR_HPP_ */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldHistory.hpp
+ *
+ *  Created on: Oct 21, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_WORLDHISTORY_HPP_
+#define INCLUDE_WORLDHISTORY_HPP_
+
+#include <vector>
+#include <cstddef>
+
+#include <World.hpp>
+
+/**
+ * The last few states of a world, for undo and for rewinding the simulation.
+ *
+ * Snapshots live in a ring of capacity entries; recording into a full ring
+ * drops the oldest one. Consecutive snapshots share every chunk that did not
+ * change in between (see BlockManager::takeSnapshot), so the history costs
+ * about as much as what changed, however big the world is.
+ */
+class WorldHistory {
+public:
+	WorldHistory(World &world, std::size_t capacity);
+
+	/*
+	 * Remembers the world as it is now
+	 */
+	void record();
+
+	/*
+	 * Puts the world back to the snapshot recorded steps records ago (1 is
+	 * the latest) and forgets it and everything newer. Returns false, and
+	 * leaves the world alone, when the history isn't that long.
+	 */
+	bool rewind(std::size_t steps);
+
+	void clear();
+
+	std::size_t getSize() const {
+		return size;
+	}
+
+	std::size_t getCapacity() const {
+		return ring.size();
+	}
+
+	/*
+	 * Bytes held by the snapshots, counting shared chunks once
+	 */
+	std::size_t getMemoryUsage() const;
+
+private:
+	typedef BlockManager<accur, gen>::Snapshot Snapshot;
+
+	// Position of the snapshot recorded back records ago (0 is the latest)
+	std::size_t getSlot(std::size_t back) const {
+		return (newest + ring.size() - back) % ring.size();
+	}
+
+	World &world;
+	std::vector<Snapshot> ring;
+	std::size_t newest, size;
+};
+
+#endif /* INCLUDE_WORLDHISTORY_HPP_ */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldHost.hpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_WORLDHOST_HPP_
+#define INCLUDE_WORLDHOST_HPP_
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstddef>
+
+#include <World.hpp>
+#include <TextureManager.hpp>
+#include <ThreadPool.hpp>
+#include <BlockType.hpp>
+#include <Metrics.hpp>
+
+/**
+ * Runs many independent worlds (test shards, player instances) in one
+ * process. The worlds share the TextureManager and one set of block types,
+ * everything else is their own.
+ *
+ * Each world belongs to one lane, a thread of its own that steps the same
+ * worlds every tick, so a world's blocks stay in that core's caches. Worlds
+ * go to the lane with the fewest cells. A lane steps its worlds one after
+ * the other with an inline ThreadPool, so the parallelism comes from the
+ * worlds rather than from inside a step, and there are never more threads
+ * than lanes.
+ *
+ * On Linux lane i is pinned to CPU i (modulo the CPU count).
+ */
+class WorldHost {
+public:
+	/*
+	 * numLanes = 0 uses one lane per hardware thread
+	 */
+	WorldHost(TextureManager &manager, unsigned int numLanes = 0);
+	~WorldHost();
+
+	WorldHost(const WorldHost&) = delete;
+	WorldHost& operator=(const WorldHost&) = delete;
+
+	/*
+	 * Adds a world of width x height pixels, generated right away, and
+	 * returns its index. Not while step() is running.
+	 */
+	std::size_t addWorld(unsigned int width, unsigned int height,
+			unsigned int seed);
+
+	/*
+	 * Steps every world ticks times, returns once all of them are done.
+	 * Rethrows the first exception a world threw.
+	 */
+	void step(accur dt, unsigned int ticks = 1);
+
+	World& getWorld(std::size_t index) {
+		return *worlds[index].world;
+	}
+
+	std::size_t getWorldCount() const {
+		return worlds.size();
+	}
+
+	unsigned int getLane(std::size_t index) const {
+		return worlds[index].lane;
+	}
+
+	unsigned int getNumLanes() const {
+		return (unsigned int) lanes.size();
+	}
+
+	BlockRegistry<accur>& getBlockTypes() {
+		return blockTypes;
+	}
+
+private:
+	struct Lane {
+		std::thread thread;
+		// Runs everything inline, the lane's worlds never share it with another thread
+		ThreadPool pool { 0 };
+		std::vector<World*> worlds;
+		std::size_t cells = 0;
+		std::exception_ptr error;
+		Metrics::Counter *busyTime;
+	};
+
+	struct Hosted {
+		std::unique_ptr<World> world;
+		unsigned int lane;
+	};
+
+	void laneLoop(unsigned int index);
+
+	TextureManager &textureManager;
+	BlockRegistry<accur> blockTypes;
+	std::vector<std::unique_ptr<Lane>> lanes;
+	std::vector<Hosted> worlds;
+
+	std::mutex mutex;
+	std::condition_variable wakeUp, stepDone;
+	accur stepDt;
+	unsigned int stepTicks;
+	unsigned long stepId;
+	unsigned int lanesRunning;
+	bool stopping;
+
+	Metrics::Gauge *worldCount;
+};
+
+#endif /* INCLUDE_WORLDHOST_HPP_ */
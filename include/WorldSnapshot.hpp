@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldSnapshot.hpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#ifndef INCLUDE_WORLDSNAPSHOT_HPP_
+#define INCLUDE_WORLDSNAPSHOT_HPP_
+
+#include <vector>
+#include <cstdint>
+
+#include <World.hpp>
+
+/**
+ * Quantised copy of a world's blocks at one tick, one entry per cell.
+ * Positions are stored relative to their cell in 1/256 pixels and
+ * velocities in 1/256 pixels per second, which is all the precision
+ * replication and replays need.
+ */
+class WorldSnapshot {
+public:
+	WorldSnapshot();
+
+	/*
+	 * Copies the state of every cell of the world
+	 */
+	void capture(World &world, unsigned long tickNumber);
+
+	/*
+	 * Same size as the world, everything empty
+	 */
+	void resize(gen cellsWide, gen cellsHigh, gen bSize);
+
+	/*
+	 * Bytes a plain dump of this snapshot takes: one state byte per cell
+	 * and four 32-bit numbers per block
+	 */
+	std::size_t getNaiveSize() const;
+
+	// 0 = empty, 1 + magnet direction otherwise
+	std::vector<std::uint8_t> states;
+	std::vector<std::int32_t> offsetX, offsetY;
+	std::vector<std::int32_t> velocityX, velocityY;
+
+	unsigned long tick;
+	gen width, height;
+	gen blockSize;
+};
+
+#endif /* INCLUDE_WORLDSNAPSHOT_HPP_ */
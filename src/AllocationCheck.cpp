@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * AllocationCheck.cpp
+ *
+ *  Created on: Oct 28, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <World.hpp>
+#include <TextureManager.hpp>
+#include <ThreadPool.hpp>
+#include <AllocationTracker.hpp>
+
+/*
+ * enemycraft-alloccheck [width] [height] [warm up ticks] [checked ticks] [--strict]
+ * Generates a world (in pixels, like the server), adds a flow field and
+ * some sand and water, lets it settle for the warm up ticks and then fails
+ * if any of the checked ticks allocates on the heap. The warm up has to be
+ * long enough for the kept buffers (and spare blocks) to grow to what the
+ * world needs, growing one is an allocation too. With --strict it
+ * aborts at the first such allocation instead, for a debugger or core dump
+ * to show where it came from.
+ *
+ * Only a build with ENEMYCRAFT_TRACK_ALLOCATIONS can count allocations.
+ */
+int main(int argc, char **argv) {
+	std::vector<std::string> args(argv + 1, argv + argc);
+	bool strict = std::find(args.begin(), args.end(), "--strict") != args.end();
+	args.erase(std::remove(args.begin(), args.end(), "--strict"), args.end());
+	unsigned int width = args.size() > 0 ? std::stoi(args[0]) : 1920;
+	unsigned int height = args.size() > 1 ? std::stoi(args[1]) : 1080;
+	unsigned int warmUpTicks = args.size() > 2 ? std::stoi(args[2]) : 3000;
+	unsigned int checkedTicks = args.size() > 3 ? std::stoi(args[3]) : 600;
+
+	if (!AllocationTracker::enabled) {
+		std::cerr << "Built without ENEMYCRAFT_TRACK_ALLOCATIONS, nothing to count"
+				<< std::endl;
+		return 2;
+	}
+
+	TextureManager textureManager;
+	ThreadPool threadPool;
+	World world(width, height, textureManager, threadPool, 1);
+	world.generate();
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	gen cellsX = blockManager->getWidth(), cellsY = blockManager->getHeight();
+	gen blockSize = blockManager->getBlockSize();
+	world.addFlowField( { Point<gen>(cellsX / 2, cellsY / 2) });
+	for (gen x = cellsX / 4; x < cellsX / 4 + 6 && x < cellsX; x++) {
+		for (gen y = 0; y < 4 && y < cellsY; y++) {
+			world.addMaterial((accur) (x * blockSize), (accur) (y * blockSize),
+					y % 2 == 0 ? MaterialGrid<gen>::Sand : MaterialGrid<gen>::Water);
+		}
+	}
+
+	accur dt = (accur) 1 / (accur) 60;
+	for (unsigned int i = 0; i < warmUpTicks; i++) {
+		world.step(dt);
+	}
+
+	AllocationTracker::setStrict(strict);
+	AllocationTracker::endFrame();
+	unsigned int allocatingTicks = 0;
+	AllocationTracker::Counts checked[AllocationTracker::NumSubsystems];
+	for (unsigned int i = 0; i < checkedTicks; i++) {
+		world.step(dt);
+		AllocationTracker::endFrame();
+		bool allocated = false;
+		for (int s = 0; s < AllocationTracker::NumSubsystems; s++) {
+			AllocationTracker::Counts tick = AllocationTracker::getFrame(
+					(AllocationTracker::Subsystem) s);
+			checked[s].allocations += tick.allocations;
+			checked[s].bytes += tick.bytes;
+			allocated = allocated
+					|| (s != AllocationTracker::Untracked && tick.allocations > 0);
+		}
+		allocatingTicks += allocated ? 1 : 0;
+	}
+	AllocationTracker::setStrict(false);
+
+	std::cout << checkedTicks << " ticks after " << warmUpTicks
+			<< " to warm up, " << blockManager->getOccupancy().getCount()
+			<< " blocks (" << blockManager->getOccupancy().getAwakeCount()
+			<< " moving)" << std::endl;
+	for (int s = 1; s < AllocationTracker::NumSubsystems; s++) {
+		if (checked[s].allocations > 0) {
+			std::cout << "  " << AllocationTracker::getName(
+					(AllocationTracker::Subsystem) s) << ": "
+					<< checked[s].allocations << " allocations, "
+					<< checked[s].bytes << " bytes" << std::endl;
+		}
+	}
+	if (allocatingTicks > 0) {
+		std::cout << allocatingTicks << " ticks allocated" << std::endl;
+		return 1;
+	}
+	std::cout << "No allocations" << std::endl;
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * AllocationTracker.cpp
+ *
+ *  Created on: Oct 28, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <new>
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include <AllocationTracker.hpp>
+#include <Metrics.hpp>
+
+static AllocationTracker::Counts frameStart[AllocationTracker::NumSubsystems];
+static AllocationTracker::Counts lastFrame[AllocationTracker::NumSubsystems];
+
+void AllocationTracker::endFrame() {
+	if (!enabled) {
+		return;
+	}
+	static Metrics::Gauge *frameAllocations[NumSubsystems];
+	if (frameAllocations[0] == nullptr) {
+		for (int i = 0; i < NumSubsystems; i++) {
+			frameAllocations[i] = &Metrics::gauge("enemycraft_frame_allocations",
+					"Heap allocations made in the last frame",
+					std::string("subsystem=\"") + getName((Subsystem) i) + "\"");
+		}
+	}
+	for (int i = 0; i < NumSubsystems; i++) {
+		Counts total = getTotal((Subsystem) i);
+		lastFrame[i].allocations = total.allocations - frameStart[i].allocations;
+		lastFrame[i].frees = total.frees - frameStart[i].frees;
+		lastFrame[i].bytes = total.bytes - frameStart[i].bytes;
+		frameStart[i] = total;
+		frameAllocations[i]->set((double) lastFrame[i].allocations);
+	}
+}
+
+AllocationTracker::Counts AllocationTracker::getFrame(Subsystem subsystem) {
+	return lastFrame[subsystem];
+}
+
+const char* AllocationTracker::getName(Subsystem subsystem) {
+	static const char *names[NumSubsystems] = { "untracked", "simulation",
+			"forces", "light", "materials", "flowfields", "networking",
+			"rendering", "effects" };
+	return names[subsystem];
+}
+
+#ifdef ENEMYCRAFT_TRACK_ALLOCATIONS
+
+/*
+ * Plain relaxed atomics: this is a diagnostic build, what matters is that
+ * nothing in here allocates itself
+ */
+static std::atomic<std::uint64_t> allocations[AllocationTracker::NumSubsystems];
+static std::atomic<std::uint64_t> frees[AllocationTracker::NumSubsystems];
+static std::atomic<std::uint64_t> allocatedBytes[AllocationTracker::NumSubsystems];
+static std::atomic<bool> strictMode(false);
+static thread_local AllocationTracker::Tag currentTag = {
+		AllocationTracker::Untracked, false };
+
+AllocationTracker::Counts AllocationTracker::getTotal(Subsystem subsystem) {
+	Counts counts;
+	counts.allocations = allocations[subsystem].load(std::memory_order_relaxed);
+	counts.frees = frees[subsystem].load(std::memory_order_relaxed);
+	counts.bytes = allocatedBytes[subsystem].load(std::memory_order_relaxed);
+	return counts;
+}
+
+AllocationTracker::Tag AllocationTracker::getTag() {
+	return currentTag;
+}
+
+void AllocationTracker::setTag(const Tag &tag) {
+	currentTag = tag;
+}
+
+void AllocationTracker::setStrict(bool strict) {
+	strictMode = strict;
+}
+
+void AllocationTracker::recordAllocation(std::size_t bytes) {
+	Tag tag = currentTag;
+	if (tag.forbidden && strictMode.load(std::memory_order_relaxed)) {
+		// No iostreams here, they might allocate
+		std::fputs("Heap allocation in a no allocation scope of ", stderr);
+		std::fputs(getName(tag.subsystem), stderr);
+		std::fputs("\n", stderr);
+		std::abort();
+	}
+	allocations[tag.subsystem].fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes[tag.subsystem].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void AllocationTracker::recordFree() {
+	frees[currentTag.subsystem].fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* allocate(std::size_t size) {
+	AllocationTracker::recordAllocation(size);
+	void *memory = std::malloc(size > 0 ? size : 1);
+	if (memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+static void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+	AllocationTracker::recordAllocation(size);
+	std::size_t align = (std::size_t) alignment;
+	// aligned_alloc() wants a multiple of the alignment
+	void *memory = std::aligned_alloc(align,
+			(size + align - 1) / align * align + (size == 0 ? align : 0));
+	if (memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+static void release(void *memory) {
+	if (memory != nullptr) {
+		AllocationTracker::recordFree();
+		std::free(memory);
+	}
+}
+
+void* operator new(std::size_t size) {
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+	return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return allocateAligned(size, alignment);
+}
+
+void operator delete(void *memory) noexcept {
+	release(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+	release(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+	release(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+	release(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t&) noexcept {
+	release(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t&) noexcept {
+	release(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept {
+	release(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept {
+	release(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept {
+	release(memory);
+}
+
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept {
+	release(memory);
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ChunkCodec.cpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+
+#include <ChunkCodec.hpp>
+
+static constexpr unsigned int maxLiteral = 128, maxRun = 64, minMatch = 3,
+		maxMatch = 66, maxDistance = 256;
+
+void ChunkCodec::encode(const std::uint32_t *values, unsigned int count,
+		std::vector<std::uint8_t> &out) {
+	if (count > maxValues) {
+		throw std::invalid_argument(
+				"Too many values for a chunk: " + std::to_string(count));
+	}
+	// No more distinct values than cells, so an index always fits in a byte
+	std::uint32_t palette[maxValues];
+	std::uint8_t indices[maxValues];
+	unsigned int paletteSize = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int entry = 0;
+		while (entry < paletteSize && palette[entry] != values[i]) {
+			entry++;
+		}
+		if (entry == paletteSize) {
+			palette[paletteSize++] = values[i];
+		}
+		indices[i] = (std::uint8_t) entry;
+	}
+	if (paletteSize == 0) {
+		palette[paletteSize++] = 0;
+	}
+	out.push_back((std::uint8_t) (paletteSize - 1));
+	for (unsigned int i = 0; i < paletteSize; i++) {
+		for (int shift = 0; shift < 32; shift += 8) {
+			out.push_back((std::uint8_t) (palette[i] >> shift));
+		}
+	}
+	// Every index is 0, nothing more to say
+	if (paletteSize == 1) {
+		return;
+	}
+
+	// Greedy: whichever of a run and the longest match covers more, literals otherwise
+	std::size_t literalToken = 0;
+	unsigned int literals = 0;
+	unsigned int i = 0;
+	while (i < count) {
+		unsigned int run = 0;
+		if (i > 0) {
+			while (i + run < count && run < maxRun
+					&& indices[i + run] == indices[i - 1]) {
+				run++;
+			}
+		}
+		unsigned int match = 0, distance = 0;
+		for (unsigned int d = 2; d <= i && d <= maxDistance; d++) {
+			unsigned int length = 0;
+			while (i + length < count && length < maxMatch
+					&& indices[i + length] == indices[i + length - d]) {
+				length++;
+			}
+			if (length > match) {
+				match = length;
+				distance = d;
+			}
+		}
+		if (run >= 2 && run + 1 >= match) {
+			out.push_back((std::uint8_t) (0x80 + run - 1));
+			literals = 0;
+			i += run;
+		} else if (match >= minMatch) {
+			out.push_back((std::uint8_t) (0xC0 + match - minMatch));
+			out.push_back((std::uint8_t) (distance - 1));
+			literals = 0;
+			i += match;
+		} else {
+			if (literals == 0 || literals == maxLiteral) {
+				literalToken = out.size();
+				out.push_back(0);
+				literals = 0;
+			}
+			out[literalToken] = (std::uint8_t) literals;
+			out.push_back(indices[i]);
+			literals++;
+			i++;
+		}
+	}
+}
+
+const std::uint8_t* ChunkCodec::decodeIndices(const std::uint8_t *in,
+		std::uint8_t *indices, unsigned int last) {
+	unsigned int i = 0;
+	while (i <= last) {
+		std::uint8_t token = *in++;
+		if (token < 0x80) {
+			for (unsigned int n = 0; n <= token; n++) {
+				indices[i++] = *in++;
+			}
+		} else if (token < 0xC0) {
+			std::uint8_t previous = indices[i - 1];
+			for (unsigned int n = 0; n <= (unsigned int) (token - 0x80); n++) {
+				indices[i++] = previous;
+			}
+		} else {
+			unsigned int distance = (unsigned int) *in++ + 1;
+			unsigned int length = token - 0xC0 + minMatch;
+			// Overlapping copies repeat the pattern, so it goes one index at a time
+			for (unsigned int n = 0; n < length; n++, i++) {
+				indices[i] = indices[i - distance];
+			}
+		}
+	}
+	return in;
+}
+
+std::size_t ChunkCodec::decode(const std::uint8_t *in, std::uint32_t *values,
+		unsigned int count) {
+	const std::uint8_t *start = in;
+	unsigned int paletteSize = (unsigned int) *in++ + 1;
+	const std::uint8_t *palette = in;
+	in += paletteSize * 4;
+	std::uint8_t indices[maxValues];
+	if (paletteSize == 1) {
+		std::fill_n(indices, count, 0);
+	} else if (count > 0) {
+		in = decodeIndices(in, indices, count - 1);
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		const std::uint8_t *entry = palette + indices[i] * 4;
+		values[i] = (std::uint32_t) entry[0] | (std::uint32_t) entry[1] << 8
+				| (std::uint32_t) entry[2] << 16 | (std::uint32_t) entry[3] << 24;
+	}
+	return in - start;
+}
+
+std::uint32_t ChunkCodec::decodeAt(const std::uint8_t *in, unsigned int index) {
+	unsigned int paletteSize = (unsigned int) *in++ + 1;
+	const std::uint8_t *palette = in;
+	in += paletteSize * 4;
+	std::uint8_t indices[maxValues];
+	if (paletteSize == 1) {
+		indices[index] = 0;
+	} else {
+		decodeIndices(in, indices, index);
+	}
+	const std::uint8_t *entry = palette + indices[index] * 4;
+	return (std::uint32_t) entry[0] | (std::uint32_t) entry[1] << 8
+			| (std::uint32_t) entry[2] << 16 | (std::uint32_t) entry[3] << 24;
+}
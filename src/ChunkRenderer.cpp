@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ChunkRenderer.cpp
+ *
+ *  Created on: Oct 15, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <algorithm>
+
+#include <ChunkRenderer.hpp>
+
+ChunkRenderer::ChunkRenderer() :
+		atlas(nullptr), useBuffers(sf::VertexBuffer::isAvailable()), frame(0), rebuiltChunks(
+				0), dynamicChunks(0) {
+}
+
+void ChunkRenderer::update(World &world, const sf::FloatRect &view,
+		float alpha) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	if (layers.size() != (std::size_t) grid.getChunkCount()) {
+		layers = std::vector<ChunkLayer>(grid.getChunkCount());
+	}
+	atlas = &world.getTextureManager().getAtlas();
+	cachedInView.clear();
+	dynamicVertices.clear();
+	rebuiltChunks = 0;
+	dynamicChunks = 0;
+	frame++;
+
+	float chunkPixels = (float) (ChunkGrid<gen>::chunkSize
+			* blockManager->getBlockSize());
+	gen firstX = std::max((gen) (view.left / chunkPixels), 0);
+	gen firstY = std::max((gen) (view.top / chunkPixels), 0);
+	gen lastX = std::min((gen) ((view.left + view.width) / chunkPixels),
+			grid.getChunksX() - 1);
+	gen lastY = std::min((gen) ((view.top + view.height) / chunkPixels),
+			grid.getChunksY() - 1);
+	for (gen chunkY = firstY; chunkY <= lastY; chunkY++) {
+		for (gen chunkX = firstX; chunkX <= lastX; chunkX++) {
+			gen index = grid.getChunkIndexOf(chunkX, chunkY);
+			ChunkLayer &layer = layers[index];
+			unsigned long revision = blockManager->getChunkRevision(index);
+			unsigned long lightRevision =
+					blockManager->getLight().getChunkRevision(index);
+			unsigned long materialRevision =
+					world.getMaterials().getChunkRevision(index);
+			bool changed = revision != layer.revision
+					|| lightRevision != layer.lightRevision
+					|| materialRevision != layer.materialRevision;
+			layer.revision = revision;
+			layer.lightRevision = lightRevision;
+			layer.materialRevision = materialRevision;
+			if (changed) {
+				layer.hot = frame - layer.lastChange <= coolFrames;
+				layer.lastChange = frame;
+			} else if (frame - layer.lastChange > coolFrames) {
+				layer.hot = false;
+			}
+
+			if (layer.hot) {
+				appendChunk(dynamicVertices, world, index, alpha);
+				layer.valid = false;
+				dynamicChunks++;
+				continue;
+			}
+			if (changed || !layer.valid) {
+				rebuild(layer, world, index);
+			}
+			if (!layer.vertices.empty()) {
+				cachedInView.push_back(index);
+			}
+		}
+	}
+}
+
+void ChunkRenderer::draw(sf::RenderTarget &target,
+		sf::RenderStates states) const {
+	states.texture = atlas;
+	for (gen index : cachedInView) {
+		const ChunkLayer &layer = layers[index];
+		if (useBuffers) {
+			target.draw(layer.buffer, states);
+		} else {
+			target.draw(layer.vertices.data(), layer.vertices.size(), sf::Quads,
+					states);
+		}
+	}
+	if (!dynamicVertices.empty()) {
+		target.draw(dynamicVertices.data(), dynamicVertices.size(), sf::Quads,
+				states);
+	}
+}
+
+void ChunkRenderer::rebuild(ChunkLayer &layer, World &world, gen chunkIndex) {
+	layer.vertices.clear();
+	appendChunk(layer.vertices, world, chunkIndex, 1);
+	if (useBuffers && !layer.vertices.empty()) {
+		if (layer.buffer.getVertexCount() != layer.vertices.size()) {
+			layer.buffer.setPrimitiveType(sf::Quads);
+			layer.buffer.setUsage(sf::VertexBuffer::Static);
+			layer.buffer.create(layer.vertices.size());
+		}
+		layer.buffer.update(layer.vertices.data());
+	}
+	layer.valid = true;
+	rebuiltChunks++;
+}
+
+void ChunkRenderer::appendChunk(std::vector<sf::Vertex> &vertices,
+		World &world, gen chunkIndex, float alpha) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	const OccupancyMap<gen> &occupancy = blockManager->getOccupancy();
+	const LightMap<gen> &light = blockManager->getLight();
+	TextureManager &textureManager = world.getTextureManager();
+	gen blockSize = blockManager->getBlockSize();
+
+	Point<gen> chunk = grid.getChunkCoord(chunkIndex);
+	Point<gen> start = grid.getChunkStart(chunk.x, chunk.y);
+	Point<gen> end = grid.getChunkEnd(chunk.x, chunk.y);
+	occupancy.getOccupied().forEachInRect(start.x, start.y, end.x, end.y,
+			[&](gen x, gen y) {
+				const BlockType<accur> &type = *blockManager->getCellType(x, y);
+				int direction = blockManager->getCellKind(x, y);
+				// Resting blocks sit right on their cell
+				float left = (float) (x * blockSize), top = (float) (y * blockSize);
+				if (occupancy.testAwake(x, y)) {
+					Block<accur> *block = blockManager->getAwakeBlock(x, y);
+					const Point<accur> &now = block->getCoord();
+					const Point<accur> &before = block->getPreviousCoord();
+					left = (float) before.x + ((float) now.x - (float) before.x) * alpha;
+					top = (float) before.y + ((float) now.y - (float) before.y) * alpha;
+				}
+				float size = (float) type.length;
+				const sf::IntRect &rect = textureManager.getTileRect(
+						type.tiles[direction]);
+				float u0 = (float) rect.left, v0 = (float) rect.top;
+				float u1 = u0 + rect.width, v1 = v0 + rect.height;
+				sf::Uint8 brightness = (sf::Uint8) (minBrightness
+						+ (255 - minBrightness) * light.getLevel(x, y)
+								/ LightMap<gen>::maxLight);
+				sf::Color color(brightness, brightness, brightness);
+				vertices.emplace_back(sf::Vector2f(left, top), color,
+						sf::Vector2f(u0, v0));
+				vertices.emplace_back(sf::Vector2f(left + size, top), color,
+						sf::Vector2f(u1, v0));
+				vertices.emplace_back(sf::Vector2f(left + size, top + size), color,
+						sf::Vector2f(u1, v1));
+				vertices.emplace_back(sf::Vector2f(left, top + size), color,
+						sf::Vector2f(u0, v1));
+			});
+	appendMaterials(vertices, world, chunkIndex);
+}
+
+/*
+ * Materials are drawn as the plain block tile, tinted
+ */
+void ChunkRenderer::appendMaterials(std::vector<sf::Vertex> &vertices,
+		World &world, gen chunkIndex) {
+	static const sf::Color colors[MaterialGrid<gen>::NumMaterials] = {
+			sf::Color(0, 0, 0, 0), sf::Color(64, 110, 230, 200), sf::Color(
+					220, 190, 120) };
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	const OccupancyMap<gen> &occupancy = blockManager->getOccupancy();
+	const LightMap<gen> &light = blockManager->getLight();
+	const MaterialGrid<gen> &materials = world.getMaterials();
+	gen blockSize = blockManager->getBlockSize();
+	const sf::IntRect &rect = world.getTextureManager().getBlockRect(
+			TextureManager::NormalBlock);
+	float u0 = (float) rect.left, v0 = (float) rect.top;
+	float u1 = u0 + rect.width, v1 = v0 + rect.height;
+	float size = (float) blockSize;
+
+	Point<gen> chunk = grid.getChunkCoord(chunkIndex);
+	Point<gen> start = grid.getChunkStart(chunk.x, chunk.y);
+	Point<gen> end = grid.getChunkEnd(chunk.x, chunk.y);
+	for (gen y = start.y; y < end.y; y++) {
+		for (gen x = start.x; x < end.x; x++) {
+			MaterialGrid<gen>::Material material = materials.get(x, y);
+			if (material == MaterialGrid<gen>::Empty || occupancy.test(x, y)) {
+				continue;
+			}
+			int level = minBrightness
+					+ (255 - minBrightness) * light.getLevel(x, y)
+							/ LightMap<gen>::maxLight;
+			const sf::Color &base = colors[material];
+			sf::Color color((sf::Uint8) (base.r * level / 255),
+					(sf::Uint8) (base.g * level / 255),
+					(sf::Uint8) (base.b * level / 255), base.a);
+			float left = (float) (x * blockSize), top = (float) (y * blockSize);
+			vertices.emplace_back(sf::Vector2f(left, top), color,
+					sf::Vector2f(u0, v0));
+			vertices.emplace_back(sf::Vector2f(left + size, top), color,
+					sf::Vector2f(u1, v0));
+			vertices.emplace_back(sf::Vector2f(left + size, top + size), color,
+					sf::Vector2f(u1, v1));
+			vertices.emplace_back(sf::Vector2f(left, top + size), color,
+					sf::Vector2f(u0, v1));
+		}
+	}
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * DeltaCodec.cpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <algorithm>
+
+#include <DeltaCodec.hpp>
+#include <NetProtocol.hpp>
+
+// Varint groups of the quantised differences
+static const int quantaBits = 3;
+
+SnapshotEncoder::SnapshotEncoder(std::size_t historySize, int offsetGrid,
+		int velocityGrid) :
+		baselineValid(false), maxHistory(historySize), offsetSteps(
+				offsetGrid), velocitySteps(velocityGrid) {
+}
+
+void SnapshotEncoder::encode(const WorldSnapshot &current,
+		std::vector<std::uint8_t> &out) {
+	sent.push_back(current);
+	encodeDelta(baselineValid ? &baseline : nullptr, sent.back(), out,
+			offsetSteps, velocitySteps);
+	if (sent.size() > maxHistory) {
+		sent.pop_front();
+	}
+}
+
+void SnapshotEncoder::acknowledge(unsigned long tick) {
+	if (baselineValid && tick <= baseline.tick) {
+		return;
+	}
+	while (!sent.empty() && sent.front().tick < tick) {
+		sent.pop_front();
+	}
+	if (!sent.empty() && sent.front().tick == tick) {
+		baseline = std::move(sent.front());
+		baselineValid = true;
+		sent.pop_front();
+	}
+}
+
+void SnapshotEncoder::reset() {
+	baselineValid = false;
+	sent.clear();
+}
+
+/*
+ * Difference in whole quanta, rounded to the nearest one
+ */
+static std::int32_t toQuanta(std::int32_t difference, std::int32_t quantum) {
+	return difference >= 0 ?
+			(difference + quantum / 2) / quantum :
+			-((quantum / 2 - difference) / quantum);
+}
+
+/*
+ * Whether a value is a whole quantum or more away from the receiver's
+ */
+static bool hasMoved(std::int32_t value, std::int32_t base,
+		std::int32_t quantum) {
+	return value - base >= quantum || base - value >= quantum;
+}
+
+void SnapshotEncoder::encodeDelta(const WorldSnapshot *baseline,
+		WorldSnapshot &current, std::vector<std::uint8_t> &out, int offsetSteps,
+		int velocitySteps) {
+	if (baseline != nullptr
+			&& (baseline->width != current.width
+					|| baseline->height != current.height)) {
+		baseline = nullptr;
+	}
+	std::int32_t offsetQuantum = std::max<std::int32_t>(1,
+			current.blockSize * positionScale / offsetSteps);
+	std::int32_t velocityQuantum = std::max<std::int32_t>(1,
+			current.blockSize * positionScale / velocitySteps);
+	BitWriter writer(out);
+	writer.writeVarint(current.tick);
+	writer.writeVarint(baseline != nullptr ? baseline->tick + 1 : 0);
+	writer.writeVarint(current.width);
+	writer.writeVarint(current.height);
+	writer.writeVarint(current.blockSize);
+	writer.writeVarint(offsetQuantum);
+	writer.writeVarint(velocityQuantum);
+
+	std::size_t cells = current.states.size();
+	std::size_t previous = (std::size_t) -1;
+	for (std::size_t i = 0; i < cells; i++) {
+		std::uint8_t baseState = baseline ? baseline->states[i] : 0;
+		std::int32_t baseOffsetX = baseline ? baseline->offsetX[i] : 0;
+		std::int32_t baseOffsetY = baseline ? baseline->offsetY[i] : 0;
+		std::int32_t baseVelocityX = baseline ? baseline->velocityX[i] : 0;
+		std::int32_t baseVelocityY = baseline ? baseline->velocityY[i] : 0;
+
+		bool stateChanged = current.states[i] != baseState;
+		bool offsetChanged = hasMoved(current.offsetX[i], baseOffsetX,
+				offsetQuantum)
+				|| hasMoved(current.offsetY[i], baseOffsetY, offsetQuantum);
+		bool velocityChanged = hasMoved(current.velocityX[i], baseVelocityX,
+				velocityQuantum)
+				|| hasMoved(current.velocityY[i], baseVelocityY, velocityQuantum);
+		std::int32_t offsetX = offsetChanged ?
+				toQuanta(current.offsetX[i] - baseOffsetX, offsetQuantum) : 0;
+		std::int32_t offsetY = offsetChanged ?
+				toQuanta(current.offsetY[i] - baseOffsetY, offsetQuantum) : 0;
+		std::int32_t velocityX = velocityChanged ?
+				toQuanta(current.velocityX[i] - baseVelocityX, velocityQuantum) : 0;
+		std::int32_t velocityY = velocityChanged ?
+				toQuanta(current.velocityY[i] - baseVelocityY, velocityQuantum) : 0;
+		// From here on current holds what the receiver decodes
+		current.offsetX[i] = baseOffsetX + offsetX * offsetQuantum;
+		current.offsetY[i] = baseOffsetY + offsetY * offsetQuantum;
+		current.velocityX[i] = baseVelocityX + velocityX * velocityQuantum;
+		current.velocityY[i] = baseVelocityY + velocityY * velocityQuantum;
+		if (!stateChanged && !offsetChanged && !velocityChanged) {
+			continue;
+		}
+		writer.writeVarint(i - previous);
+		previous = i;
+		writer.writeBool(stateChanged);
+		writer.writeBool(offsetChanged);
+		writer.writeBool(velocityChanged);
+		if (stateChanged) {
+			writer.writeBits(current.states[i], 3);
+		}
+		if (offsetChanged) {
+			writer.writeSignedVarint(offsetX, quantaBits);
+			writer.writeSignedVarint(offsetY, quantaBits);
+		}
+		if (velocityChanged) {
+			writer.writeSignedVarint(velocityX, quantaBits);
+			writer.writeSignedVarint(velocityY, quantaBits);
+		}
+	}
+	writer.writeVarint(0);
+	writer.flush();
+}
+
+SnapshotDecoder::SnapshotDecoder(std::size_t historySize) :
+		maxHistory(historySize) {
+}
+
+bool SnapshotDecoder::decode(const std::uint8_t *data, std::size_t size,
+		WorldSnapshot &out) {
+	unsigned long baselineTick;
+	const WorldSnapshot *baseline = nullptr;
+	if (peekBaseline(data, size, baselineTick)) {
+		for (const WorldSnapshot &snapshot : history) {
+			if (snapshot.tick == baselineTick) {
+				baseline = &snapshot;
+				break;
+			}
+		}
+		if (baseline == nullptr) {
+			return false;
+		}
+	}
+	BitReader reader(data, size);
+	if (!decodeDelta(baseline, reader, out)) {
+		return false;
+	}
+	if (history.empty() || out.tick > history.back().tick) {
+		history.push_back(out);
+		if (history.size() > maxHistory) {
+			history.pop_front();
+		}
+	}
+	return true;
+}
+
+bool SnapshotDecoder::peekBaseline(const std::uint8_t *data, std::size_t size,
+		unsigned long &baselineTick) {
+	BitReader reader(data, size);
+	reader.readVarint();
+	std::uint32_t base = reader.readVarint();
+	if (!reader.isValid() || base == 0) {
+		return false;
+	}
+	baselineTick = base - 1;
+	return true;
+}
+
+bool SnapshotDecoder::decodeDelta(const WorldSnapshot *baseline,
+		BitReader &reader, WorldSnapshot &out) {
+	unsigned long tick = reader.readVarint();
+	reader.readVarint(); // baseline, already looked up by the caller
+	gen width = reader.readVarint();
+	gen height = reader.readVarint();
+	gen blockSize = reader.readVarint();
+	std::int32_t offsetQuantum = reader.readVarint();
+	std::int32_t velocityQuantum = reader.readVarint();
+	if (!reader.isValid()) {
+		return false;
+	}
+	if (baseline != nullptr && baseline->width == width
+			&& baseline->height == height) {
+		out = *baseline;
+	} else if (baseline == nullptr) {
+		out.resize(width, height, blockSize);
+	} else {
+		return false;
+	}
+	out.tick = tick;
+
+	std::size_t cells = out.states.size();
+	std::size_t i = (std::size_t) -1;
+	while (true) {
+		std::uint32_t gap = reader.readVarint();
+		if (!reader.isValid()) {
+			return false;
+		}
+		if (gap == 0) {
+			return true;
+		}
+		i += gap;
+		if (i >= cells) {
+			return false;
+		}
+		bool stateChanged = reader.readBool();
+		bool offsetChanged = reader.readBool();
+		bool velocityChanged = reader.readBool();
+		if (stateChanged) {
+			out.states[i] = reader.readBits(3);
+		}
+		if (offsetChanged) {
+			out.offsetX[i] += reader.readSignedVarint(quantaBits) * offsetQuantum;
+			out.offsetY[i] += reader.readSignedVarint(quantaBits) * offsetQuantum;
+		}
+		if (velocityChanged) {
+			out.velocityX[i] += reader.readSignedVarint(quantaBits)
+					* velocityQuantum;
+			out.velocityY[i] += reader.readSignedVarint(quantaBits)
+					* velocityQuantum;
+		}
+	}
+}
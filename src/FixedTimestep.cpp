@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * FixedTimestep.cpp
+ *
+ *  Created on: Oct 16, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <FixedTimestep.hpp>
+
+FixedTimestep::FixedTimestep(unsigned int rate, unsigned int substeps) :
+		tickRate(rate), maxSubsteps(substeps), accumulator(0), droppedTicks(0) {
+	tickLength = 1.0 / rate;
+}
+
+unsigned int FixedTimestep::advance(double frameTime) {
+	if (frameTime > maxFrameTime) {
+		frameTime = maxFrameTime;
+	} else if (frameTime < 0) {
+		frameTime = 0;
+	}
+	accumulator += frameTime;
+
+	unsigned int ticks = (unsigned int) (accumulator / tickLength);
+	accumulator -= ticks * tickLength;
+	if (accumulator < 0) {
+		accumulator = 0;
+	}
+	// Only the fraction of a tick is carried over, the backlog past the cap is gone for good
+	if (ticks > maxSubsteps) {
+		droppedTicks += ticks - maxSubsteps;
+		ticks = maxSubsteps;
+	}
+	return ticks;
+}
+
+void FixedTimestep::setTickRate(unsigned int rate) {
+	// Keep the same fraction of a tick in the accumulator
+	double alpha = getAlpha();
+	tickRate = rate;
+	tickLength = 1.0 / rate;
+	accumulator = alpha * tickLength;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ForceFieldDump.cpp
+ *
+ *  Created on: Oct 26, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include <SFML/Graphics.hpp>
+#include <SharedWorldReader.hpp>
+
+/*
+ * enemycraft-forcedump [segment name] [output image] [pixels per cell]
+ * Saves the force field of a running world shared with --share (or the
+ * server's shared view) as an image: the hue is the direction of the
+ * force, the brightness its strength relative to the strongest cell.
+ * Blocks are drawn grey and magnets white.
+ */
+int main(int argc, char **argv) {
+	std::string segmentName = argc > 1 ? argv[1] : "/enemycraft";
+	std::string outputPath = argc > 2 ? argv[2] : "forces.png";
+	unsigned int scale = argc > 3 ? std::max(1, std::stoi(argv[3])) : 4;
+
+	SharedWorldFrame frame;
+	try {
+		SharedWorldReader reader(segmentName);
+		if (!reader.read(frame)) {
+			std::cerr << segmentName << " has no world published" << std::endl;
+			return 1;
+		}
+	} catch (std::runtime_error &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	float strongest = 0;
+	for (std::size_t i = 0; i < frame.forceX.size(); i++) {
+		strongest = std::max(strongest,
+				std::hypot(frame.forceX[i], frame.forceY[i]));
+	}
+
+	sf::Image image;
+	image.create(frame.width * scale, frame.height * scale, sf::Color::Black);
+	for (std::uint32_t y = 0; y < frame.height; y++) {
+		for (std::uint32_t x = 0; x < frame.width; x++) {
+			sf::Color color;
+			if (frame.isMagnetic(x, y)) {
+				color = sf::Color(255, 255, 255);
+			} else if (frame.isOccupied(x, y)) {
+				color = sf::Color(90, 90, 90);
+			} else {
+				float fx = frame.getForceX(x, y), fy = frame.getForceY(x, y);
+				float magnitude = std::hypot(fx, fy);
+				if (magnitude > 0) {
+					// Square root, so weak forces far from a magnet still show up
+					float brightness = std::sqrt(magnitude / strongest) * 255;
+					color = sf::Color(
+							(sf::Uint8) (brightness * (0.5f + 0.5f * fx / magnitude)),
+							(sf::Uint8) (brightness * (0.5f + 0.5f * fy / magnitude)),
+							(sf::Uint8) (brightness * 0.5f));
+				}
+			}
+			for (unsigned int py = 0; py < scale; py++) {
+				for (unsigned int px = 0; px < scale; px++) {
+					image.setPixel(x * scale + px, y * scale + py, color);
+				}
+			}
+		}
+	}
+	if (!image.saveToFile(outputPath)) {
+		std::cerr << "Unable to write " << outputPath << std::endl;
+		return 1;
+	}
+	std::cout << "Tick " << frame.tick << ", " << frame.width << "x"
+			<< frame.height << " cells, strongest force " << strongest
+			<< " N, saved to " << outputPath << std::endl;
+	return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * FrameScheduler.cpp
+ *
+ *  Created on: Oct 29, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+#include <FrameScheduler.hpp>
+
+FrameScheduler::FrameScheduler(float targetSeconds) :
+		nextId(0), target(targetSeconds), scale(1), lastBudget(0), lastUsed(0), turn(
+				0), frameStarted(false) {
+	budgetGauge = &Metrics::gauge("enemycraft_background_budget_seconds",
+			"Time the last frame had left for background jobs");
+	lateFrames = &Metrics::counter("enemycraft_late_frames_total",
+			"Frames that took longer than the target frame time");
+}
+
+int FrameScheduler::add(const std::string &name, int priority,
+		const Slice &slice) {
+	Job job;
+	job.id = nextId++;
+	job.name = name;
+	job.priority = priority;
+	job.slice = slice;
+	job.pending = true;
+	job.lastRun = 0;
+	job.seconds = &Metrics::counter("enemycraft_background_seconds_total",
+			"Time spent in background jobs", "job=\"" + name + "\"", 1e-9);
+	jobs.push_back(job);
+	return job.id;
+}
+
+void FrameScheduler::remove(int id) {
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [id](const Job &job) {
+		return job.id == id;
+	}), jobs.end());
+}
+
+void FrameScheduler::beginFrame() {
+	float frameTime = frameClock.restart().asSeconds();
+	if (frameStarted) {
+		// Back off hard after a late frame, come back slowly
+		if (frameTime > target * lateFactor) {
+			scale /= 2;
+			lateFrames->add();
+		} else {
+			scale = std::min(1.0f, scale + 0.05f);
+		}
+	}
+	frameStarted = true;
+	for (Job &job : jobs) {
+		job.pending = true;
+	}
+}
+
+unsigned int FrameScheduler::runBackground() {
+	float elapsed = frameClock.getElapsedTime().asSeconds();
+	float budget = std::max(minBudget,
+			(target - elapsed - presentReserve) * scale);
+	lastBudget = budget;
+	budgetGauge->set(budget);
+
+	sf::Clock clock;
+	unsigned int slices = 0;
+	while (true) {
+		// Highest priority first, the one that waited longest among equals
+		Job *next = nullptr;
+		for (Job &job : jobs) {
+			if (job.pending
+					&& (next == nullptr || job.priority > next->priority
+							|| (job.priority == next->priority
+									&& job.lastRun < next->lastRun))) {
+				next = &job;
+			}
+		}
+		float before = clock.getElapsedTime().asSeconds();
+		if (next == nullptr || before >= budget) {
+			break;
+		}
+		next->pending = next->slice();
+		next->lastRun = ++turn;
+		next->seconds->add(
+				(std::uint64_t) ((clock.getElapsedTime().asSeconds() - before) * 1e9f));
+		slices++;
+	}
+	lastUsed = clock.getElapsedTime().asSeconds();
+	return slices;
+}
+
+bool FrameScheduler::hasPendingWork() const {
+	for (const Job &job : jobs) {
+		if (job.pending) {
+			return true;
+		}
+	}
+	return false;
+}
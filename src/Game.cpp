@@ -27,6 +27,7 @@
 #include <thread>
 #include <ctime>
 #include <span>
+#include <algorithm>
 
 // Debug Libraries to import
 #include <unistd.h>
@@ -40,63 +41,199 @@ Game::Game(std::string windowTitle, const Point<unsigned int> &dimensions) :
 		Game(windowTitle, dimensions.x, dimensions.y) {
 
 }
-Game::Game(std::string windowTitle, unsigned int width, unsigned int height) :
-		title(windowTitle), w(width), h(height) {
-	randDevice.seed(time(NULL));
+Game::Game(std::string windowTitle, const Point<unsigned int> &dimensions,
+		const Point<unsigned int> &worldSize) :
+		Game(windowTitle, dimensions.x, dimensions.y, worldSize.x, worldSize.y) {
+
+}
+Game::Game(std::string windowTitle, unsigned int width, unsigned int height,
+		unsigned int worldWidth, unsigned int worldHeight) :
+		client(nullptr), sharedView(nullptr), tickCount(0), frameCount(0), metricsExporter(
+				nullptr), background(1.0f / targetFrameRate), timestep(
+				defaultTickRate, maxSubsteps), zoom(1), strokeKind(0), painting(
+				false), pourMaterial(MaterialGrid<gen>::Sand), title(
+				windowTitle), w(width), h(height) {
 	deltaTime = sf::Time::Zero;
-	defaultMu = 0.5;
-	defaultBlockSize = 50.f;
+	loadTextures();
+	world = new World(worldWidth > 0 ? worldWidth : width,
+			worldHeight > 0 ? worldHeight : height, textureManager, threadPool,
+			time(NULL));
+	undoHistory = new WorldHistory(*world, undoDepth);
+	rewindHistory = new WorldHistory(*world, rewindTicks);
+	startEffects();
+	startBackgroundJobs();
+}
 
-	// Loading textures from image files in res folder
-	if (!textureManager.loadNormalBlock("res/Block.png")
-			|| !textureManager.loadMagnetUpBlock("res/Magnet_Block_Up.png")
-			|| !textureManager.loadMagnetDownBlock("res/Magnet_Block_Down.png")
-			|| !textureManager.loadMagnetLeftBlock("res/Magnet_Block_Left.png")
-			|| !textureManager.loadMagnetRightBlock(
-					"res/Magnet_Block_Right.png")) {
-		std::cerr << "err loading textures!" << std::endl;
-		throw -999;
+Game::Game(std::string windowTitle, unsigned int width, unsigned int height,
+		const std::string &serverHost, unsigned short serverPort) :
+		undoHistory(nullptr), rewindHistory(nullptr), sharedView(nullptr), tickCount(
+				0), frameCount(0), metricsExporter(nullptr), background(
+				1.0f / targetFrameRate), timestep(defaultTickRate, maxSubsteps), zoom(
+				1), strokeKind(0), painting(false), pourMaterial(MaterialGrid<gen>::Sand), title(
+				windowTitle), w(width), h(height) {
+	deltaTime = sf::Time::Zero;
+	loadTextures();
+	client = new NetClient(serverHost, serverPort, textureManager, threadPool);
+	if (!client->connect(5000)) {
+		std::cerr << "no answer from " << serverHost << ":" << serverPort
+				<< std::endl;
+		delete client;
+		throw -998;
 	}
-
-	blockManager = new BlockManager<accur, gen>(defaultBlockSize, 5.f, width,
-			height, defaultMu, textureManager, randDevice);
+	world = client->getWorld();
+	gen blockSize = world->getBlockManager()->getBlockSize();
+	client->setViewport(0, 0, (width + blockSize - 1) / blockSize,
+			(height + blockSize - 1) / blockSize);
+	startEffects();
+	startBackgroundJobs();
 }
 
 Game::~Game() {
-	delete blockManager;
+	delete metricsExporter;
+	delete sharedView;
+	// The client owns its replica world
+	if (client != nullptr) {
+		delete client;
+	} else {
+		delete undoHistory;
+		delete rewindHistory;
+		delete world;
+	}
+}
+
+void Game::loadTextures() {
+	// Loading textures from image files in res folder, in TextureManager::BlockTexture order
+	textureManager.loadTiles( { "res/Block.png", "res/Magnet_Block_Up.png",
+			"res/Magnet_Block_Down.png", "res/Magnet_Block_Left.png",
+			"res/Magnet_Block_Right.png" }, "res/atlas.cache", threadPool);
+}
+
+void Game::shareWorld(const std::string &name) {
+	delete sharedView;
+	sharedView = nullptr;
+	sharedView = new SharedWorldView(name, *world);
+}
+
+void Game::serveMetrics(unsigned short port) {
+	delete metricsExporter;
+	metricsExporter = nullptr;
+	metricsExporter = new MetricsExporter(port, "");
+}
+
+void Game::startEffects() {
+	frameTime = &Metrics::histogram("enemycraft_frame_seconds",
+			"Time from one frame to the next", Metrics::timeBuckets());
+	particles.setTexture(&textureManager.getAtlas(),
+			textureManager.getBlockRect(TextureManager::NormalBlock));
+	world->getBlockManager()->setEventsEnabled(true);
+}
+
+/*
+ * Work that can wait a frame or two goes to the FrameScheduler, which
+ * fits it into the time the frame has left
+ */
+void Game::startBackgroundJobs() {
+	// Bulk edits (undo, rewind, generated chunks) leave most of their force rebuild to a job
+	world->getBlockManager()->setDeferredRebuildLines(deferredForceLines);
+	background.add("forces", 2, [this] {
+		return world->getBlockManager()->rebuildForces(forceLinesPerSlice);
+	});
+	if (client == nullptr) {
+		world->setChunksPerStep(0);
+		background.add("generation", 1, [this] {
+			return world->commitGeneratedChunks(chunksPerSlice) > 0;
+		});
+	}
 }
 
 void Game::startGameLoop() {
 	sf::RenderWindow window(sf::VideoMode(w, h), title);
-	window.setFramerateLimit(60);
+	window.setFramerateLimit(targetFrameRate);
 	window.setVerticalSyncEnabled(true);
+	camera = sf::View(sf::FloatRect(0, 0, (float) w, (float) h));
+	zoom = 1;
 
-	blockManager->generateAll();
+	if (client == nullptr) {
+		world->startGenerating((accur) (w / 2), (accur) (h / 2));
+	}
 
 	sf::Clock clock;
 	while (window.isOpen()) {
 		deltaTime = clock.restart();
+		background.beginFrame();
+		frameTime->observe(deltaTime.asSeconds());
+		window.setView(camera);
 		sf::Event event;
 		while (window.pollEvent(event)) {
 			handleAllUserInteractions(event, window);
 		}
+		applyStroke();
 		// Calculations
-		updateBlockForces();
-		updateBlockVelocity();
-		enforceBoxBounds();
-		updateBlockPositions();
+		if (client != nullptr) {
+			AllocationScope scope(AllocationTracker::Networking);
+			client->poll();
+			// The replica has no ticks of its own, it is published once per frame
+			if (sharedView != nullptr) {
+				sharedView->publish(tickCount, frameCount);
+			}
+		} else {
+			// Whole ticks only, however long the frame took
+			unsigned int ticks = timestep.advance(deltaTime.asSeconds());
+			for (unsigned int i = 0; i < ticks; i++) {
+				world->step((accur) timestep.getTickLength());
+				rewindHistory->record();
+				tickCount++;
+				if (sharedView != nullptr) {
+					sharedView->publish(tickCount, frameCount);
+				}
+			}
+		}
+		frameCount++;
+		{
+			AllocationScope scope(AllocationTracker::Effects);
+			particles.emitBlockEvents(*world);
+			particles.update(deltaTime.asSeconds(), threadPool);
+		}
 
-		window.clear(sf::Color::Black);
-		drawAllBlocks(window);
+		{
+			AllocationScope scope(AllocationTracker::Rendering);
+			window.clear(sf::Color::Black);
+			drawAllBlocks(window);
+		}
+		background.runBackground();
 		window.display();
+		AllocationTracker::endFrame();
 	}
 }
 void Game::handleAllUserInteractions(sf::Event &event,
 		sf::RenderWindow &window) {
 	switch (event.type) {
-	case sf::Event::MouseButtonPressed:
+	case sf::Event::MouseButtonPressed: {
+		// The handlers work in world pixels
+		sf::Vector2f at = window.mapPixelToCoords(
+				sf::Vector2i(event.mouseButton.x, event.mouseButton.y), camera);
+		event.mouseButton.x = (int) at.x;
+		event.mouseButton.y = (int) at.y;
 		handleMousePresses(event);
 		break;
+	}
+	case sf::Event::MouseMoved: {
+		sf::Vector2f at = window.mapPixelToCoords(
+				sf::Vector2i(event.mouseMove.x, event.mouseMove.y), camera);
+		event.mouseMove.x = (int) at.x;
+		event.mouseMove.y = (int) at.y;
+		handleMouseMoves(event);
+		break;
+	}
+	case sf::Event::MouseWheelScrolled:
+		zoomAt(window, event.mouseWheelScroll.x, event.mouseWheelScroll.y,
+				event.mouseWheelScroll.delta);
+		break;
+	case sf::Event::MouseButtonReleased:
+		if (event.mouseButton.button == sf::Mouse::Left) {
+			painting = false;
+		}
+		break;
 	case sf::Event::KeyPressed:
 		handleKeyPresses(event);
 		break;
@@ -109,38 +246,45 @@ void Game::handleAllUserInteractions(sf::Event &event,
 }
 
 void Game::handleMousePresses(sf::Event &event) {
+	BlockManager<accur, gen> *blockManager = world->getBlockManager();
+	accur x = (accur) event.mouseButton.x, y = (accur) event.mouseButton.y;
+	if (!world->contains(x, y)) {
+		return;
+	}
 	switch (event.mouseButton.button) {
 	case sf::Mouse::Left: {
-		Point<accur> coord(
-				(event.mouseButton.x / blockManager->getBlockSize())
-						* blockManager->getBlockSize(),
-				(event.mouseButton.y / blockManager->getBlockSize())
-						* blockManager->getBlockSize());
-
-		auto *block = blockManager->getBlockMap()->get(coord);
-		if (block == nullptr) {
-			Block<accur> *newBlock = new Block<accur>(
-					blockManager->getBlockSize(), blockManager->getBlockMass(),
-					0, 0, defaultMu, textureManager);
-			newBlock->setPosition(coord.x, coord.y);
-			blockManager->add(newBlock);
-			std::cout << "Added block!" << std::endl;
+		// Starting on an empty cell paints plain blocks, starting on a block erases
+		bool isEmpty = blockManager->getCellKind(
+				(gen) (x / blockManager->getBlockSize()),
+				(gen) (y / blockManager->getBlockSize()))
+				== BlockManager<accur, gen>::emptyCell;
+		strokeKind = isEmpty ? 0 : BlockManager<accur, gen>::emptyCell;
+		painting = true;
+		lastPaintCell = Point<gen>((gen) (x / blockManager->getBlockSize()),
+				(gen) (y / blockManager->getBlockSize()));
+		strokeCells.push_back(lastPaintCell);
+		break;
+	}
+	case sf::Mouse::Right: {
+		if (client != nullptr) {
+			client->sendCommand(CommandAction::RotateBlock, event.mouseButton.x,
+					event.mouseButton.y);
 		} else {
-			blockManager->remove(coord);
-			std::cout << "Removed block!" << std::endl;
+			undoHistory->record();
+			world->rotateBlock(x, y);
 		}
-
 		break;
 	}
-	case sf::Mouse::Right: {
-		Point<accur> coord(event.mouseButton.x, event.mouseButton.y);
-		auto *block = blockManager->getBlockMap()->get(coord);
-		if (block != NULL) {
-			int magnetFacingDirection = block->getMagnetFacingDirection();
-			// When the magnet's direction is already 4 (the last one), it should go back to 0
-			block->setMagnetFacingDirection(
-					(magnetFacingDirection >= 4) ?
-							0 : magnetFacingDirection + 1);
+	case sf::Mouse::Middle: {
+		// Materials aren't replicated, so this only works on a local world
+		if (client == nullptr) {
+			gen blockSize = blockManager->getBlockSize();
+			for (gen dy = -pourRadius; dy <= pourRadius; dy++) {
+				for (gen dx = -pourRadius; dx <= pourRadius; dx++) {
+					world->addMaterial(x + (accur) (dx * blockSize),
+							y + (accur) (dy * blockSize), pourMaterial);
+				}
+			}
 		}
 		break;
 	}
@@ -149,15 +293,96 @@ void Game::handleMousePresses(sf::Event &event) {
 	}
 }
 
+void Game::handleMouseMoves(sf::Event &event) {
+	if (!painting) {
+		return;
+	}
+	gen blockSize = world->getBlockManager()->getBlockSize();
+	accur x = (accur) event.mouseMove.x, y = (accur) event.mouseMove.y;
+	if (world->contains(x, y)) {
+		paintTo((gen) (x / blockSize), (gen) (y / blockSize));
+	}
+}
+
+/*
+ * Walks the cells on the line from the last painted cell, so that fast drags
+ * don't leave gaps between mouse events
+ */
+void Game::paintTo(gen cellX, gen cellY) {
+	gen dx = tma::abs(cellX - lastPaintCell.x), dy = -tma::abs(cellY - lastPaintCell.y);
+	gen stepX = lastPaintCell.x < cellX ? 1 : -1;
+	gen stepY = lastPaintCell.y < cellY ? 1 : -1;
+	gen error = dx + dy;
+	Point<gen> cell = lastPaintCell;
+	while (cell.x != cellX || cell.y != cellY) {
+		gen doubled = 2 * error;
+		if (doubled >= dy) {
+			error += dy;
+			cell.x += stepX;
+		}
+		if (doubled <= dx) {
+			error += dx;
+			cell.y += stepY;
+		}
+		strokeCells.push_back(cell);
+	}
+	lastPaintCell = cell;
+}
+
+void Game::applyStroke() {
+	if (strokeCells.empty()) {
+		return;
+	}
+	if (client != nullptr) {
+		gen blockSize = world->getBlockManager()->getBlockSize();
+		CommandAction action =
+				strokeKind == BlockManager<accur, gen>::emptyCell ?
+						CommandAction::RemoveBlock : CommandAction::AddBlock;
+		for (const Point<gen> &cell : strokeCells) {
+			client->sendCommand(action, cell.x * blockSize, cell.y * blockSize);
+		}
+	} else {
+		undoHistory->record();
+		world->getBlockManager()->fillCells(strokeCells, strokeKind);
+	}
+	strokeCells.clear();
+}
+
 void Game::handleKeyPresses(sf::Event &event) {
 	switch (event.key.code) {
 	case sf::Keyboard::W:
+		camera.move(0, -camera.getSize().y * panStep);
+		updateViewport();
 		break;
 	case sf::Keyboard::A:
+		camera.move(-camera.getSize().x * panStep, 0);
+		updateViewport();
 		break;
 	case sf::Keyboard::S:
+		camera.move(0, camera.getSize().y * panStep);
+		updateViewport();
 		break;
 	case sf::Keyboard::D:
+		camera.move(camera.getSize().x * panStep, 0);
+		updateViewport();
+		break;
+	case sf::Keyboard::Z:
+		// Also takes back whatever moved since the edit
+		if (undoHistory != nullptr) {
+			undoHistory->rewind(1);
+		}
+		break;
+	case sf::Keyboard::M:
+		pourMaterial =
+				pourMaterial == MaterialGrid<gen>::Sand ?
+						MaterialGrid<gen>::Water : MaterialGrid<gen>::Sand;
+		break;
+	case sf::Keyboard::R:
+		if (rewindHistory != nullptr) {
+			rewindHistory->rewind(
+					std::min<std::size_t>(timestep.getTickRate(),
+							rewindHistory->getSize()));
+		}
 		break;
 	default:
 		break;
@@ -165,105 +390,58 @@ void Game::handleKeyPresses(sf::Event &event) {
 }
 
 void Game::drawAllBlocks(sf::RenderWindow &window) {
-	for (gen i = 0; i < blockManager->getBlockMap()->getSize(); i++) {
-		Block<accur> *block = blockManager->getBlockMap()->getArr()[i];
-		if (block != nullptr) {
-			window.draw(*block);
-		}
-	}
-}
-
-void Game::updateBlockForces() {
-	for (gen i = 0; i < blockManager->getBlockMap()->getSize(); i++) {
-		Block<accur> *block = blockManager->getBlockMap()->getArr()[i];
-		if (block == nullptr) {
-			continue;
-		}
-		// TODO: make it not calculate unnecessarily if the magnetic block isn't moving
-		if (block->isMagnetic()) {
-			Point<gen> blockPos = blockManager->getBlockyCoordinates(
-					block->getPosition().x, block->getPosition().y);
-			blockManager->removeMagneticForce(block->getPreviousCoord(), block);
-			blockManager->addMagneticForce(blockPos.x, blockPos.y, block);
-		}
+	const sf::View &view = window.getView();
+	sf::FloatRect visible(view.getCenter().x - view.getSize().x / 2,
+			view.getCenter().y - view.getSize().y / 2, view.getSize().x,
+			view.getSize().y);
+	float scale = 1 / zoom;
+	if (world->getBlockManager()->getBlockSize() * scale < overviewBlockPixels) {
+		overview.update(*world, visible, scale);
+		window.draw(overview);
+		return;
 	}
+	// The client's replica only changes with snapshots, there is nothing to blend
+	float alpha = client == nullptr ? (float) timestep.getAlpha() : 1;
+	chunkRenderer.update(*world, visible, alpha);
+	window.draw(chunkRenderer);
+	window.draw(particles);
 }
 
-// Calculate block position based on velocity
-
-// A = F/M
-void Game::updateBlockVelocity() {
-	for (gen i = 0; i < blockManager->getBlockMap()->getSize(); i++) {
-		Block<accur> *block = blockManager->getBlockMap()->getArr()[i];
-		if (block == nullptr) {
-			continue;
-		}
-		Point<gen> pos = blockManager->getBlockyCoordinates(
-				block->getPosition().x, block->getPosition().y);
-		Point<accur> f = blockManager->getForceTable()->getForce(pos.x, pos.y);
-		block->setVx(block->getVx() + (f.x / block->getMass()));
-		block->setVy(block->getVy() + (f.y / block->getMass()));
-
-		// Debug Messages
-//		std::cout << "fx: " << f.x << ", fy: " << f.y << std::endl;
-	}
-}
-
-void Game::enforceBoxBounds() {
-	for (gen i = 0; i < blockManager->getBlockMap()->getSize(); i++) {
-		Block<accur> *block = blockManager->getBlockMap()->getArr()[i];
-		if (block == nullptr) {
-			continue;
-		}
-		const sf::Vector2f &pos = block->getPosition();
-		if (pos.x < 0) {
-			// Set velocity greater than zero
-			block->setVx(tma::abs(block->getVx()));
-		} else if (pos.x + block->getLength() > w) {
-			block->setVx(block->getVx() < 0 ? block->getVx() : -block->getVx());
-		}
-
-		if (pos.y < 0) {
-			block->setVy(tma::abs(block->getVy()));
-		} else if (pos.y + block->getLength() > w) {
-			block->setVy(block->getVy() < 0 ? block->getVy() : -block->getVy());
-		}
+/*
+ * Zooms in (delta > 0) or out by zoomStep, keeping the point under the
+ * cursor where it is. Out as far as twice the world's size.
+ */
+void Game::zoomAt(sf::RenderWindow &window, int pixelX, int pixelY,
+		float delta) {
+	float maxZoom = 2
+			* std::max(1.0f,
+					std::max((float) world->getWidth() / w,
+							(float) world->getHeight() / h));
+	float newZoom = delta > 0 ? zoom / zoomStep : zoom * zoomStep;
+	newZoom = std::min(maxZoom, std::max(minZoom, newZoom));
+	if (newZoom == zoom) {
+		return;
 	}
+	sf::Vector2i pixel(pixelX, pixelY);
+	sf::Vector2f before = window.mapPixelToCoords(pixel, camera);
+	camera.zoom(newZoom / zoom);
+	zoom = newZoom;
+	sf::Vector2f after = window.mapPixelToCoords(pixel, camera);
+	camera.move(before.x - after.x, before.y - after.y);
+	updateViewport();
 }
 
-void Game::updateBlockPositions() {
-	gen numRows = blockManager->getBlockMap()->getRows();
-	gen numColumns = blockManager->getBlockMap()->getColumns();
-	gen blockSize = blockManager->getBlockSize();
-	for (gen row = 0; row < numRows; row++) {
-		for (gen col = 0; col < numColumns; col++) {
-			accur x = row, y = col;
-			auto *block = blockManager->getBlockMap()->get(x * blockSize, y * blockSize);
-			if (block == nullptr) {
-				continue;
-			}
-			accur deltaX = block->getVx() * deltaTime.asSeconds();
-			accur deltaY = block->getVy() * deltaTime.asSeconds();
-
-			gen newPosX = (gen) ((block->getPosition().x + deltaX) / blockManager->getBlockSize());
-			gen newPosY = (gen) ((block->getPosition().y + deltaY) / blockManager->getBlockSize());
-			if ((newPosX != x || newPosY != y) && (newPosX >= 0 && newPosY >= 0 && newPosX < numRows && newPosY < numColumns)) {
-				auto *otherBlock = blockManager->getBlockMap()->get(newPosX,
-						newPosY);
-				if (otherBlock == nullptr) {
-					blockManager->getBlockMap()->set(newPosX * blockSize, newPosY * blockSize, block);
-					blockManager->getBlockMap()->set(x * blockSize, y * blockSize, nullptr);
-				} else {
-					deltaX = -deltaX;
-					deltaY = -deltaY;
-				}
-			}
-			block->moveWithStats(deltaX, deltaY);
-
-			// Debug Messages
-			std::cout << "X: " << x << ", Y: " << y << ", newPosX: " << newPosX << ", newPosY: " << newPosY << std::endl;
-//			std::cout << "Vx: " << block->getVx() << ", Vy: " << block->getVy()
-//					<< std::endl;
-		}
+/*
+ * A remote world only sends the cells the camera can see
+ */
+void Game::updateViewport() {
+	if (client == nullptr) {
+		return;
 	}
+	gen blockSize = world->getBlockManager()->getBlockSize();
+	const sf::Vector2f &centre = camera.getCenter(), &size = camera.getSize();
+	gen left = std::max(0, (gen) ((centre.x - size.x / 2) / blockSize));
+	gen top = std::max(0, (gen) ((centre.y - size.y / 2) / blockSize));
+	client->setViewport(left, top, (gen) (size.x / blockSize) + 2,
+			(gen) (size.y / blockSize) + 2);
 }
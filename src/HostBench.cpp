@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * HostBench.cpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+#include <WorldHost.hpp>
+#include <TextureManager.hpp>
+
+/*
+ * enemycraft-hostbench [worlds] [lanes] [width] [height] [ticks]
+ * Runs that many worlds (in pixels, like the server) on a WorldHost and
+ * prints how many world steps per second it manages. Lanes default to the
+ * number of hardware threads; running it with 1, 2, 4 ... lanes shows how
+ * the host scales.
+ */
+int main(int argc, char **argv) {
+	unsigned int numWorlds = argc > 1 ? std::stoi(argv[1]) : 8;
+	unsigned int numLanes = argc > 2 ? std::stoi(argv[2]) : 0;
+	unsigned int width = argc > 3 ? std::stoi(argv[3]) : 1280;
+	unsigned int height = argc > 4 ? std::stoi(argv[4]) : 720;
+	unsigned int ticks = argc > 5 ? std::stoi(argv[5]) : 600;
+
+	TextureManager textureManager;
+	WorldHost host(textureManager, numLanes);
+	for (unsigned int i = 0; i < numWorlds; i++) {
+		host.addWorld(width, height, i + 1);
+	}
+
+	accur dt = (accur) 1 / (accur) 60;
+	// Let the worlds settle first, a fresh world has far more moving blocks
+	host.step(dt, 60);
+	auto start = std::chrono::steady_clock::now();
+	host.step(dt, ticks);
+	double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+
+	std::cout << numWorlds << " worlds on " << host.getNumLanes() << " lanes, "
+			<< ticks << " ticks in " << seconds << " s: "
+			<< numWorlds * ticks / seconds << " world steps/s" << std::endl;
+	return 0;
+}
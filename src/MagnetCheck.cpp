@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * MagnetCheck.cpp
+ *
+ *  Created on: Nov 3, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include <MagnetQuadTree.hpp>
+#include <ThreadPool.hpp>
+#include <BitGrid.hpp>
+#include <Block.hpp>
+#include <Fixed.hpp>
+
+/*
+ * enemycraft-magnetcheck [grid size] [mass] [strength]
+ * Builds the same MagnetQuadTree for float and for Fixed over square
+ * clusters of magnets that all face the same way, the case where node
+ * moments add up the most, and compares the force both give on a magnet
+ * at a range of distances from each cluster. Fails if Fixed is off by more
+ * than rounding can explain, e.g. because something overflowed and flipped
+ * the sign of the force. The forces have to fit in Fixed's range, which they
+ * do with the game's mass and strength (the defaults).
+ */
+int main(int argc, char **argv) {
+	int size = argc > 1 ? std::stoi(argv[1]) : 256;
+	int mass = argc > 2 ? std::stoi(argv[2]) : 5;
+	int strength = argc > 3 ? std::stoi(argv[3]) : 100;
+
+	ThreadPool threadPool;
+	MagnetQuadTree<float, int> floatTree(size, size, 0.5f);
+	MagnetQuadTree<Fixed, int> fixedTree(size, size, Fixed(1) / 2);
+	// Facing right
+	int direction = 4;
+	Point<float> floatMoment = Block<float>::getMagneticMoment((float) mass,
+			direction);
+	Point<Fixed> fixedMoment = Block<Fixed>::getMagneticMoment(Fixed(mass),
+			direction);
+
+	int checked = 0, failed = 0;
+	double worstError = 0;
+	for (int clusterSize = 2; clusterSize <= 32 && clusterSize < size / 2;
+			clusterSize *= 2) {
+		BitGrid<int> magnets(size, size);
+		for (int y = 0; y < clusterSize; y++) {
+			for (int x = 0; x < clusterSize; x++) {
+				magnets.set(x, y, true);
+			}
+		}
+		floatTree.rebuild(magnets, [&](int, int) {
+			return floatMoment;
+		}, threadPool);
+		fixedTree.rebuild(magnets, [&](int, int) {
+			return fixedMoment;
+		}, threadPool);
+
+		for (int distance = clusterSize; distance < size; distance += 3) {
+			for (int target = 0; target < 2; target++) {
+				// Along the row the magnets point along, and along the diagonal
+				int x = distance, y = target == 0 ? 0 : std::min(distance, size - 1);
+				Point<float> expected = floatTree.getForce(magnets,
+						[&](int, int) {
+							return floatMoment;
+						}, x, y, floatMoment, (float) strength);
+				Point<Fixed> actual = fixedTree.getForce(magnets,
+						[&](int, int) {
+							return fixedMoment;
+						}, x, y, fixedMoment, Fixed(strength));
+				double errorX = std::fabs((double) actual.x - expected.x);
+				double errorY = std::fabs((double) actual.y - expected.y);
+				double magnitude = std::fabs(expected.x) + std::fabs(expected.y);
+				double error = std::max(errorX, errorY);
+				worstError = std::max(worstError, error);
+				checked++;
+				if (error > 0.01 * magnitude + 0.01) {
+					failed++;
+					if (failed <= 10) {
+						std::cout << clusterSize << "x" << clusterSize
+								<< " cluster, magnet at (" << x << ", " << y
+								<< "): float (" << expected.x << ", " << expected.y
+								<< "), Fixed (" << actual.x << ", " << actual.y
+								<< ")" << std::endl;
+					}
+				}
+			}
+		}
+	}
+
+	std::cout << checked << " forces compared, worst difference "
+			<< worstError << std::endl;
+	if (failed > 0) {
+		std::cout << failed << " forces differ between float and Fixed"
+				<< std::endl;
+		return 1;
+	}
+	std::cout << "Fixed agrees with float" << std::endl;
+	return 0;
+}
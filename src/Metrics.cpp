@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Metrics.cpp
+ *
+ *  Created on: Oct 27, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <sstream>
+#include <stdexcept>
+
+#include <Metrics.hpp>
+
+std::atomic<unsigned int> Metrics::nextShard(0);
+
+std::uint64_t Metrics::Counter::getValue() const {
+	std::uint64_t sum = 0;
+	for (const Shard &shard : shards) {
+		sum += shard.value.load(std::memory_order_relaxed);
+	}
+	return sum;
+}
+
+Metrics::Histogram::Histogram(const std::vector<double> &upperBounds) :
+		bounds(upperBounds) {
+	for (Shard &shard : shards) {
+		shard.counts.reset(new std::atomic<std::uint64_t>[bounds.size() + 1]);
+		for (std::size_t i = 0; i <= bounds.size(); i++) {
+			shard.counts[i].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+void Metrics::Histogram::observe(double seconds) {
+	// A handful of buckets, a linear search is as fast as anything
+	std::size_t bucket = 0;
+	while (bucket < bounds.size() && seconds > bounds[bucket]) {
+		bucket++;
+	}
+	Shard &shard = shards[getShard()];
+	shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	shard.sumNanos.fetch_add(
+			(std::uint64_t) (seconds > 0 ? seconds * 1e9 : 0),
+			std::memory_order_relaxed);
+}
+
+std::vector<std::uint64_t> Metrics::Histogram::getBucketCounts() const {
+	std::vector<std::uint64_t> counts(bounds.size() + 1, 0);
+	for (const Shard &shard : shards) {
+		for (std::size_t i = 0; i < counts.size(); i++) {
+			counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+		}
+	}
+	return counts;
+}
+
+double Metrics::Histogram::getSum() const {
+	std::uint64_t nanos = 0;
+	for (const Shard &shard : shards) {
+		nanos += shard.sumNanos.load(std::memory_order_relaxed);
+	}
+	return nanos * 1e-9;
+}
+
+Metrics::Counter& Metrics::counter(const std::string &name,
+		const std::string &help, const std::string &labels, double scale) {
+	Metrics &metrics = getInstance();
+	std::lock_guard<std::mutex> lock(metrics.mutex);
+	Entry *entry = metrics.find(name, labels, CounterKind);
+	if (entry == nullptr) {
+		entry = &metrics.add(name, help, labels, CounterKind);
+		entry->counter.reset(new Counter());
+		entry->scale = scale;
+	}
+	return *entry->counter;
+}
+
+Metrics::Gauge& Metrics::gauge(const std::string &name,
+		const std::string &help, const std::string &labels) {
+	Metrics &metrics = getInstance();
+	std::lock_guard<std::mutex> lock(metrics.mutex);
+	Entry *entry = metrics.find(name, labels, GaugeKind);
+	if (entry == nullptr) {
+		entry = &metrics.add(name, help, labels, GaugeKind);
+		entry->gauge.reset(new Gauge());
+	}
+	return *entry->gauge;
+}
+
+Metrics::Histogram& Metrics::histogram(const std::string &name,
+		const std::string &help, const std::vector<double> &upperBounds,
+		const std::string &labels) {
+	Metrics &metrics = getInstance();
+	std::lock_guard<std::mutex> lock(metrics.mutex);
+	Entry *entry = metrics.find(name, labels, HistogramKind);
+	if (entry == nullptr) {
+		entry = &metrics.add(name, help, labels, HistogramKind);
+		entry->histogram.reset(new Histogram(upperBounds));
+	}
+	return *entry->histogram;
+}
+
+/*
+ * Joins the metric's own labels with an extra one (the histogram's le)
+ */
+static std::string labelSet(const std::string &labels,
+		const std::string &extra = "") {
+	if (labels.empty() && extra.empty()) {
+		return "";
+	}
+	if (labels.empty() || extra.empty()) {
+		return "{" + labels + extra + "}";
+	}
+	return "{" + labels + "," + extra + "}";
+}
+
+void Metrics::write(std::ostream &out) {
+	Metrics &metrics = getInstance();
+	std::lock_guard<std::mutex> lock(metrics.mutex);
+	std::ostringstream text;
+	text.precision(15);
+	std::vector<bool> written(metrics.entries.size(), false);
+	for (std::size_t i = 0; i < metrics.entries.size(); i++) {
+		if (written[i]) {
+			continue;
+		}
+		const Entry &family = metrics.entries[i];
+		static const char *types[] = { "counter", "gauge", "histogram" };
+		text << "# HELP " << family.name << " " << family.help << "\n";
+		text << "# TYPE " << family.name << " " << types[family.kind] << "\n";
+		for (std::size_t j = i; j < metrics.entries.size(); j++) {
+			const Entry &entry = metrics.entries[j];
+			if (written[j] || entry.name != family.name) {
+				continue;
+			}
+			written[j] = true;
+			switch (entry.kind) {
+			case CounterKind:
+				if (entry.scale == 1) {
+					text << entry.name << labelSet(entry.labels) << " "
+							<< entry.counter->getValue() << "\n";
+				} else {
+					text << entry.name << labelSet(entry.labels) << " "
+							<< entry.counter->getValue() * entry.scale << "\n";
+				}
+				break;
+			case GaugeKind:
+				text << entry.name << labelSet(entry.labels) << " "
+						<< entry.gauge->getValue() << "\n";
+				break;
+			case HistogramKind: {
+				const std::vector<double> &bounds = entry.histogram->getBounds();
+				std::vector<std::uint64_t> counts =
+						entry.histogram->getBucketCounts();
+				std::uint64_t cumulative = 0;
+				for (std::size_t b = 0; b < counts.size(); b++) {
+					cumulative += counts[b];
+					std::ostringstream bound;
+					bound.precision(15);
+					if (b < bounds.size()) {
+						bound << bounds[b];
+					} else {
+						bound << "+Inf";
+					}
+					text << entry.name << "_bucket"
+							<< labelSet(entry.labels, "le=\"" + bound.str() + "\"")
+							<< " " << cumulative << "\n";
+				}
+				text << entry.name << "_sum" << labelSet(entry.labels) << " "
+						<< entry.histogram->getSum() << "\n";
+				text << entry.name << "_count" << labelSet(entry.labels) << " "
+						<< cumulative << "\n";
+				break;
+			}
+			}
+		}
+	}
+	out << text.str();
+}
+
+std::string Metrics::write() {
+	std::ostringstream out;
+	write(out);
+	return out.str();
+}
+
+std::vector<double> Metrics::timeBuckets() {
+	std::vector<double> bounds;
+	for (double bound = 0.0001; bound < 2; bound *= 2) {
+		bounds.push_back(bound);
+	}
+	return bounds;
+}
+
+Metrics& Metrics::getInstance() {
+	// Never destroyed, threads may still count on their way out of the process
+	static Metrics *instance = new Metrics();
+	return *instance;
+}
+
+Metrics::Entry* Metrics::find(const std::string &name,
+		const std::string &labels, Kind kind) {
+	for (Entry &entry : entries) {
+		if (entry.name == name) {
+			if (entry.kind != kind) {
+				throw std::invalid_argument(
+						"Metric " + name + " is already registered as another kind");
+			}
+			if (entry.labels == labels) {
+				return &entry;
+			}
+		}
+	}
+	return nullptr;
+}
+
+Metrics::Entry& Metrics::add(const std::string &name, const std::string &help,
+		const std::string &labels, Kind kind) {
+	entries.emplace_back();
+	Entry &entry = entries.back();
+	entry.name = name;
+	entry.help = help;
+	entry.labels = labels;
+	entry.kind = kind;
+	entry.scale = 1;
+	return entry;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * MetricsExporter.cpp
+ *
+ *  Created on: Oct 27, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <MetricsExporter.hpp>
+#include <Metrics.hpp>
+
+MetricsExporter::MetricsExporter(std::uint16_t port,
+		const std::string &dumpPath, double dumpSeconds) :
+		listener(-1), boundPort(0), path(dumpPath), interval(dumpSeconds), stopping(
+				false) {
+	if (port != 0) {
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		if (listener < 0) {
+			throw std::runtime_error(
+					std::string("Unable to open metrics socket: ")
+							+ std::strerror(errno));
+		}
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		// Only for scrapers on the same machine (or behind a tunnel)
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		if (bind(listener, (sockaddr*) &address, sizeof(address)) < 0
+				|| ::listen(listener, 8) < 0) {
+			std::string err = "Unable to serve metrics on port "
+					+ std::to_string(port) + ": " + std::strerror(errno);
+			close(listener);
+			throw std::runtime_error(err);
+		}
+		boundPort = port;
+	}
+	if (listener >= 0 || !path.empty()) {
+		thread = std::thread(&MetricsExporter::serve, this);
+	}
+}
+
+MetricsExporter::~MetricsExporter() {
+	stopping = true;
+	if (thread.joinable()) {
+		thread.join();
+	}
+	if (listener >= 0) {
+		close(listener);
+	}
+	if (!path.empty()) {
+		dump();
+	}
+}
+
+void MetricsExporter::dump() {
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::trunc);
+		if (!out) {
+			return;
+		}
+		Metrics::write(out);
+	}
+	std::rename(temporary.c_str(), path.c_str());
+}
+
+void MetricsExporter::serve() {
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point nextDump = Clock::now()
+			+ std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<double>(interval));
+	while (!stopping) {
+		// Wakes up every so often to notice stopping, a scrape doesn't have to wait for it
+		pollfd waiting { listener, POLLIN, 0 };
+		if (poll(&waiting, listener >= 0 ? 1 : 0, 200) > 0
+				&& (waiting.revents & POLLIN)) {
+			int client = accept(listener, nullptr, nullptr);
+			if (client >= 0) {
+				answer(client);
+				close(client);
+			}
+		}
+		if (!path.empty() && Clock::now() >= nextDump) {
+			dump();
+			nextDump += std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<double>(interval));
+		}
+	}
+}
+
+void MetricsExporter::answer(int client) {
+	// A scraper that stops talking mustn't hold up the next one
+	timeval timeout { 1, 0 };
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	// Only the request line matters, the headers are read and ignored
+	std::string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == std::string::npos
+			&& request.size() < 8192) {
+		ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+		if (received <= 0) {
+			break;
+		}
+		request.append(buffer, received);
+	}
+
+	std::string status, body;
+	if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0) {
+		status = "200 OK";
+		body = Metrics::write();
+	} else {
+		status = "404 Not Found";
+		body = "Try /metrics\n";
+	}
+	std::string response = "HTTP/1.1 " + status + "\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"Connection: close\r\n\r\n" + body;
+	std::size_t sent = 0;
+	while (sent < response.size()) {
+		ssize_t written = send(client, response.data() + sent,
+				response.size() - sent, MSG_NOSIGNAL);
+		if (written <= 0) {
+			break;
+		}
+		sent += written;
+	}
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * NetClient.cpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <thread>
+#include <chrono>
+
+#include <NetClient.hpp>
+
+NetClient::NetClient(const std::string &host, std::uint16_t port,
+		TextureManager &manager, ThreadPool &pool) :
+		socket(0), server(NetAddress::resolve(host, port)), textureManager(
+				manager), threadPool(pool), world(nullptr), viewX(0), viewY(0), viewW(
+				0), viewH(0), chunksReceived(0) {
+}
+
+NetClient::~NetClient() {
+	PacketWriter bye(MessageType::Bye);
+	socket.send(server, bye.getBytes());
+	delete world;
+}
+
+bool NetClient::connect(int timeoutMillis) {
+	auto deadline = std::chrono::steady_clock::now()
+			+ std::chrono::milliseconds(timeoutMillis);
+	while (std::chrono::steady_clock::now() < deadline) {
+		sendViewport(MessageType::Hello);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		NetAddress from;
+		while (socket.receive(from, receiveBuffer)) {
+			PacketReader reader(receiveBuffer);
+			if (from != server || !reader.isValid()
+					|| reader.getType() != MessageType::Welcome) {
+				continue;
+			}
+			unsigned int width = reader.readU32();
+			unsigned int height = reader.readU32();
+			reader.readU16(); // block size, fixed at 50 for now
+			reader.readU16(); // tick rate
+			if (!reader.isValid()) {
+				continue;
+			}
+			world = new World(width, height, textureManager, threadPool, 0);
+			chunkTicks.assign(
+					world->getBlockManager()->getChunkGrid().getChunkCount(), 0);
+			return true;
+		}
+	}
+	return false;
+}
+
+void NetClient::poll() {
+	if (world == nullptr) {
+		return;
+	}
+	NetAddress from;
+	while (socket.receive(from, receiveBuffer)) {
+		PacketReader reader(receiveBuffer);
+		if (from == server && reader.isValid()
+				&& reader.getType() == MessageType::ChunkState) {
+			applyChunk(reader);
+		}
+	}
+	// The replica doesn't step, its light catches up here instead
+	world->getBlockManager()->updateLight();
+	if (std::chrono::steady_clock::now() - lastSent
+			> std::chrono::milliseconds(keepAliveMillis)) {
+		sendViewport(MessageType::Viewport);
+	}
+}
+
+void NetClient::sendCommand(CommandAction action, gen x, gen y) {
+	PacketWriter writer(MessageType::Command);
+	writer.writeU8((std::uint8_t) action);
+	writer.writeI32(x);
+	writer.writeI32(y);
+	socket.send(server, writer.getBytes());
+}
+
+void NetClient::setViewport(gen x, gen y, gen w, gen h) {
+	viewX = x;
+	viewY = y;
+	viewW = w;
+	viewH = h;
+	sendViewport(MessageType::Viewport);
+}
+
+void NetClient::sendViewport(MessageType type) {
+	PacketWriter writer(type);
+	writer.writeI32(viewX);
+	writer.writeI32(viewY);
+	writer.writeU16(viewW);
+	writer.writeU16(viewH);
+	socket.send(server, writer.getBytes());
+	lastSent = std::chrono::steady_clock::now();
+}
+
+void NetClient::applyChunk(PacketReader &reader) {
+	BlockManager<accur, gen> *blockManager = world->getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	gen blockSize = blockManager->getBlockSize();
+
+	unsigned long tick = reader.readU32();
+	gen chunkX = reader.readU16();
+	gen chunkY = reader.readU16();
+	if (!reader.isValid() || !grid.containsChunk(chunkX, chunkY)) {
+		return;
+	}
+	gen index = grid.getChunkIndexOf(chunkX, chunkY);
+	// UDP may hand over an older copy after a newer one
+	if (chunkTicks[index] > tick) {
+		return;
+	}
+	chunkTicks[index] = tick;
+	chunksReceived++;
+
+	Point<gen> start = grid.getChunkStart(chunkX, chunkY);
+	Point<gen> end = grid.getChunkEnd(chunkX, chunkY);
+	for (gen y = start.y; y < end.y; y++) {
+		for (gen x = start.x; x < end.x; x++) {
+			std::uint8_t state = reader.readU8();
+			accur cellX = (accur) (x * blockSize), cellY = (accur) (y * blockSize);
+			int kind = blockManager->getCellKind(x, y);
+			if (state == 0) {
+				if (kind != BlockManager<accur, gen>::emptyCell) {
+					blockManager->remove(cellX, cellY);
+				}
+				continue;
+			}
+			accur posX = (accur) ((double) reader.readI32() / positionScale);
+			accur posY = (accur) ((double) reader.readI32() / positionScale);
+			if (!reader.isValid()) {
+				return;
+			}
+			int direction = state - 1;
+			if (kind == BlockManager<accur, gen>::emptyCell) {
+				blockManager->place(x, y, blockManager->getDefaultType(),
+						direction);
+			} else if (kind != direction) {
+				blockManager->setCellDirection(x, y, direction);
+			}
+			// The replica only draws, so the block can sit anywhere in its cell
+			Block<accur> *block = blockManager->getAwakeBlock(x, y);
+			if (block != nullptr ?
+					block->getCoord().x != posX || block->getCoord().y != posY :
+					posX != cellX || posY != cellY) {
+				blockManager->wake(x, y)->setCoord(posX, posY);
+				blockManager->markChanged(cellX, cellY);
+			}
+		}
+	}
+}
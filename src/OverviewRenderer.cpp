@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * OverviewRenderer.cpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <algorithm>
+
+#include <OverviewRenderer.hpp>
+
+OverviewRenderer::OverviewRenderer() :
+		mappedWorld(nullptr), level(0), refreshedChunks(0) {
+}
+
+void OverviewRenderer::update(World &world, const sf::FloatRect &view,
+		float scale) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	if (mappedWorld != &world || map == nullptr) {
+		map.reset(new OverviewMap<gen>(grid));
+		mappedWorld = &world;
+	}
+	vertices.clear();
+	refreshedChunks = 0;
+
+	float blockSize = (float) blockManager->getBlockSize();
+	// The finest level that's still readable, or the coarsest if none is
+	level = OverviewMap<gen>::numLevels - 1;
+	for (int l = 0; l < OverviewMap<gen>::numLevels; l++) {
+		float cellSize = blockSize * (ChunkGrid<gen>::chunkSize
+				/ OverviewMap<gen>::getSide(l));
+		if (cellSize * scale >= minCellPixels) {
+			level = l;
+			break;
+		}
+	}
+	gen side = OverviewMap<gen>::getSide(level);
+	float cellSize = blockSize * (ChunkGrid<gen>::chunkSize / side);
+
+	float chunkPixels = (float) (ChunkGrid<gen>::chunkSize * blockSize);
+	gen firstX = std::max((gen) (view.left / chunkPixels), 0);
+	gen firstY = std::max((gen) (view.top / chunkPixels), 0);
+	gen lastX = std::min((gen) ((view.left + view.width) / chunkPixels),
+			grid.getChunksX() - 1);
+	gen lastY = std::min((gen) ((view.top + view.height) / chunkPixels),
+			grid.getChunksY() - 1);
+	for (gen chunkY = firstY; chunkY <= lastY; chunkY++) {
+		for (gen chunkX = firstX; chunkX <= lastX; chunkX++) {
+			gen index = grid.getChunkIndexOf(chunkX, chunkY);
+			if (map->refresh(index, *blockManager)) {
+				refreshedChunks++;
+			}
+			const OverviewMap<gen>::Cell *cells = map->getLevel(index, level);
+			float left = chunkX * chunkPixels, top = chunkY * chunkPixels;
+			for (gen y = 0; y < side; y++) {
+				for (gen x = 0; x < side; x++) {
+					const OverviewMap<gen>::Cell &cell = cells[y * side + x];
+					if (cell.blocks == 0) {
+						continue;
+					}
+					sf::Color color = getColor(cell);
+					float x0 = left + x * cellSize, y0 = top + y * cellSize;
+					vertices.emplace_back(sf::Vector2f(x0, y0), color);
+					vertices.emplace_back(sf::Vector2f(x0 + cellSize, y0), color);
+					vertices.emplace_back(
+							sf::Vector2f(x0 + cellSize, y0 + cellSize), color);
+					vertices.emplace_back(sf::Vector2f(x0, y0 + cellSize), color);
+				}
+			}
+		}
+	}
+}
+
+void OverviewRenderer::draw(sf::RenderTarget &target,
+		sf::RenderStates states) const {
+	if (!vertices.empty()) {
+		target.draw(vertices.data(), vertices.size(), sf::Quads, states);
+	}
+}
+
+sf::Color OverviewRenderer::getColor(const OverviewMap<gen>::Cell &cell) {
+	static const sf::Color typeColors[] = { sf::Color(150, 150, 150),
+			sf::Color(181, 136, 99), sf::Color(110, 160, 90), sf::Color(120,
+					130, 200), sf::Color(200, 180, 90), sf::Color(170, 110, 170) };
+	static const sf::Color magnetColor(210, 60, 50);
+	const sf::Color &base = typeColors[cell.type
+			% (sizeof(typeColors) / sizeof(typeColors[0]))];
+	// Share of the blocks that are magnets
+	int magnets = std::min(255, cell.magnets * 255 / cell.blocks);
+	auto mix = [magnets](sf::Uint8 from, sf::Uint8 to) {
+		return (sf::Uint8) (from + (to - from) * magnets / 255);
+	};
+	// Sparse cells fade out, but never so far that they vanish
+	return sf::Color(mix(base.r, magnetColor.r), mix(base.g, magnetColor.g),
+			mix(base.b, magnetColor.b),
+			(sf::Uint8) (64 + cell.blocks * 191 / 255));
+}
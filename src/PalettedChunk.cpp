@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * PalettedChunk.cpp
+ *
+ *  Created on: Oct 20, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <PalettedChunk.hpp>
+
+PalettedChunk::PalettedChunk(unsigned int numCells) :
+		cells(numCells), bits(0) {
+	palette.push_back(0);
+	useCounts.push_back(numCells);
+}
+
+void PalettedChunk::set(unsigned int cell, std::uint16_t value) {
+	unsigned int old = getIndex(cell);
+	if (palette[old] == value) {
+		return;
+	}
+	unsigned int index = findOrAddEntry(value);
+	useCounts[old]--;
+	useCounts[index]++;
+	setIndex(cell, index);
+}
+
+std::size_t PalettedChunk::getMemoryUsage() const {
+	return palette.capacity() * sizeof(std::uint16_t)
+			+ useCounts.capacity() * sizeof(unsigned int)
+			+ packed.capacity() * sizeof(std::uint64_t);
+}
+
+unsigned int PalettedChunk::getIndex(unsigned int cell) const {
+	if (bits == 0) {
+		return 0;
+	}
+	unsigned int perWord = 64 / bits;
+	return (packed[cell / perWord] >> ((cell % perWord) * bits))
+			& ((std::uint64_t(1) << bits) - 1);
+}
+
+void PalettedChunk::setIndex(unsigned int cell, unsigned int index) {
+	unsigned int perWord = 64 / bits;
+	unsigned int shift = (cell % perWord) * bits;
+	std::uint64_t mask = ((std::uint64_t(1) << bits) - 1) << shift;
+	std::uint64_t &word = packed[cell / perWord];
+	word = (word & ~mask) | ((std::uint64_t) index << shift);
+}
+
+unsigned int PalettedChunk::findOrAddEntry(std::uint16_t value) {
+	unsigned int unused = palette.size();
+	for (unsigned int i = 0; i < palette.size(); i++) {
+		if (palette[i] == value) {
+			return i;
+		}
+		// Entry 0 stays the empty value for good
+		if (i != 0 && useCounts[i] == 0 && unused == palette.size()) {
+			unused = i;
+		}
+	}
+	if (unused < palette.size()) {
+		palette[unused] = value;
+		return unused;
+	}
+	palette.push_back(value);
+	useCounts.push_back(0);
+	unsigned int needed = bits;
+	while (needed == 0 || palette.size() > (std::size_t(1) << needed)) {
+		needed = needed == 0 ? 1 : needed * 2;
+	}
+	if (needed != bits) {
+		repack(needed);
+	}
+	return palette.size() - 1;
+}
+
+void PalettedChunk::repack(unsigned int newBits) {
+	std::vector<unsigned int> indices(cells);
+	for (unsigned int i = 0; i < cells; i++) {
+		indices[i] = getIndex(i);
+	}
+	bits = newBits;
+	unsigned int perWord = 64 / bits;
+	packed.assign((cells + perWord - 1) / perWord, 0);
+	for (unsigned int i = 0; i < cells; i++) {
+		setIndex(i, indices[i]);
+	}
+}
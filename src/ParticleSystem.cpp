@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ParticleSystem.cpp
+ *
+ *  Created on: Oct 25, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <cmath>
+
+#include <ParticleSystem.hpp>
+
+ParticleSystem::ParticleSystem(std::size_t maxParticles) :
+		capacity(maxParticles), count(0), x(maxParticles), y(maxParticles), vx(
+				maxParticles), vy(maxParticles), life(maxParticles), inverseLifetime(
+				maxParticles), halfSize(maxParticles), color(maxParticles), vertices(
+				sf::Quads, maxParticles * 4), atlas(nullptr) {
+}
+
+void ParticleSystem::setTexture(const sf::Texture *texture,
+		const sf::IntRect &tile) {
+	atlas = texture;
+	float u0 = (float) tile.left, v0 = (float) tile.top;
+	float u1 = u0 + tile.width, v1 = v0 + tile.height;
+	for (std::size_t i = 0; i < capacity; i++) {
+		vertices[i * 4].texCoords = sf::Vector2f(u0, v0);
+		vertices[i * 4 + 1].texCoords = sf::Vector2f(u1, v0);
+		vertices[i * 4 + 2].texCoords = sf::Vector2f(u1, v1);
+		vertices[i * 4 + 3].texCoords = sf::Vector2f(u0, v1);
+	}
+}
+
+void ParticleSystem::emit(float px, float py, float pvx, float pvy,
+		float lifetime, float particleSize, sf::Color particleColor) {
+	if (count == capacity || lifetime <= 0) {
+		return;
+	}
+	x[count] = px;
+	y[count] = py;
+	vx[count] = pvx;
+	vy[count] = pvy;
+	life[count] = lifetime;
+	inverseLifetime[count] = 1 / lifetime;
+	halfSize[count] = particleSize / 2;
+	color[count] = particleColor;
+	count++;
+}
+
+void ParticleSystem::burst(float px, float py, unsigned int particles,
+		float speed, float lifetime, sf::Color particleColor) {
+	std::uniform_real_distribution<float> angle(0, 6.2831853f);
+	std::uniform_real_distribution<float> fraction(0.25f, 1);
+	for (unsigned int i = 0; i < particles && count < capacity; i++) {
+		float a = angle(random), s = speed * fraction(random);
+		emit(px, py, std::cos(a) * s, std::sin(a) * s,
+				lifetime * fraction(random), 3 + 5 * fraction(random),
+				particleColor);
+	}
+}
+
+void ParticleSystem::emitBlockEvents(World &world) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	float blockSize = (float) blockManager->getBlockSize();
+	for (const auto &event : blockManager->collectEvents()) {
+		float centreX = (event.cellX + 0.5f) * blockSize;
+		float centreY = (event.cellY + 0.5f) * blockSize;
+		switch (event.kind) {
+		case BlockManager<accur, gen>::BlockAdded:
+			burst(centreX, centreY, 12, 120, 0.4f, sf::Color(200, 200, 200));
+			break;
+		case BlockManager<accur, gen>::BlockRemoved:
+			burst(centreX, centreY, 24, 220, 0.7f, sf::Color(150, 120, 90));
+			break;
+		case BlockManager<accur, gen>::BlockTurned:
+			burst(centreX, centreY, 16, 160, 0.5f, sf::Color(90, 160, 255));
+			break;
+		case BlockManager<accur, gen>::BlockCollided:
+			burst(centreX, centreY, 6, 90, 0.3f, sf::Color(255, 220, 120));
+			break;
+		}
+	}
+}
+
+void ParticleSystem::update(float dt, ThreadPool &pool) {
+	pool.parallelFor<std::size_t>(0, count, grain,
+			[this, dt](std::size_t begin, std::size_t end) {
+				integrate(begin, end, dt);
+			});
+	removeDead();
+	pool.parallelFor<std::size_t>(0, count, grain,
+			[this](std::size_t begin, std::size_t end) {
+				buildVertices(begin, end);
+			});
+}
+
+void ParticleSystem::integrate(std::size_t begin, std::size_t end,
+		float dt) {
+	// Plain arrays and no branches, so this vectorizes
+	float *px = x.data(), *py = y.data(), *pvx = vx.data(), *pvy = vy.data();
+	float *plife = life.data();
+	for (std::size_t i = begin; i < end; i++) {
+		px[i] += pvx[i] * dt;
+		pvy[i] += gravity * dt;
+		py[i] += pvy[i] * dt;
+		plife[i] -= dt;
+	}
+}
+
+/*
+ * Swaps the last live particle into every hole
+ */
+void ParticleSystem::removeDead() {
+	std::size_t i = 0;
+	while (i < count) {
+		if (life[i] > 0) {
+			i++;
+			continue;
+		}
+		count--;
+		x[i] = x[count];
+		y[i] = y[count];
+		vx[i] = vx[count];
+		vy[i] = vy[count];
+		life[i] = life[count];
+		inverseLifetime[i] = inverseLifetime[count];
+		halfSize[i] = halfSize[count];
+		color[i] = color[count];
+	}
+}
+
+void ParticleSystem::buildVertices(std::size_t begin, std::size_t end) {
+	sf::Vertex *quad = &vertices[begin * 4];
+	for (std::size_t i = begin; i < end; i++, quad += 4) {
+		float half = halfSize[i];
+		float left = x[i] - half, right = x[i] + half;
+		float top = y[i] - half, bottom = y[i] + half;
+		sf::Color tint = color[i];
+		// Fades out over its life
+		tint.a = (sf::Uint8) (tint.a * (life[i] * inverseLifetime[i]));
+		quad[0].position = sf::Vector2f(left, top);
+		quad[1].position = sf::Vector2f(right, top);
+		quad[2].position = sf::Vector2f(right, bottom);
+		quad[3].position = sf::Vector2f(left, bottom);
+		quad[0].color = tint;
+		quad[1].color = tint;
+		quad[2].color = tint;
+		quad[3].color = tint;
+	}
+}
+
+void ParticleSystem::draw(sf::RenderTarget &target,
+		sf::RenderStates states) const {
+	if (count == 0) {
+		return;
+	}
+	states.texture = atlas;
+	// Only the front of the array holds live particles
+	target.draw(&vertices[0], count * 4, sf::Quads, states);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * RebuildCheck.cpp
+ *
+ *  Created on: Nov 2, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <World.hpp>
+#include <TextureManager.hpp>
+#include <ThreadPool.hpp>
+
+/*
+ * enemycraft-rebuildcheck [width] [height] [deferred lines] [lines per slice]
+ * Puts a cross of resting blocks in an empty world (in pixels, like the
+ * server), then adds and clears whole rows and columns of magnets in bulk
+ * edits, with endEdit() only rebuilding the deferred lines and the rest
+ * left to rebuildForces() slices like the "forces" background job does.
+ * World::wakePushedBlocks() only looks at a resting block when
+ * collectChangedCells() hands it out, so every block has to be handed out
+ * again after the last change to the forces on it. Fails if any block ends
+ * up with a force other than the one it had when it was last handed out.
+ */
+int main(int argc, char **argv) {
+	unsigned int width = argc > 1 ? std::stoi(argv[1]) : 1920;
+	unsigned int height = argc > 2 ? std::stoi(argv[2]) : 1080;
+	gen deferredLines = argc > 3 ? std::stoi(argv[3]) : 1;
+	gen linesPerSlice = argc > 4 ? std::stoi(argv[4]) : 1;
+
+	TextureManager textureManager;
+	ThreadPool threadPool;
+	World world(width, height, textureManager, threadPool, 1);
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	gen cellsX = blockManager->getWidth(), cellsY = blockManager->getHeight();
+	gen blockSize = blockManager->getBlockSize();
+	const OccupancyMap<gen> &occupancy = blockManager->getOccupancy();
+
+	blockManager->fillRect(cellsX / 2, 1, 1, cellsY - 1, 0);
+	blockManager->fillRect(1, cellsY / 2, cellsX - 1, 1, 0);
+	blockManager->setDeferredRebuildLines(deferredLines);
+
+	// The force on each block when collectChangedCells() last handed it out
+	std::vector<Point<accur>> seen(cellsX * cellsY);
+	auto getForce = [&](gen x, gen y) {
+		return blockManager->getForceTable()->getForce((accur) (x * blockSize),
+				(accur) (y * blockSize));
+	};
+	auto handOut = [&]() {
+		for (const Point<gen> &cell : blockManager->collectChangedCells()) {
+			if (occupancy.test(cell.x, cell.y)) {
+				seen[cell.y * cellsX + cell.x] = getForce(cell.x, cell.y);
+			}
+		}
+	};
+	handOut();
+
+	unsigned long missed = 0;
+	int slices = 0;
+	for (int direction = 1; direction < BlockManager<accur, gen>::directions;
+			direction++) {
+		for (int kind : { direction, BlockManager<accur, gen>::emptyCell }) {
+			// Magnets along the left and top edge, pointing across the world
+			blockManager->beginEdit();
+			blockManager->fillRect(0, 0, 1, cellsY, kind);
+			blockManager->fillRect(1, 0, cellsX - 1, 1, kind);
+			blockManager->endEdit();
+			handOut();
+			while (blockManager->rebuildForces(linesPerSlice)) {
+				handOut();
+				slices++;
+			}
+			handOut();
+
+			for (gen y = 1; y < cellsY; y++) {
+				for (gen x = 1; x < cellsX; x++) {
+					if (!occupancy.test(x, y)) {
+						continue;
+					}
+					Point<accur> force = getForce(x, y);
+					const Point<accur> &last = seen[y * cellsX + x];
+					if (force.x != last.x || force.y != last.y) {
+						missed++;
+					}
+				}
+			}
+		}
+	}
+
+	std::cout << cellsX << "x" << cellsY << " cells, " << slices
+			<< " rebuild slices after the edits" << std::endl;
+	if (missed > 0) {
+		std::cout << missed
+				<< " blocks had their forces changed without being handed out"
+				<< std::endl;
+		return 1;
+	}
+	std::cout << "Every changed block was handed out" << std::endl;
+	return 0;
+}
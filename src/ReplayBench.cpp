@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ReplayBench.cpp
+ *
+ *  Created on: Nov 4, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include <World.hpp>
+#include <WorldSnapshot.hpp>
+#include <DeltaCodec.hpp>
+#include <TextureManager.hpp>
+#include <ThreadPool.hpp>
+
+/*
+ * enemycraft-replaybench [width] [height] [ticks] [keyframe interval]
+ * Records every tick of a few scenario worlds (in pixels, like the server)
+ * the way ReplayRecorder does and prints the bytes per tick of the deltas
+ * against a naive dump, and how long encoding and decoding a tick took:
+ *   settling - a freshly generated world coming to rest
+ *   editing  - the same with blocks added, removed and turned all the time,
+ *              like the server's bots do
+ *   magnets  - a slab of magnets dropped into the middle of the world
+ * Fails if any delta doesn't decode back to the snapshot it was made from.
+ */
+
+enum Scenario {
+	Settling, Editing, Magnets, NumScenarios
+};
+
+static bool sameSnapshot(const WorldSnapshot &a, const WorldSnapshot &b) {
+	return a.states == b.states && a.offsetX == b.offsetX
+			&& a.offsetY == b.offsetY && a.velocityX == b.velocityX
+			&& a.velocityY == b.velocityY;
+}
+
+int main(int argc, char **argv) {
+	unsigned int width = argc > 1 ? std::stoi(argv[1]) : 1920;
+	unsigned int height = argc > 2 ? std::stoi(argv[2]) : 1080;
+	unsigned int ticks = argc > 3 ? std::stoi(argv[3]) : 600;
+	unsigned int keyframes = argc > 4 ? std::stoi(argv[4]) : 300;
+
+	static const char *names[NumScenarios] = { "settling", "editing",
+			"magnets" };
+	TextureManager textureManager;
+	ThreadPool threadPool;
+	accur dt = (accur) 1 / (accur) 60;
+	bool allDecoded = true;
+
+	for (int scenario = 0; scenario < NumScenarios; scenario++) {
+		World world(width, height, textureManager, threadPool, 1);
+		world.generate();
+		BlockManager<accur, gen> *blockManager = world.getBlockManager();
+		gen cellsX = blockManager->getWidth(), cellsY = blockManager->getHeight();
+		gen blockSize = blockManager->getBlockSize();
+		if (scenario == Magnets) {
+			blockManager->fillRect(cellsX / 3, cellsY / 4, cellsX / 3, 3, 4);
+		}
+		std::mt19937 rands(scenario);
+
+		SnapshotEncoder encoder(2);
+		SnapshotDecoder decoder(2);
+		WorldSnapshot snapshot, decoded;
+		std::vector<std::uint8_t> buffer;
+		unsigned long long encodedBytes = 0, naiveBytes = 0;
+		double encodeSeconds = 0, decodeSeconds = 0;
+
+		for (unsigned int tick = 0; tick < ticks; tick++) {
+			if (scenario == Editing && tick % 3 == 0) {
+				accur x = (accur) ((gen) (rands() % cellsX) * blockSize);
+				accur y = (accur) ((gen) (rands() % cellsY) * blockSize);
+				switch (rands() % 3) {
+				case 0:
+					world.addBlock(x, y);
+					break;
+				case 1:
+					world.removeBlock(x, y);
+					break;
+				default:
+					world.rotateBlock(x, y);
+					break;
+				}
+			}
+			world.step(dt);
+
+			auto start = std::chrono::steady_clock::now();
+			snapshot.capture(world, tick);
+			if (keyframes > 0 && tick % keyframes == 0) {
+				encoder.reset();
+			}
+			buffer.clear();
+			encoder.encode(snapshot, buffer);
+			encoder.acknowledge(tick);
+			auto encoded = std::chrono::steady_clock::now();
+			bool ok = decoder.decode(buffer.data(), buffer.size(), decoded);
+			decodeSeconds += std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - encoded).count();
+			encodeSeconds += std::chrono::duration<double>(encoded - start).count();
+
+			if (!ok || !sameSnapshot(decoded, encoder.getLastSent())) {
+				std::cout << names[scenario] << ": tick " << tick
+						<< " does not decode" << std::endl;
+				allDecoded = false;
+				break;
+			}
+			// Same framing as ReplayRecorder, a u32 size per frame
+			encodedBytes += buffer.size() + 4;
+			naiveBytes += snapshot.getNaiveSize();
+		}
+
+		std::cout << names[scenario] << ": " << (double) encodedBytes / ticks
+				<< " bytes per tick (naive " << (double) naiveBytes / ticks
+				<< ", " << (double) naiveBytes / encodedBytes << " to 1), "
+				<< encodeSeconds * 1e6 / ticks << " us to encode and "
+				<< decodeSeconds * 1e6 / ticks << " us to decode a tick, "
+				<< blockManager->getOccupancy().getAwakeCount()
+				<< " blocks moving at the end" << std::endl;
+	}
+	return allDecoded ? 0 : 1;
+}
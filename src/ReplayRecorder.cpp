@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ReplayRecorder.cpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <chrono>
+#include <stdexcept>
+
+#include <ReplayRecorder.hpp>
+
+ReplayRecorder::ReplayRecorder(const std::string &path,
+		unsigned long keyframeInterval) :
+		file(path, std::ios::binary), encoder(2), keyframes(keyframeInterval), frames(
+				0), encodedBytes(0), naiveBytes(0), encodeSeconds(0) {
+	if (!file) {
+		throw std::runtime_error("Unable to open replay file: " + path);
+	}
+}
+
+void ReplayRecorder::record(World &world, unsigned long tick) {
+	auto start = std::chrono::steady_clock::now();
+	snapshot.capture(world, tick);
+	if (keyframes > 0 && frames % keyframes == 0) {
+		encoder.reset();
+	}
+	buffer.clear();
+	encoder.encode(snapshot, buffer);
+	// A file never loses frames, so each one is acknowledged straight away
+	encoder.acknowledge(tick);
+	encodeSeconds += std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+
+	std::uint32_t size = buffer.size();
+	std::uint8_t header[4] = { (std::uint8_t) size, (std::uint8_t) (size >> 8),
+			(std::uint8_t) (size >> 16), (std::uint8_t) (size >> 24) };
+	file.write((const char*) header, sizeof(header));
+	file.write((const char*) buffer.data(), buffer.size());
+
+	frames++;
+	encodedBytes += buffer.size() + sizeof(header);
+	naiveBytes += snapshot.getNaiveSize();
+}
+
+void ReplayRecorder::printStats(std::ostream &out) const {
+	if (frames == 0) {
+		return;
+	}
+	out << "Replay: " << frames << " ticks, "
+			<< (double) encodedBytes / frames << " bytes per tick (naive "
+			<< (double) naiveBytes / frames << "), "
+			<< encodeSeconds * 1e6 / frames << " us to encode a tick"
+			<< std::endl;
+}
+
+long ReplayRecorder::verify(const std::string &path, double &decodeSeconds) {
+	std::ifstream in(path, std::ios::binary);
+	SnapshotDecoder decoder(2);
+	WorldSnapshot frame;
+	std::vector<std::uint8_t> data;
+	long count = 0;
+	decodeSeconds = 0;
+	std::uint8_t header[4];
+	while (in.read((char*) header, sizeof(header))) {
+		std::uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16)
+				| ((std::uint32_t) header[3] << 24);
+		data.resize(size);
+		if (!in.read((char*) data.data(), size)) {
+			return -1;
+		}
+		auto start = std::chrono::steady_clock::now();
+		bool ok = decoder.decode(data.data(), data.size(), frame);
+		decodeSeconds += std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+		if (!ok) {
+			return -1;
+		}
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * Server.cpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include <Server.hpp>
+
+Server::Server(World &w, std::uint16_t port, unsigned int rate) :
+		world(w), socket(port), tickRate(rate), tickCount(0), recorder(nullptr), sharedView(
+				nullptr) {
+	tickLength = (accur) 1 / (int) tickRate;
+}
+
+void Server::run(const std::atomic<bool> &running) {
+	auto period = std::chrono::nanoseconds(1000000000 / tickRate);
+	auto nextTick = std::chrono::steady_clock::now();
+	while (running) {
+		tick();
+		nextTick += period;
+		auto now = std::chrono::steady_clock::now();
+		if (nextTick < now) {
+			// Fell behind, don't try to catch up with a burst of ticks
+			nextTick = now;
+		}
+		std::this_thread::sleep_until(nextTick);
+	}
+}
+
+void Server::tick() {
+	AllocationScope scope(AllocationTracker::Networking);
+	receivePackets();
+	dropSilentClients();
+	world.step(tickLength);
+	if (recorder != nullptr) {
+		recorder->record(world, tickCount);
+	}
+	if (sharedView != nullptr) {
+		sharedView->publish(tickCount, tickCount);
+	}
+	for (auto &entry : clients) {
+		replicate(entry.first, entry.second);
+	}
+	tickCount++;
+	AllocationTracker::endFrame();
+}
+
+void Server::receivePackets() {
+	NetAddress from;
+	while (socket.receive(from, receiveBuffer)) {
+		PacketReader reader(receiveBuffer);
+		if (reader.isValid()) {
+			handlePacket(from, reader);
+		}
+	}
+}
+
+void Server::handlePacket(const NetAddress &from, PacketReader &reader) {
+	switch (reader.getType()) {
+	case MessageType::Hello:
+	case MessageType::Viewport: {
+		gen x = reader.readI32();
+		gen y = reader.readI32();
+		gen w = reader.readU16();
+		gen h = reader.readU16();
+		if (!reader.isValid()) {
+			break;
+		}
+		// The client picks where it looks, not how much it costs to replicate
+		gen cellsX = world.getBlockManager()->getWidth();
+		gen cellsY = world.getBlockManager()->getHeight();
+		x = std::clamp<gen>(x, 0, cellsX);
+		y = std::clamp<gen>(y, 0, cellsY);
+		w = std::min( { w, maxViewCells, cellsX - x });
+		h = std::min( { h, maxViewCells, cellsY - y });
+		bool isNew = clients.find(from) == clients.end();
+		ClientState &client = clients[from];
+		client.viewX = x;
+		client.viewY = y;
+		client.viewW = w;
+		client.viewH = h;
+		client.lastHeard = std::chrono::steady_clock::now();
+		if (reader.getType() == MessageType::Hello) {
+			PacketWriter welcome(MessageType::Welcome);
+			welcome.writeU32(world.getWidth());
+			welcome.writeU32(world.getHeight());
+			welcome.writeU16(world.getBlockManager()->getBlockSize());
+			welcome.writeU16(tickRate);
+			socket.send(from, welcome.getBytes());
+			if (isNew) {
+				std::cout << "Client joined: " << from.toString() << std::endl;
+			}
+		}
+		break;
+	}
+	case MessageType::Command: {
+		auto found = clients.find(from);
+		CommandAction action = (CommandAction) reader.readU8();
+		std::int32_t pixelX = reader.readI32();
+		std::int32_t pixelY = reader.readI32();
+		if (found == clients.end() || !reader.isValid()) {
+			break;
+		}
+		found->second.lastHeard = std::chrono::steady_clock::now();
+		// Anything outside of the world can't even be converted to accur safely
+		if (pixelX < 0 || pixelY < 0
+				|| (std::uint32_t) pixelX >= world.getWidth()
+				|| (std::uint32_t) pixelY >= world.getHeight()) {
+			break;
+		}
+		accur x = (accur) pixelX, y = (accur) pixelY;
+		switch (action) {
+		case CommandAction::AddBlock:
+			world.addBlock(x, y);
+			break;
+		case CommandAction::RemoveBlock:
+			world.removeBlock(x, y);
+			break;
+		case CommandAction::RotateBlock:
+			world.rotateBlock(x, y);
+			break;
+		default:
+			break;
+		}
+		break;
+	}
+	case MessageType::Bye:
+		if (clients.erase(from) > 0) {
+			std::cout << "Client left: " << from.toString() << std::endl;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void Server::dropSilentClients() {
+	auto now = std::chrono::steady_clock::now();
+	for (auto it = clients.begin(); it != clients.end();) {
+		if (now - it->second.lastHeard
+				> std::chrono::seconds(clientTimeoutSeconds)) {
+			std::cout << "Client timed out: " << it->first.toString()
+					<< std::endl;
+			it = clients.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void Server::replicate(const NetAddress &address, ClientState &client) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	gen size = ChunkGrid<gen>::chunkSize;
+
+	gen firstX = std::max<gen>(0, client.viewX / size - interestMargin);
+	gen firstY = std::max<gen>(0, client.viewY / size - interestMargin);
+	gen lastX = std::min<gen>(grid.getChunksX() - 1,
+			(client.viewX + client.viewW) / size + interestMargin);
+	gen lastY = std::min<gen>(grid.getChunksY() - 1,
+			(client.viewY + client.viewH) / size + interestMargin);
+
+	for (gen chunkY = firstY; chunkY <= lastY; chunkY++) {
+		for (gen chunkX = firstX; chunkX <= lastX; chunkX++) {
+			gen index = grid.getChunkIndexOf(chunkX, chunkY);
+			unsigned long revision = blockManager->getChunkRevision(index);
+			auto sent = client.sentChunks.find(index);
+			if (sent != client.sentChunks.end()
+					&& sent->second.revision == revision
+					&& tickCount - sent->second.tick < resendTicks) {
+				continue;
+			}
+			PacketWriter writer(MessageType::ChunkState);
+			writeChunk(writer, chunkX, chunkY);
+			socket.send(address, writer.getBytes());
+			client.sentChunks[index] = ChunkSendState { revision, tickCount };
+		}
+	}
+
+	// Forget chunks that left the area so they are sent fresh when they come back
+	for (auto it = client.sentChunks.begin(); it != client.sentChunks.end();) {
+		Point<gen> coord = grid.getChunkCoord(it->first);
+		if (coord.x < firstX || coord.x > lastX || coord.y < firstY
+				|| coord.y > lastY) {
+			it = client.sentChunks.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void Server::writeChunk(PacketWriter &writer, gen chunkX, gen chunkY) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	gen blockSize = blockManager->getBlockSize();
+
+	writer.writeU32(tickCount);
+	writer.writeU16(chunkX);
+	writer.writeU16(chunkY);
+	Point<gen> start = grid.getChunkStart(chunkX, chunkY);
+	Point<gen> end = grid.getChunkEnd(chunkX, chunkY);
+	for (gen y = start.y; y < end.y; y++) {
+		for (gen x = start.x; x < end.x; x++) {
+			int kind = blockManager->getCellKind(x, y);
+			if (kind == BlockManager<accur, gen>::emptyCell) {
+				writer.writeU8(0);
+				continue;
+			}
+			Block<accur> *block = blockManager->getAwakeBlock(x, y);
+			Point<accur> coord = block != nullptr ? block->getCoord() :
+					Point<accur>((accur) (x * blockSize), (accur) (y * blockSize));
+			writer.writeU8(1 + kind);
+			writer.writeI32((std::int32_t) ((double) coord.x * positionScale));
+			writer.writeI32((std::int32_t) ((double) coord.y * positionScale));
+		}
+	}
+}
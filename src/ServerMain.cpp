@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ServerMain.cpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <csignal>
+#include <ctime>
+
+#include <Server.hpp>
+#include <NetClient.hpp>
+#include <World.hpp>
+#include <TextureManager.hpp>
+#include <ThreadPool.hpp>
+#include <ReplayRecorder.hpp>
+#include <MetricsExporter.hpp>
+
+/*
+ * Dedicated server: enemycraft-server [port] [tick rate] [width] [height] [bots] [replay file] [shared view] [metrics port] [metrics file]
+ * width and height are in pixels. Bots are loopback clients that join over
+ * localhost UDP, look at a random part of the world and keep editing it.
+ * With a replay file every tick is recorded as a delta, and the size and
+ * speed of the encoding are reported on exit. With a shared view name
+ * (e.g. /enemycraft) every tick is also published in shared memory for
+ * tools like enemycraft-forcedump. A metrics port serves Prometheus metrics
+ * on localhost, a metrics file gets them rewritten every 10 seconds. Pass
+ * "" to leave any of them out.
+ */
+
+static std::atomic<bool> running(true);
+
+static void stop(int) {
+	running = false;
+}
+
+static void runBot(unsigned short port, unsigned int id,
+		TextureManager &textures) {
+	ThreadPool pool(0);
+	NetClient client("127.0.0.1", port, textures, pool);
+	if (!client.connect(5000)) {
+		std::cerr << "bot " << id << " could not connect" << std::endl;
+		return;
+	}
+	BlockManager<accur, gen> *blockManager = client.getWorld()->getBlockManager();
+	gen blockSize = blockManager->getBlockSize();
+	std::mt19937 rands(id);
+	std::uniform_int_distribution<gen> randX(0, blockManager->getWidth() - 1);
+	std::uniform_int_distribution<gen> randY(0, blockManager->getHeight() - 1);
+	std::uniform_int_distribution<int> randAction(1, 3);
+	gen viewX = randX(rands), viewY = randY(rands);
+	client.setViewport(viewX, viewY, 20, 12);
+
+	while (running) {
+		client.poll();
+		gen x = std::min<gen>(viewX + rands() % 20, blockManager->getWidth() - 1);
+		gen y = std::min<gen>(viewY + rands() % 12, blockManager->getHeight() - 1);
+		client.sendCommand((CommandAction) randAction(rands), x * blockSize,
+				y * blockSize);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+	std::cout << "bot " << id << " received " << client.getChunksReceived()
+			<< " chunks" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	unsigned short port = argc > 1 ? std::stoi(argv[1]) : 25570;
+	unsigned int tickRate = argc > 2 ? std::stoi(argv[2]) : 30;
+	unsigned int width = argc > 3 ? std::stoi(argv[3]) : 1920;
+	unsigned int height = argc > 4 ? std::stoi(argv[4]) : 1080;
+	unsigned int numBots = argc > 5 ? std::stoi(argv[5]) : 0;
+	std::string replayPath = argc > 6 ? argv[6] : "";
+	std::string sharedViewName = argc > 7 ? argv[7] : "";
+	unsigned short metricsPort = argc > 8 && *argv[8] ? std::stoi(argv[8]) : 0;
+	std::string metricsPath = argc > 9 ? argv[9] : "";
+
+	std::signal(SIGINT, stop);
+	std::signal(SIGTERM, stop);
+
+	// Headless, so the blocks never get any textures
+	TextureManager textureManager;
+	ThreadPool threadPool;
+	World world(width, height, textureManager, threadPool, time(NULL));
+	world.generate();
+
+	Server server(world, port, tickRate);
+	std::cout << "Enemycraft server on port " << server.getPort() << ", "
+			<< tickRate << " ticks per second" << std::endl;
+
+	ReplayRecorder *recorder = nullptr;
+	if (!replayPath.empty()) {
+		recorder = new ReplayRecorder(replayPath, 10 * tickRate);
+		server.setRecorder(recorder);
+	}
+
+	SharedWorldView *sharedView = nullptr;
+	if (!sharedViewName.empty()) {
+		sharedView = new SharedWorldView(sharedViewName, world);
+		server.setSharedView(sharedView);
+		std::cout << "Sharing the world as " << sharedViewName << " ("
+				<< sharedView->getSize() << " bytes)" << std::endl;
+	}
+
+	MetricsExporter *metricsExporter = nullptr;
+	if (metricsPort != 0 || !metricsPath.empty()) {
+		metricsExporter = new MetricsExporter(metricsPort, metricsPath);
+		if (metricsPort != 0) {
+			std::cout << "Metrics on http://127.0.0.1:" << metricsPort
+					<< "/metrics" << std::endl;
+		}
+	}
+
+	std::vector<std::thread> bots;
+	for (unsigned int i = 0; i < numBots; i++) {
+		bots.emplace_back(runBot, server.getPort(), i, std::ref(textureManager));
+	}
+
+	server.run(running);
+
+	for (auto &bot : bots) {
+		bot.join();
+	}
+	std::cout << "Stopped after " << server.getTick() << " ticks" << std::endl;
+	const ForceTable<gen, accur> &forces = *world.getBlockManager()->getForceTable();
+	if (forces.getColdTiles() > 0) {
+		std::cout << "Cold chunks: " << forces.getColdTiles() << " of "
+				<< forces.getTileCount() << ", packed "
+				<< (double) forces.getUnpackedBytes(forces.getColdTiles())
+						/ forces.getPackedBytes() << " to 1" << std::endl;
+	}
+	if (forces.getDecodes() > 0) {
+		std::cout << "Unpacked " << forces.getDecodes() << " chunks, "
+				<< forces.getDecodeNanos() / 1e3 / forces.getDecodes()
+				<< " us each" << std::endl;
+	}
+	delete sharedView;
+	delete metricsExporter;
+
+	if (recorder != nullptr) {
+		recorder->printStats(std::cout);
+		delete recorder;
+		double decodeSeconds;
+		long frames = ReplayRecorder::verify(replayPath, decodeSeconds);
+		if (frames < 0) {
+			std::cerr << "Replay file does not decode!" << std::endl;
+			return 1;
+		}
+		std::cout << "Replay decodes: " << frames << " ticks, "
+				<< decodeSeconds * 1e6 / (frames > 0 ? frames : 1)
+				<< " us to decode a tick" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * SharedWorldReader.cpp
+ *
+ *  Created on: Oct 26, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <SharedWorldReader.hpp>
+
+SharedWorldReader::SharedWorldReader(const std::string &segmentName) :
+		size(0), base(nullptr), header(nullptr) {
+	int handle = shm_open(segmentName.c_str(), O_RDONLY, 0);
+	if (handle < 0) {
+		throw std::runtime_error(
+				"Unable to open shared memory " + segmentName + ": "
+						+ std::strerror(errno));
+	}
+	struct stat info;
+	if (fstat(handle, &info) != 0
+			|| (std::size_t) info.st_size < sizeof(SharedWorldHeader)) {
+		close(handle);
+		throw std::runtime_error(segmentName + " is not a shared world");
+	}
+	size = (std::size_t) info.st_size;
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, handle, 0);
+	close(handle);
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error(
+				"Unable to map shared memory " + segmentName + ": "
+						+ std::strerror(errno));
+	}
+	base = (const unsigned char*) mapped;
+	header = (const SharedWorldHeader*) base;
+}
+
+SharedWorldReader::~SharedWorldReader() {
+	munmap((void*) base, size);
+}
+
+bool SharedWorldReader::read(SharedWorldFrame &frame, int maxAttempts) const {
+	for (int attempt = 0; attempt < maxAttempts; attempt++) {
+		std::uint64_t before = header->sequence.load(std::memory_order_acquire);
+		if (before % 2 != 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		// Set up once before the first publish, so even sequences mean they are valid
+		if (header->magic != sharedWorldMagic
+				|| header->version != sharedWorldVersion
+				|| header->totalSize > size) {
+			return false;
+		}
+		std::size_t cells = (std::size_t) header->width * header->height;
+		std::size_t words = (std::size_t) header->wordsPerRow * header->height;
+		frame.width = header->width;
+		frame.height = header->height;
+		frame.blockSize = header->blockSize;
+		frame.wordsPerRow = header->wordsPerRow;
+		frame.occupied.resize(words);
+		frame.magnetic.resize(words);
+		frame.forceX.resize(cells);
+		frame.forceY.resize(cells);
+
+		frame.tick = header->tick;
+		frame.frame = header->frame;
+		frame.publishedNanos = header->publishedNanos;
+		std::memcpy(frame.occupied.data(), base + header->occupiedOffset,
+				words * sizeof(std::uint64_t));
+		std::memcpy(frame.magnetic.data(), base + header->magneticOffset,
+				words * sizeof(std::uint64_t));
+		std::memcpy(frame.forceX.data(), base + header->forceXOffset,
+				cells * sizeof(float));
+		std::memcpy(frame.forceY.data(), base + header->forceYOffset,
+				cells * sizeof(float));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->sequence.load(std::memory_order_relaxed) == before) {
+			return true;
+		}
+	}
+	return false;
+}
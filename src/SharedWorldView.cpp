@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * SharedWorldView.cpp
+ *
+ *  Created on: Oct 26, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <new>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <SharedWorldView.hpp>
+
+static std::uint64_t alignUp(std::uint64_t offset) {
+	return (offset + 63) / 64 * 64;
+}
+
+SharedWorldView::SharedWorldView(const std::string &segmentName, World &w) :
+		name(segmentName), world(w), size(0), base(nullptr), header(nullptr) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const BitGrid<gen> &occupied = blockManager->getOccupancy().getOccupied();
+	std::uint64_t cells = (std::uint64_t) blockManager->getWidth()
+			* blockManager->getHeight();
+	std::uint64_t bitBytes = (std::uint64_t) occupied.getWordsPerRow()
+			* occupied.getHeight() * sizeof(std::uint64_t);
+
+	SharedWorldHeader layout;
+	layout.occupiedOffset = alignUp(sizeof(SharedWorldHeader));
+	layout.magneticOffset = alignUp(layout.occupiedOffset + bitBytes);
+	layout.forceXOffset = alignUp(layout.magneticOffset + bitBytes);
+	layout.forceYOffset = alignUp(layout.forceXOffset + cells * sizeof(float));
+	layout.totalSize = alignUp(layout.forceYOffset + cells * sizeof(float));
+	size = layout.totalSize;
+
+	int handle = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (handle < 0) {
+		throw std::runtime_error(
+				"Unable to create shared memory " + name + ": "
+						+ std::strerror(errno));
+	}
+	if (ftruncate(handle, (off_t) size) != 0) {
+		std::string error = std::strerror(errno);
+		close(handle);
+		shm_unlink(name.c_str());
+		throw std::runtime_error("Unable to size shared memory " + name + ": " + error);
+	}
+	void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			handle, 0);
+	close(handle);
+	if (mapped == MAP_FAILED) {
+		std::string error = std::strerror(errno);
+		shm_unlink(name.c_str());
+		throw std::runtime_error("Unable to map shared memory " + name + ": " + error);
+	}
+	base = (unsigned char*) mapped;
+	header = new (base) SharedWorldHeader();
+	header->sequence.store(1, std::memory_order_relaxed);
+	header->magic = sharedWorldMagic;
+	header->version = sharedWorldVersion;
+	header->tick = 0;
+	header->frame = 0;
+	header->publishedNanos = 0;
+	header->width = blockManager->getWidth();
+	header->height = blockManager->getHeight();
+	header->blockSize = blockManager->getBlockSize();
+	header->wordsPerRow = occupied.getWordsPerRow();
+	header->occupiedOffset = layout.occupiedOffset;
+	header->magneticOffset = layout.magneticOffset;
+	header->forceXOffset = layout.forceXOffset;
+	header->forceYOffset = layout.forceYOffset;
+	header->totalSize = layout.totalSize;
+	publish(0, 0);
+}
+
+SharedWorldView::~SharedWorldView() {
+	munmap(base, size);
+	shm_unlink(name.c_str());
+}
+
+void SharedWorldView::publish(std::uint64_t tick, std::uint64_t frame) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const OccupancyMap<gen> &occupancy = blockManager->getOccupancy();
+	ForceTable<gen, accur> *forces = blockManager->getForceTable();
+	std::size_t bitBytes = (std::size_t) header->wordsPerRow * header->height
+			* sizeof(std::uint64_t);
+
+	// Odd: readers that start now or are halfway through throw their copy away
+	std::uint64_t sequence = header->sequence.load(std::memory_order_relaxed)
+			| 1;
+	header->sequence.store(sequence, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	header->tick = tick;
+	header->frame = frame;
+	header->publishedNanos =
+			std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+	std::memcpy(base + header->occupiedOffset,
+			occupancy.getOccupied().getRow(0), bitBytes);
+	std::memcpy(base + header->magneticOffset,
+			occupancy.getMagnetic().getRow(0), bitBytes);
+	float *forceX = (float*) (base + header->forceXOffset);
+	float *forceY = (float*) (base + header->forceYOffset);
+	forces->copyForces(forceX, forceY);
+
+	header->sequence.store(sequence + 1, std::memory_order_release);
+}
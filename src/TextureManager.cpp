@@ -24,26 +24,205 @@
  */
 
 #include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
 #include <SFML/Graphics.hpp>
 
 #include <TextureManager.hpp>
 
-bool TextureManager::loadNormalBlock(std::string path) {
-	return normalBlock.loadFromFile(path);
+// Bump whenever the cache layout changes
+static const std::uint32_t atlasCacheMagic = 0x31534C54; // "TLS1"
+// Gap between tiles so smoothing never samples a neighbour
+static const unsigned int tilePadding = 1;
+static const unsigned int maxAtlasWidth = 4096;
+
+static void writeU32(std::ofstream &out, std::uint32_t value) {
+	char bytes[4] = { (char) value, (char) (value >> 8), (char) (value >> 16),
+			(char) (value >> 24) };
+	out.write(bytes, sizeof(bytes));
+}
+
+static void writeU64(std::ofstream &out, std::uint64_t value) {
+	writeU32(out, (std::uint32_t) value);
+	writeU32(out, (std::uint32_t) (value >> 32));
+}
+
+static std::uint32_t readU32(std::ifstream &in) {
+	unsigned char bytes[4] = { 0, 0, 0, 0 };
+	in.read((char*) bytes, sizeof(bytes));
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16)
+			| ((std::uint32_t) bytes[3] << 24);
+}
+
+static std::uint64_t readU64(std::ifstream &in) {
+	std::uint64_t low = readU32(in);
+	return low | ((std::uint64_t) readU32(in) << 32);
 }
 
-bool TextureManager::loadMagnetUpBlock(std::string path) {
-	return magnetUpBlock.loadFromFile(path);
+TextureManager::TextureManager() :
+		loadedFromCache(false) {
 }
 
-bool TextureManager::loadMagnetDownBlock(std::string path) {
-	return magnetDownBlock.loadFromFile(path);
+// FNV-1a
+std::uint64_t TextureManager::hashBytes(const std::vector<char> &bytes) {
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (char c : bytes) {
+		hash ^= (unsigned char) c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
 }
 
-bool TextureManager::loadMagnetLeftBlock(std::string path) {
-	return magnetLeftBlock.loadFromFile(path);
+void TextureManager::loadTiles(const std::vector<std::string> &paths,
+		const std::string &cachePath, ThreadPool &pool) {
+	std::vector<Source> sources(paths.size());
+	pool.run(paths.size(), [&](std::size_t i) {
+		Source &source = sources[i];
+		source.path = paths[i];
+		std::ifstream in(paths[i], std::ios::binary);
+		source.bytes.assign(std::istreambuf_iterator<char>(in),
+				std::istreambuf_iterator<char>());
+		source.readOk = in.is_open() && !source.bytes.empty();
+		source.hash = hashBytes(source.bytes);
+	});
+	for (const Source &source : sources) {
+		if (!source.readOk) {
+			throw std::runtime_error("Unable to read texture: " + source.path);
+		}
+	}
+
+	loadedFromCache = loadCache(cachePath, sources);
+	if (!loadedFromCache) {
+		bakeAtlas(sources, cachePath, pool);
+	}
+}
+
+bool TextureManager::loadCache(const std::string &cachePath,
+		const std::vector<Source> &sources) {
+	std::ifstream in(cachePath, std::ios::binary);
+	if (!in || readU32(in) != atlasCacheMagic
+			|| readU32(in) != sources.size()) {
+		return false;
+	}
+	std::vector<sf::IntRect> rects;
+	for (const Source &source : sources) {
+		std::uint32_t pathLength = readU32(in);
+		if (!in || pathLength > 4096) {
+			return false;
+		}
+		std::string path(pathLength, '\0');
+		in.read(&path[0], pathLength);
+		if (!in || path != source.path || readU64(in) != source.hash) {
+			return false;
+		}
+		int left = readU32(in), top = readU32(in);
+		int width = readU32(in), height = readU32(in);
+		rects.push_back(sf::IntRect(left, top, width, height));
+	}
+	unsigned int width = readU32(in), height = readU32(in);
+	if (!in || width == 0 || height == 0 || width > maxAtlasWidth * 4
+			|| height > maxAtlasWidth * 4) {
+		return false;
+	}
+	std::vector<sf::Uint8> pixels((std::size_t) width * height * 4);
+	in.read((char*) pixels.data(), pixels.size());
+	if (!in) {
+		return false;
+	}
+	sf::Image image;
+	image.create(width, height, pixels.data());
+	if (!atlas.loadFromImage(image)) {
+		return false;
+	}
+	tileRects = rects;
+	return true;
+}
+
+void TextureManager::bakeAtlas(std::vector<Source> &sources,
+		const std::string &cachePath, ThreadPool &pool) {
+	std::vector<sf::Image> images(sources.size());
+	std::vector<char> decoded(sources.size(), 0);
+	pool.run(sources.size(), [&](std::size_t i) {
+		decoded[i] = images[i].loadFromMemory(sources[i].bytes.data(),
+				sources[i].bytes.size());
+	});
+	unsigned long long area = 0;
+	unsigned int widest = 0;
+	for (std::size_t i = 0; i < sources.size(); i++) {
+		if (!decoded[i]) {
+			throw std::runtime_error(
+					"Unable to decode texture: " + sources[i].path);
+		}
+		sf::Vector2u size = images[i].getSize();
+		area += (unsigned long long) (size.x + tilePadding)
+				* (size.y + tilePadding);
+		widest = std::max(widest, size.x + tilePadding);
+	}
+
+	// Shelf packing, tallest tiles first, into a roughly square atlas
+	unsigned int atlasWidth = 64;
+	while ((unsigned long long) atlasWidth * atlasWidth < area
+			&& atlasWidth < maxAtlasWidth) {
+		atlasWidth *= 2;
+	}
+	atlasWidth = std::max(atlasWidth, widest);
+	std::vector<std::size_t> order(sources.size());
+	for (std::size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(),
+			[&](std::size_t a, std::size_t b) {
+				return images[a].getSize().y > images[b].getSize().y;
+			});
+	tileRects.assign(sources.size(), sf::IntRect());
+	unsigned int x = 0, y = 0, shelfHeight = 0;
+	for (std::size_t i : order) {
+		sf::Vector2u size = images[i].getSize();
+		if (x + size.x > atlasWidth) {
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		tileRects[i] = sf::IntRect(x, y, size.x, size.y);
+		x += size.x + tilePadding;
+		shelfHeight = std::max(shelfHeight, size.y + tilePadding);
+	}
+	unsigned int atlasHeight = std::max(1u, y + shelfHeight);
+
+	sf::Image image;
+	image.create(atlasWidth, atlasHeight, sf::Color(0, 0, 0, 0));
+	for (std::size_t i = 0; i < sources.size(); i++) {
+		image.copy(images[i], tileRects[i].left, tileRects[i].top);
+	}
+	if (!atlas.loadFromImage(image)) {
+		throw std::runtime_error("Unable to create the texture atlas");
+	}
+	writeCache(cachePath, sources, image);
 }
 
-bool TextureManager::loadMagnetRightBlock(std::string path) {
-	return magnetRightBlock.loadFromFile(path);
+void TextureManager::writeCache(const std::string &cachePath,
+		const std::vector<Source> &sources, const sf::Image &image) {
+	std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		// Not fatal, the next start just bakes again
+		return;
+	}
+	writeU32(out, atlasCacheMagic);
+	writeU32(out, sources.size());
+	for (std::size_t i = 0; i < sources.size(); i++) {
+		writeU32(out, sources[i].path.size());
+		out.write(sources[i].path.data(), sources[i].path.size());
+		writeU64(out, sources[i].hash);
+		writeU32(out, tileRects[i].left);
+		writeU32(out, tileRects[i].top);
+		writeU32(out, tileRects[i].width);
+		writeU32(out, tileRects[i].height);
+	}
+	sf::Vector2u size = image.getSize();
+	writeU32(out, size.x);
+	writeU32(out, size.y);
+	out.write((const char*) image.getPixelsPtr(),
+			(std::size_t) size.x * size.y * 4);
 }
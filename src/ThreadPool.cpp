@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * ThreadPool.cpp
+ *
+ *  Created on: Oct 10, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include <ThreadPool.hpp>
+
+ThreadPool::ThreadPool() :
+		ThreadPool(
+				std::thread::hardware_concurrency() > 1 ?
+						std::thread::hardware_concurrency() - 1 : 0) {
+
+}
+
+ThreadPool::ThreadPool(unsigned int numWorkers) :
+		currentTask(nullptr), currentContext(nullptr), taskCount(0), nextTask(0), finishedTasks(0), activeWorkers(
+				0), batchId(0), stopping(false), busyTime(
+				Metrics::counter("enemycraft_pool_busy_seconds_total",
+						"Time the thread pools spent running tasks", "", 1e-9)), tasksRun(
+				Metrics::counter("enemycraft_pool_tasks_total",
+						"Tasks run by the thread pools")) {
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::runTasks(std::size_t numTasks, TaskFunction function,
+		const void *context) {
+	if (numTasks == 0) {
+		return;
+	}
+	// Not worth waking anyone up for
+	if (numTasks == 1 || workers.empty()) {
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < numTasks; i++) {
+			function(context, i);
+		}
+		busyTime.add(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start).count());
+		tasksRun.add(numTasks);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentTask = function;
+		currentContext = context;
+		currentTag = AllocationTracker::getTag();
+		taskCount = numTasks;
+		nextTask = 0;
+		finishedTasks = 0;
+		batchId++;
+	}
+	wakeUp.notify_all();
+	drainTasks();
+
+	// Workers still inside drainTasks() must leave before the next batch resets nextTask
+	std::unique_lock<std::mutex> lock(mutex);
+	batchDone.wait(lock, [this] {
+		return finishedTasks == taskCount && activeWorkers == 0;
+	});
+	currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+	unsigned long seenBatch = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [&] {
+				return stopping || (batchId != seenBatch && currentTask != nullptr);
+			});
+			if (stopping) {
+				return;
+			}
+			seenBatch = batchId;
+			activeWorkers++;
+		}
+		drainTasks();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers--;
+		}
+		batchDone.notify_all();
+	}
+}
+
+void ThreadPool::drainTasks() {
+	std::size_t done = 0;
+	std::size_t i;
+	AllocationScope scope(currentTag);
+	auto start = std::chrono::steady_clock::now();
+	while ((i = nextTask.fetch_add(1)) < taskCount) {
+		currentTask(currentContext, i);
+		done++;
+	}
+	if (done > 0) {
+		busyTime.add(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start).count());
+		tasksRun.add(done);
+		std::lock_guard<std::mutex> lock(mutex);
+		finishedTasks += done;
+		if (finishedTasks == taskCount) {
+			batchDone.notify_all();
+		}
+	}
+}
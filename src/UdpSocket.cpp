@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * UdpSocket.cpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <UdpSocket.hpp>
+
+NetAddress NetAddress::resolve(const std::string &hostName,
+		std::uint16_t port) {
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo *result = nullptr;
+	if (getaddrinfo(hostName.c_str(), nullptr, &hints, &result) != 0
+			|| result == nullptr) {
+		throw std::runtime_error("Unable to resolve host: " + hostName);
+	}
+	std::uint32_t host = ntohl(
+			((sockaddr_in*) result->ai_addr)->sin_addr.s_addr);
+	freeaddrinfo(result);
+	return NetAddress(host, port);
+}
+
+std::string NetAddress::toString() const {
+	return std::to_string((host >> 24) & 0xFF) + "."
+			+ std::to_string((host >> 16) & 0xFF) + "."
+			+ std::to_string((host >> 8) & 0xFF) + "."
+			+ std::to_string(host & 0xFF) + ":" + std::to_string(port);
+}
+
+UdpSocket::UdpSocket(std::uint16_t port) {
+	handle = socket(AF_INET, SOCK_DGRAM, 0);
+	if (handle < 0) {
+		throw std::runtime_error(
+				std::string("Unable to open UDP socket: ") + std::strerror(errno));
+	}
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(handle, (sockaddr*) &address, sizeof(address)) < 0) {
+		std::string err = "Unable to bind UDP port " + std::to_string(port)
+				+ ": " + std::strerror(errno);
+		close(handle);
+		throw std::runtime_error(err);
+	}
+	socklen_t length = sizeof(address);
+	getsockname(handle, (sockaddr*) &address, &length);
+	boundPort = ntohs(address.sin_port);
+
+	fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+}
+
+UdpSocket::~UdpSocket() {
+	close(handle);
+}
+
+bool UdpSocket::send(const NetAddress &to,
+		const std::vector<std::uint8_t> &data) {
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(to.host);
+	address.sin_port = htons(to.port);
+	return sendto(handle, data.data(), data.size(), 0, (sockaddr*) &address,
+			sizeof(address)) == (ssize_t) data.size();
+}
+
+bool UdpSocket::receive(NetAddress &from, std::vector<std::uint8_t> &data) {
+	data.resize(maxDatagramSize);
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+	ssize_t received = recvfrom(handle, data.data(), data.size(), 0,
+			(sockaddr*) &address, &length);
+	if (received < 0) {
+		data.clear();
+		return false;
+	}
+	data.resize(received);
+	from = NetAddress(ntohl(address.sin_addr.s_addr), ntohs(address.sin_port));
+	return true;
+}
@@ -0,0 +1,526 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * World.cpp
+ *
+ *  Created on: Oct 12, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <World.hpp>
+#include <TMath.hpp>
+#include <Point.hpp>
+
+World::World(unsigned int width, unsigned int height, TextureManager &manager,
+		ThreadPool &pool, unsigned int seed, BlockRegistry<accur> *sharedTypes,
+		const std::string &name) :
+		blockTypes(sharedTypes != nullptr ? *sharedTypes : ownBlockTypes), generator(
+				nullptr), randDevice(seed), textureManager(manager), threadPool(pool), w(width), h(
+				height), residentChunks(0), generatedPerStep(chunksPerStep), coldTicks(
+				defaultColdTicks), ticks(0), publishedCellsTouched(0), publishedDecodes(
+				0), publishedDecodeNanos(0) {
+	defaultMu = (accur) 0.5;
+	defaultBlockSize = (accur) 50;
+
+	blockManager = new BlockManager<accur, gen>(defaultBlockSize, (accur) 5,
+			width, height, (float) defaultMu, blockTypes, randDevice,
+			threadPool);
+	raycaster = new GridRaycaster<accur, gen>(blockManager->getOccupancy(),
+			blockManager->getBlockSize());
+	materials = new MaterialGrid<gen>(blockManager->getChunkGrid());
+
+	// Unnamed worlds all add to (and set) the same series
+	std::string labels = name.empty() ? "" : "world=\"" + name + "\"";
+	std::string separator = labels.empty() ? "" : ",";
+	static const char *phaseNames[NumPhases] = { "scheduler", "generation",
+			"forces", "velocity", "bounds", "positions", "materials",
+			"flowfields", "light", "cooling" };
+	for (int i = 0; i < NumPhases; i++) {
+		phaseTimes[i] = &Metrics::counter("enemycraft_step_phase_seconds_total",
+				"Time spent in each phase of a world step",
+				labels + separator + "phase=\"" + phaseNames[i] + "\"", 1e-9);
+	}
+	stepTime = &Metrics::histogram("enemycraft_step_seconds",
+			"Time a whole world step took", Metrics::timeBuckets(), labels);
+	blocksAdded = &Metrics::counter("enemycraft_blocks_added_total",
+			"Blocks added to the world", labels);
+	blocksRemoved = &Metrics::counter("enemycraft_blocks_removed_total",
+			"Blocks removed from the world", labels);
+	blocksMoved = &Metrics::counter("enemycraft_blocks_moved_total",
+			"Moves of a block from one cell to another", labels);
+	blocksWoken = &Metrics::counter("enemycraft_blocks_woken_total",
+			"Resting blocks that started to move", labels);
+	blocksSlept = &Metrics::counter("enemycraft_blocks_slept_total",
+			"Moving blocks that came to rest", labels);
+	forceCellsTouched = &Metrics::counter("enemycraft_force_cells_touched_total",
+			"Force table cells written", labels);
+	blockCount = &Metrics::gauge("enemycraft_blocks", "Blocks in the world",
+			labels);
+	magnetCount = &Metrics::gauge("enemycraft_magnets", "Magnets in the world",
+			labels);
+	awakeCount = &Metrics::gauge("enemycraft_awake_blocks",
+			"Blocks that are moving (not resting in a chunk)", labels);
+	chunksResident = &Metrics::gauge("enemycraft_chunks_resident",
+			"Chunks generated and added to the world", labels);
+	poolThreads = &Metrics::gauge("enemycraft_pool_threads",
+			"Threads in the world's thread pool, busy seconds over this is the occupancy",
+			labels);
+	coldDecodes = &Metrics::counter("enemycraft_cold_decodes_total",
+			"Packed force table tiles unpacked for a write", labels);
+	coldDecodeTime = &Metrics::counter("enemycraft_cold_decode_seconds_total",
+			"Time spent unpacking force table tiles", labels, 1e-9);
+	coldChunks = &Metrics::gauge("enemycraft_cold_chunks",
+			"Force table tiles (one per chunk) held packed", labels);
+	coldRatio = &Metrics::gauge("enemycraft_cold_compression_ratio",
+			"Unpacked over packed size of the cold tiles", labels);
+	forceTableBytes = &Metrics::gauge("enemycraft_force_table_bytes",
+			"Memory held by the force table, hot and cold", labels);
+}
+
+World::~World() {
+	for (auto *field : flowFields) {
+		delete field;
+	}
+	delete generator;
+	delete raycaster;
+	delete materials;
+	delete blockManager;
+}
+
+void World::generate() {
+	blockManager->generateAll();
+	residentChunks = blockManager->getChunkGrid().getChunkCount();
+}
+
+void World::startGenerating(accur x, accur y) {
+	const ChunkGrid<gen> &grid = blockManager->getChunkGrid();
+	delete generator;
+	generator = new WorldGenerator<gen>(grid, randDevice());
+	residentChunks = 0;
+
+	gen chunkPixels = ChunkGrid<gen>::chunkSize * blockManager->getBlockSize();
+	gen centreX = (gen) (x / chunkPixels), centreY = (gen) (y / chunkPixels);
+	std::vector<gen> chunks(grid.getChunkCount());
+	for (gen i = 0; i < grid.getChunkCount(); i++) {
+		chunks[i] = i;
+	}
+	std::stable_sort(chunks.begin(), chunks.end(), [&](gen a, gen b) {
+		Point<gen> ca = grid.getChunkCoord(a), cb = grid.getChunkCoord(b);
+		gen da = tma::abs(ca.x - centreX) + tma::abs(ca.y - centreY);
+		gen db = tma::abs(cb.x - centreX) + tma::abs(cb.y - centreY);
+		return da < db;
+	});
+	for (gen chunk : chunks) {
+		Point<gen> coord = grid.getChunkCoord(chunk);
+		generator->request(coord.x, coord.y);
+	}
+}
+
+int World::commitGeneratedChunks(int maxChunks) {
+	if (generator == nullptr) {
+		return 0;
+	}
+	generator->generate(threadPool, maxChunks);
+	WorldGenerator<gen>::ChunkData chunk;
+	int committed = 0;
+	while (committed < maxChunks && generator->takeNext(chunk)) {
+		blockManager->fillChunk(chunk);
+		residentChunks++;
+		committed++;
+	}
+	if (!generator->hasOutstanding()) {
+		delete generator;
+		generator = nullptr;
+	}
+	return committed;
+}
+
+void World::step(accur dt) {
+	std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point mark = start;
+	AllocationScope scope(AllocationTracker::Simulation, true);
+	scheduler.advance([this](gen x, gen y, int action) {
+		blockActions[action](x, y);
+	});
+	mark = endPhase(SchedulerPhase, mark);
+	commitGeneratedChunks(generatedPerStep);
+	mark = endPhase(GenerationPhase, mark);
+	{
+		AllocationScope forceScope(AllocationTracker::Forces);
+		updateBlockForces();
+	}
+	mark = endPhase(ForcesPhase, mark);
+	updateBlockVelocity(dt);
+	mark = endPhase(VelocityPhase, mark);
+	enforceBoxBounds();
+	mark = endPhase(BoundsPhase, mark);
+	updateBlockPositions(dt);
+	mark = endPhase(PositionsPhase, mark);
+	{
+		AllocationScope materialScope(AllocationTracker::Materials);
+		materials->step(blockManager->getOccupancy(), threadPool);
+	}
+	mark = endPhase(MaterialsPhase, mark);
+	{
+		AllocationScope flowFieldScope(AllocationTracker::FlowFields);
+		for (auto *field : flowFields) {
+			field->update(*blockManager, threadPool);
+		}
+	}
+	mark = endPhase(FlowFieldPhase, mark);
+	{
+		AllocationScope lightScope(AllocationTracker::Light);
+		blockManager->updateLight();
+	}
+	mark = endPhase(LightPhase, mark);
+	if (coldTicks > 0 && ++ticks % coolInterval == 0) {
+		AllocationScope coolingScope(AllocationTracker::Forces);
+		blockManager->getForceTable()->cool(coldTicks / coolInterval);
+	}
+	mark = endPhase(CoolingPhase, mark);
+	stepTime->observe(std::chrono::duration<double>(mark - start).count());
+	publishMetrics();
+}
+
+std::chrono::steady_clock::time_point World::endPhase(StepPhase phase,
+		std::chrono::steady_clock::time_point start) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	phaseTimes[phase]->add(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+	return now;
+}
+
+/*
+ * The BlockManager and ForceTable only keep plain running totals, so the
+ * hot paths never touch an atomic; the difference goes to the counters here.
+ */
+void World::publishMetrics() {
+	const BlockManager<accur, gen>::Stats &stats = blockManager->getStats();
+	blocksAdded->add(stats.added - publishedStats.added);
+	blocksRemoved->add(stats.removed - publishedStats.removed);
+	blocksMoved->add(stats.moved - publishedStats.moved);
+	blocksWoken->add(stats.woken - publishedStats.woken);
+	blocksSlept->add(stats.slept - publishedStats.slept);
+	publishedStats = stats;
+	unsigned long long cellsTouched =
+			blockManager->getForceTable()->getCellsTouched();
+	// A table swapped in from outside starts counting from zero again
+	forceCellsTouched->add(
+			cellsTouched >= publishedCellsTouched ?
+					cellsTouched - publishedCellsTouched : cellsTouched);
+	publishedCellsTouched = cellsTouched;
+	const ForceTable<gen, accur> &forces = *blockManager->getForceTable();
+	unsigned long long decodes = forces.getDecodes();
+	unsigned long long decodeNanos = forces.getDecodeNanos();
+	if (decodes >= publishedDecodes) {
+		coldDecodes->add(decodes - publishedDecodes);
+		coldDecodeTime->add(decodeNanos - publishedDecodeNanos);
+	} else {
+		coldDecodes->add(decodes);
+		coldDecodeTime->add(decodeNanos);
+	}
+	publishedDecodes = decodes;
+	publishedDecodeNanos = decodeNanos;
+	coldChunks->set((double) forces.getColdTiles());
+	coldRatio->set(
+			forces.getPackedBytes() > 0 ?
+					(double) forces.getUnpackedBytes(forces.getColdTiles())
+							/ forces.getPackedBytes() : 0.0);
+	forceTableBytes->set((double) forces.getMemoryUsage());
+
+	const OccupancyMap<gen> &occupancy = blockManager->getOccupancy();
+	blockCount->set((double) occupancy.getCount());
+	magnetCount->set((double) occupancy.getMagnetCount());
+	awakeCount->set((double) occupancy.getAwakeCount());
+	chunksResident->set((double) residentChunks);
+	poolThreads->set((double) threadPool.getNumThreads());
+}
+
+FlowField<accur, gen>* World::addFlowField(
+		const std::vector<Point<gen>> &targets) {
+	auto *field = new FlowField<accur, gen>(blockManager->getChunkGrid(),
+			blockManager->getBlockSize(), targets);
+	field->update(*blockManager, threadPool);
+	flowFields.push_back(field);
+	return field;
+}
+
+void World::removeFlowField(FlowField<accur, gen> *field) {
+	auto found = std::find(flowFields.begin(), flowFields.end(), field);
+	if (found != flowFields.end()) {
+		flowFields.erase(found);
+		delete field;
+	}
+}
+
+int World::addBlockAction(const std::function<void(gen, gen)> &action) {
+	blockActions.push_back(action);
+	return blockActions.size() - 1;
+}
+
+void World::scheduleBlockAction(gen x, gen y, int action,
+		unsigned long delay) {
+	if (action < 0 || action >= (int) blockActions.size()) {
+		throw std::out_of_range("No block action " + std::to_string(action));
+	}
+	scheduler.schedule(x, y, action, delay);
+}
+
+bool World::addBlock(accur x, accur y) {
+	if (!contains(x, y)) {
+		return false;
+	}
+	gen cellX = (gen) (x / blockManager->getBlockSize());
+	gen cellY = (gen) (y / blockManager->getBlockSize());
+	if (blockManager->getOccupancy().test(cellX, cellY)) {
+		return false;
+	}
+	blockManager->place(cellX, cellY, blockManager->getDefaultType(), 0);
+	return true;
+}
+
+bool World::addMaterial(accur x, accur y,
+		MaterialGrid<gen>::Material material) {
+	if (!contains(x, y)) {
+		return false;
+	}
+	gen cellX = (gen) (x / blockManager->getBlockSize());
+	gen cellY = (gen) (y / blockManager->getBlockSize());
+	if (blockManager->getOccupancy().test(cellX, cellY)
+			|| materials->get(cellX, cellY) == material) {
+		return false;
+	}
+	materials->set(cellX, cellY, material);
+	return true;
+}
+
+bool World::removeBlock(accur x, accur y) {
+	if (!contains(x, y)
+			|| !blockManager->getOccupancy().test(
+					(gen) (x / blockManager->getBlockSize()),
+					(gen) (y / blockManager->getBlockSize()))) {
+		return false;
+	}
+	blockManager->remove(x, y);
+	return true;
+}
+
+bool World::rotateBlock(accur x, accur y) {
+	if (!contains(x, y)) {
+		return false;
+	}
+	gen cellX = (gen) (x / blockManager->getBlockSize());
+	gen cellY = (gen) (y / blockManager->getBlockSize());
+	int magnetFacingDirection = blockManager->getCellKind(cellX, cellY);
+	if (magnetFacingDirection == BlockManager<accur, gen>::emptyCell) {
+		return false;
+	}
+	// When the magnet's direction is already 4 (the last one), it should go back to 0
+	blockManager->setCellDirection(cellX, cellY,
+			(magnetFacingDirection >= 4) ? 0 : magnetFacingDirection + 1);
+	return true;
+}
+
+bool World::contains(accur x, accur y) const {
+	return x >= (accur) 0 && y >= (accur) 0
+			&& (gen) (x / blockManager->getBlockSize())
+					< blockManager->getWidth()
+			&& (gen) (y / blockManager->getBlockSize())
+					< blockManager->getHeight();
+}
+
+void World::updateBlockForces() {
+	blockManager->refreshMagnetTree();
+	Block<accur> **arr = blockManager->getBlockMap()->getArr();
+	gen rows = blockManager->getBlockMap()->getRows();
+	// Every magnet moves its force at once, so let the force table catch up in one sweep
+	// (resting magnets stay put, so only the awake ones can have moved)
+	blockManager->beginEdit();
+	blockManager->getOccupancy().getAwake().forEach([&](gen x, gen y) {
+		Block<accur> *block = arr[y * rows + x];
+		if (!block->isMagnetic()) {
+			return;
+		}
+		Point<gen> blockPos = blockManager->getBlockyCoordinates(
+				block->getCoord().x, block->getCoord().y);
+		Point<gen> previousPos = blockManager->getBlockyCoordinates(
+				block->getPreviousCoord().x, block->getPreviousCoord().y);
+		// Still in the same cell, so its force (and everything it pushes on) stays as it is
+		if (blockPos.x == previousPos.x && blockPos.y == previousPos.y) {
+			return;
+		}
+		blockManager->removeMagneticForce(block->getPreviousCoord(), block);
+		blockManager->addMagneticForce((accur) blockPos.x, (accur) blockPos.y,
+				block);
+	});
+	blockManager->endEdit();
+}
+
+// Calculate block position based on velocity
+
+// A = F/M
+void World::updateBlockVelocity(accur dt) {
+	wakePushedBlocks();
+	// Forces were tuned as kicks given once per 60 Hz frame, keep that strength at any tick rate
+	accur kick = dt * forceTuningRate;
+	Block<accur> **arr = blockManager->getBlockMap()->getArr();
+	gen rows = blockManager->getBlockMap()->getRows();
+	const BitGrid<gen> &awake = blockManager->getOccupancy().getAwake();
+	// Every block only writes its own velocity, so the slices (of grid rows) can run side by side
+	threadPool.parallelFor<gen>(0, awake.getHeight(), 4,
+			[&](gen begin, gen end) {
+				awake.forEachInRows(begin, end, [&](gen x, gen y) {
+					Block<accur> *block = arr[y * rows + x];
+					Point<gen> pos = blockManager->getBlockyCoordinates(
+							block->getCoord().x, block->getCoord().y);
+					Point<accur> f = blockManager->getForceTable()->getForce(
+							(accur) pos.x, (accur) pos.y);
+					if (block->isMagnetic()) {
+						Point<accur> pull = blockManager->getMagnetInteraction(
+								(accur) pos.x, (accur) pos.y, block);
+						f.x += pull.x;
+						f.y += pull.y;
+					}
+					block->setVx(block->getVx() + f.x / block->getMass() * kick);
+					block->setVy(block->getVy() + f.y / block->getMass() * kick);
+
+					// Debug Messages
+//					std::cout << "fx: " << f.x << ", fy: " << f.y << std::endl;
+				});
+			});
+}
+
+/*
+ * A resting block only starts moving once the forces on it stop cancelling
+ * out, which can only happen to the cells BlockManager reports as changed.
+ * Checks those (in parallel) and wakes the pushed ones up for
+ * updateBlockVelocity().
+ */
+void World::wakePushedBlocks() {
+	const OccupancyMap<gen> &occupancy = blockManager->getOccupancy();
+	const std::vector<Point<gen>> &changed = blockManager->collectChangedCells();
+	gen blockSize = blockManager->getBlockSize();
+	pushed.assign(changed.size(), 0);
+	// Whatever changed next to a material might let it fall
+	for (const Point<gen> &cell : changed) {
+		materials->wake(cell.x, cell.y);
+	}
+	threadPool.parallelFor<std::size_t>(0, changed.size(), 256,
+			[&](std::size_t begin, std::size_t end) {
+				for (std::size_t i = begin; i < end; i++) {
+					gen x = changed[i].x, y = changed[i].y;
+					if (!occupancy.test(x, y) || occupancy.testAwake(x, y)) {
+						continue;
+					}
+					Point<accur> f = blockManager->getForceTable()->getForce(
+							(accur) (x * blockSize), (accur) (y * blockSize));
+					if (occupancy.testMagnetic(x, y)) {
+						Point<accur> pull = blockManager->getMagnetInteraction(
+								(accur) (x * blockSize), (accur) (y * blockSize),
+								blockManager->getMagneticMoment(x, y));
+						f.x += pull.x;
+						f.y += pull.y;
+					}
+					pushed[i] = f.x != (accur) 0 || f.y != (accur) 0;
+				}
+			});
+	for (std::size_t i = 0; i < changed.size(); i++) {
+		if (pushed[i]) {
+			blockManager->wake(changed[i].x, changed[i].y);
+		}
+	}
+}
+
+void World::enforceBoxBounds() {
+	Block<accur> **arr = blockManager->getBlockMap()->getArr();
+	gen rows = blockManager->getBlockMap()->getRows();
+	blockManager->getOccupancy().getAwake().forEach([&](gen x, gen y) {
+		Block<accur> *block = arr[y * rows + x];
+		const Point<accur> &pos = block->getCoord();
+		if (pos.x < (accur) 0) {
+			// Set velocity greater than zero
+			block->setVx(tma::abs(block->getVx()));
+		} else if (pos.x + block->getLength() > (accur) w) {
+			block->setVx(
+					block->getVx() < (accur) 0 ? block->getVx() : -block->getVx());
+		}
+
+		if (pos.y < (accur) 0) {
+			block->setVy(tma::abs(block->getVy()));
+		} else if (pos.y + block->getLength() > (accur) h) {
+			block->setVy(
+					block->getVy() < (accur) 0 ? block->getVy() : -block->getVy());
+		}
+	});
+}
+
+void World::updateBlockPositions(accur dt) {
+	gen numRows = blockManager->getBlockMap()->getRows();
+	gen numColumns = blockManager->getBlockMap()->getColumns();
+	gen blockSize = blockManager->getBlockSize();
+	// Take the list of blocks up front, so a block that moves further along isn't moved twice
+	movingCells.clear();
+	blockManager->getOccupancy().getAwake().forEach([this](gen x, gen y) {
+		movingCells.emplace_back(x, y);
+	});
+	for (const Point<gen> &cell : movingCells) {
+		accur x = (accur) cell.x, y = (accur) cell.y;
+		gen atX = cell.x, atY = cell.y;
+		auto *block = blockManager->getBlockMap()->getArr()[cell.y * numRows + cell.x];
+		accur deltaX = block->getVx() * dt;
+		accur deltaY = block->getVy() * dt;
+
+		gen newPosX = (gen) ((block->getCoord().x + deltaX) / blockManager->getBlockSize());
+		gen newPosY = (gen) ((block->getCoord().y + deltaY) / blockManager->getBlockSize());
+		if ((newPosX != cell.x || newPosY != cell.y) && (newPosX >= 0 && newPosY >= 0 && newPosX < numRows && newPosY < numColumns)) {
+			if (!blockManager->getOccupancy().test(newPosX, newPosY)
+					&& materials->get(newPosX, newPosY)
+							== MaterialGrid<gen>::Empty) {
+				blockManager->move(block, x * blockSize, y * blockSize,
+						(accur) (newPosX * blockSize), (accur) (newPosY * blockSize));
+				atX = newPosX;
+				atY = newPosY;
+			} else {
+				deltaX = -deltaX;
+				deltaY = -deltaY;
+				blockManager->addEvent(BlockManager<accur, gen>::BlockCollided,
+						atX, atY);
+			}
+		}
+		block->moveWithStats(deltaX, deltaY);
+		if (deltaX != (accur) 0 || deltaY != (accur) 0) {
+			blockManager->markChanged(block->getCoord().x, block->getCoord().y);
+		}
+		// A block that stopped right on its cell only needs its palette entry again
+		if (blockManager->isAtRest(atX, atY)) {
+			blockManager->sleep(atX, atY);
+		}
+
+		// Debug Messages
+//		std::cout << "X: " << x << ", Y: " << y << ", newPosX: " << newPosX << ", newPosY: " << newPosY << std::endl;
+//		std::cout << "Vx: " << block->getVx() << ", Vy: " << block->getVy()
+//				<< std::endl;
+	}
+}
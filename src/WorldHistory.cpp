@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldHistory.cpp
+ *
+ *  Created on: Oct 21, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <unordered_set>
+#include <stdexcept>
+
+#include <WorldHistory.hpp>
+
+WorldHistory::WorldHistory(World &world, std::size_t capacity) :
+		world(world), ring(capacity), newest(0), size(0) {
+	if (capacity == 0) {
+		throw std::invalid_argument("A world history needs room for a snapshot");
+	}
+}
+
+void WorldHistory::record() {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	const Snapshot *previous = size > 0 ? &ring[newest] : nullptr;
+	std::size_t slot = size > 0 ? (newest + 1) % ring.size() : newest;
+	ring[slot] = blockManager->takeSnapshot(previous);
+	newest = slot;
+	if (size < ring.size()) {
+		size++;
+	}
+}
+
+bool WorldHistory::rewind(std::size_t steps) {
+	if (steps == 0 || steps > size) {
+		return false;
+	}
+	world.getBlockManager()->restoreSnapshot(ring[getSlot(steps - 1)]);
+	for (std::size_t i = 0; i < steps; i++) {
+		ring[getSlot(0)].clear();
+		newest = getSlot(1);
+		size--;
+	}
+	return true;
+}
+
+void WorldHistory::clear() {
+	for (Snapshot &snapshot : ring) {
+		snapshot.clear();
+	}
+	newest = 0;
+	size = 0;
+}
+
+std::size_t WorldHistory::getMemoryUsage() const {
+	std::unordered_set<const void*> counted;
+	std::size_t total = 0;
+	for (std::size_t back = 0; back < size; back++) {
+		const Snapshot &snapshot = ring[getSlot(back)];
+		total += snapshot.capacity() * sizeof(Snapshot::value_type);
+		for (const auto &state : snapshot) {
+			if (!counted.insert(state.get()).second) {
+				continue;
+			}
+			total += sizeof(*state)
+					+ state->moving.capacity() * sizeof(state->moving[0]);
+			if (counted.insert(state->resting.get()).second) {
+				total += sizeof(PalettedChunk) + state->resting->getMemoryUsage();
+			}
+		}
+	}
+	return total;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldHost.cpp
+ *
+ *  Created on: Oct 30, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <WorldHost.hpp>
+
+WorldHost::WorldHost(TextureManager &manager, unsigned int numLanes) :
+		textureManager(manager), stepDt(0), stepTicks(0), stepId(0), lanesRunning(
+				0), stopping(false) {
+	if (numLanes == 0) {
+		numLanes = std::max(1u, std::thread::hardware_concurrency());
+	}
+	worldCount = &Metrics::gauge("enemycraft_host_worlds",
+			"Worlds run by the world host");
+	for (unsigned int i = 0; i < numLanes; i++) {
+		lanes.emplace_back(new Lane());
+		lanes.back()->busyTime = &Metrics::counter(
+				"enemycraft_host_lane_busy_seconds_total",
+				"Time each lane of the world host spent stepping its worlds",
+				"lane=\"" + std::to_string(i) + "\"", 1e-9);
+	}
+	// Only once every lane exists, laneLoop() looks at lanes
+	for (unsigned int i = 0; i < numLanes; i++) {
+		lanes[i]->thread = std::thread(&WorldHost::laneLoop, this, i);
+#ifdef __linux__
+		unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(i % cpus, &set);
+		// Only a hint, the lane works the same unpinned
+		pthread_setaffinity_np(lanes[i]->thread.native_handle(), sizeof(set),
+				&set);
+#endif
+	}
+}
+
+WorldHost::~WorldHost() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (auto &lane : lanes) {
+		lane->thread.join();
+	}
+	// The worlds go before the lanes' pools they were given
+	worlds.clear();
+}
+
+std::size_t WorldHost::addWorld(unsigned int width, unsigned int height,
+		unsigned int seed) {
+	auto least = std::min_element(lanes.begin(), lanes.end(),
+			[](const std::unique_ptr<Lane> &a, const std::unique_ptr<Lane> &b) {
+				return a->cells < b->cells;
+			});
+	Lane &lane = **least;
+	Hosted hosted;
+	hosted.lane = (unsigned int) (least - lanes.begin());
+	hosted.world.reset(
+			new World(width, height, textureManager, lane.pool, seed,
+					&blockTypes, std::to_string(worlds.size())));
+	hosted.world->generate();
+	lane.worlds.push_back(hosted.world.get());
+	lane.cells += (std::size_t) hosted.world->getBlockManager()->getWidth()
+			* hosted.world->getBlockManager()->getHeight();
+	worlds.push_back(std::move(hosted));
+	worldCount->set((double) worlds.size());
+	return worlds.size() - 1;
+}
+
+void WorldHost::step(accur dt, unsigned int ticks) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stepDt = dt;
+		stepTicks = ticks;
+		lanesRunning = (unsigned int) lanes.size();
+		stepId++;
+	}
+	wakeUp.notify_all();
+	std::unique_lock<std::mutex> lock(mutex);
+	stepDone.wait(lock, [this] {
+		return lanesRunning == 0;
+	});
+	for (auto &lane : lanes) {
+		if (lane->error) {
+			std::exception_ptr error = lane->error;
+			lane->error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+void WorldHost::laneLoop(unsigned int index) {
+	Lane &lane = *lanes[index];
+	unsigned long seenStep = 0;
+	while (true) {
+		accur dt;
+		unsigned int ticks;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [&] {
+				return stopping || stepId != seenStep;
+			});
+			if (stopping) {
+				return;
+			}
+			seenStep = stepId;
+			dt = stepDt;
+			ticks = stepTicks;
+		}
+		auto start = std::chrono::steady_clock::now();
+		try {
+			for (unsigned int t = 0; t < ticks; t++) {
+				for (World *world : lane.worlds) {
+					world->step(dt);
+				}
+			}
+		} catch (...) {
+			lane.error = std::current_exception();
+		}
+		lane.busyTime->add(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start).count());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			lanesRunning--;
+		}
+		stepDone.notify_all();
+	}
+}
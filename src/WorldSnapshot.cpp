@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021, suncloudsmoon and the Enemycraft contributors.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * WorldSnapshot.cpp
+ *
+ *  Created on: Oct 13, 2021
+ *      Author: suncloudsmoon
+ */
+
+#include <algorithm>
+
+#include <WorldSnapshot.hpp>
+#include <NetProtocol.hpp>
+
+WorldSnapshot::WorldSnapshot() :
+		tick(0), width(0), height(0), blockSize(0) {
+}
+
+void WorldSnapshot::resize(gen cellsWide, gen cellsHigh, gen bSize) {
+	width = cellsWide;
+	height = cellsHigh;
+	blockSize = bSize;
+	gen cells = cellsWide * cellsHigh;
+	states.assign(cells, 0);
+	offsetX.assign(cells, 0);
+	offsetY.assign(cells, 0);
+	velocityX.assign(cells, 0);
+	velocityY.assign(cells, 0);
+}
+
+void WorldSnapshot::capture(World &world, unsigned long tickNumber) {
+	BlockManager<accur, gen> *blockManager = world.getBlockManager();
+	if (width != blockManager->getWidth() || height != blockManager->getHeight()) {
+		resize(blockManager->getWidth(), blockManager->getHeight(),
+				blockManager->getBlockSize());
+	}
+	tick = tickNumber;
+
+	// Clear everything in bulk, then only visit the cells that hold a block
+	std::fill(states.begin(), states.end(), 0);
+	std::fill(offsetX.begin(), offsetX.end(), 0);
+	std::fill(offsetY.begin(), offsetY.end(), 0);
+	std::fill(velocityX.begin(), velocityX.end(), 0);
+	std::fill(velocityY.begin(), velocityY.end(), 0);
+	blockManager->getOccupancy().getOccupied().forEach([&](gen x, gen y) {
+			gen i = y * width + x;
+			states[i] = 1 + blockManager->getCellKind(x, y);
+			// A resting block has no offset or velocity to save
+			Block<accur> *block = blockManager->getAwakeBlock(x, y);
+			if (block == nullptr) {
+				return;
+			}
+			offsetX[i] = (std::int32_t) ((double) block->getCoord().x
+					* positionScale) - x * blockSize * positionScale;
+			offsetY[i] = (std::int32_t) ((double) block->getCoord().y
+					* positionScale) - y * blockSize * positionScale;
+			velocityX[i] = (std::int32_t) ((double) block->getVx()
+					* positionScale);
+			velocityY[i] = (std::int32_t) ((double) block->getVy()
+					* positionScale);
+		});
+}
+
+std::size_t WorldSnapshot::getNaiveSize() const {
+	std::size_t size = states.size();
+	for (std::uint8_t state : states) {
+		if (state != 0) {
+			size += 4 * sizeof(std::int32_t);
+		}
+	}
+	return size;
+}
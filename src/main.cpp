@@ -24,13 +24,39 @@
  */
 
 #include <iostream>
+#include <string>
 
 #include <Game.hpp>
 #include <Point.hpp>
 
 const Point<unsigned int> fullHD(1920, 1080);
 
-int main() {
+/*
+ * Options that go with any game, from argv[first] on
+ */
+static void applyOptions(Game &g, int argc, char **argv, int first) {
+	for (int i = first; i + 1 < argc; i += 2) {
+		std::string option = argv[i];
+		if (option == "--share") {
+			// --share <name> also publishes the world for tools like enemycraft-forcedump
+			g.shareWorld(argv[i + 1]);
+		} else if (option == "--metrics") {
+			// --metrics <port> serves Prometheus metrics on localhost
+			g.serveMetrics((unsigned short) std::stoi(argv[i + 1]));
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	// Enemycraft --connect <host> <port> joins a world hosted by enemycraft-server
+	if (argc >= 4 && std::string(argv[1]) == "--connect") {
+		Game g("Enemycraft - Just Imagine", fullHD.x, fullHD.y, argv[2],
+				(unsigned short) std::stoi(argv[3]));
+		applyOptions(g, argc, argv, 4);
+		g.startGameLoop();
+		return 0;
+	}
+
 //	try {
 //		Game g("Enemycraft - Just Imagine", fullHD);
 //		g.startGameLoop();
@@ -39,7 +65,17 @@ int main() {
 //	} catch (...) {
 //		std::cerr << "An Unknown Exception Occurred!" << std::endl;
 //	}
-	Game g("Enemycraft - Just Imagine", fullHD);
+	// --world <width>x<height> simulates a world bigger than the window (in pixels), scroll to zoom out
+	Point<unsigned int> worldSize = fullHD;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (std::string(argv[i]) == "--world") {
+			std::string size = argv[i + 1];
+			std::size_t x = size.find('x');
+			worldSize.x = std::stoi(size.substr(0, x));
+			worldSize.y = x == std::string::npos ? worldSize.x : std::stoi(size.substr(x + 1));
+		}
+	}
+	Game g("Enemycraft - Just Imagine", fullHD, worldSize);
+	applyOptions(g, argc, argv, 1);
 	g.startGameLoop();
 }
-